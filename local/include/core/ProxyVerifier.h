@@ -10,17 +10,22 @@
 #include <condition_variable>
 #include <deque>
 #include <list>
+#include <mutex>
 #include <string>
 #include <string_view>
+#include <sys/uio.h>
 #include <thread>
 #include <unistd.h>
+#include <vector>
 
 #include "swoc/BufferWriter.h"
 #include "swoc/Errata.h"
+#include "swoc/MemSpan.h"
 #include "swoc/TextView.h"
 #include "swoc/bwf_base.h"
 #include "swoc/swoc_ip.h"
 
+/// Whether diag level messages are logged, as configured by configure_logging.
 extern bool Verbose;
 
 /** Configure the process to block SIGPIPE.
@@ -98,3 +103,72 @@ protected:
   std::mutex _threadPoolMutex;
   size_t max_threads = default_max_threads;
 };
+
+/** Writes log files, such as qlog and TLS key logs, from a background thread.
+ *
+ * Callers hand over whole buffers of log data. Their only cost is appending
+ * the buffer to a queue, so logging does not add write system calls, nor a
+ * lock held across them, to the threads replaying traffic. The writer gathers
+ * the queued buffers of each file into a single writev.
+ */
+class LogFileWriter
+{
+public:
+  /// The most bytes queued before callers wait for the writer to catch up.
+  static constexpr size_t MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+
+  /** Queue @a data to be written to @a fd.
+   *
+   * The writer thread is started on first use. If MAX_QUEUED_BYTES are
+   * already queued, this waits until the writer takes them. Once the writer
+   * is terminated, the data is instead written before returning.
+   *
+   * @param[in] fd The file to write to.
+   * @param[in] data The data to write.
+   * @param[in] close_fd Whether to close @a fd after writing @a data. No more
+   * data may be queued for @a fd.
+   */
+  static void write(int fd, std::string &&data, bool close_fd = false);
+
+  /** Write the queued data and stop the writer thread. */
+  static void terminate();
+
+private:
+  /// Data to write.
+  struct Chunk
+  {
+    int _fd = -1;
+    std::string _data;
+    bool _close_fd = false;
+  };
+
+  /// Write queued chunks until terminate is called.
+  static void run();
+
+  /// Write @a chunk now.
+  static void write_chunk(Chunk &chunk);
+
+  /** Write the chunks of @a chunks indexed by @a group, which are for the same
+   * file, then empty @a group.
+   *
+   * @param[in] iov Storage for the gathered buffers, reused across calls.
+   */
+  static void
+  write_group(std::vector<Chunk> &chunks, std::vector<size_t> &group, std::vector<iovec> &iov);
+
+  /// Write all of @a iov to @a fd, which is closed afterward if @a close_fd.
+  static void write_all(int fd, swoc::MemSpan<iovec> iov, bool close_fd);
+
+  /// Guards the members below.
+  static std::mutex _mutex;
+  /// Signaled when chunks are queued.
+  static std::condition_variable _cvar;
+  /// Signaled when the writer takes the queued chunks.
+  static std::condition_variable _space_cvar;
+  static std::vector<Chunk> _queue;
+  /// The size of the data of _queue.
+  static size_t _queued_bytes;
+  static std::thread _thread;
+  /// Whether terminate has been called.
+  static bool _terminated;
+};
@@ -24,6 +24,8 @@
 
 class HttpFields;
 class HttpHeader;
+struct H2Settings;
+struct QuicSettings;
 
 // Delay specification units.
 static const std::string MICROSECONDS_SUFFIX{"us"};
@@ -43,6 +45,7 @@ static const std::string YAML_SSN_PROTOCOL_NAME{"name"};
 static const std::string YAML_SSN_PROTOCOL_VERSION{"version"};
 static const std::string YAML_SSN_PROTOCOL_TLS_NAME{"tls"};
 static const std::string YAML_SSN_PROTOCOL_HTTP_NAME{"http"};
+static const std::string YAML_SSN_HTTP_SETTINGS_KEY{"settings"};
 static const std::string YAML_SSN_TLS_SNI_KEY{"sni"};
 static const std::string YAML_SSN_TLS_ALPN_PROTOCOLS_KEY{"alpn-protocols"};
 static const std::string YAML_SSN_TLS_VERIFY_MODE_KEY{"verify-mode"};
@@ -239,6 +242,22 @@ protected:
 
   static swoc::Rv<std::string> parse_alpn_protocols_node(YAML::Node const &tls_node);
 
+  /** Parse an "http" node for the HTTP/2 "settings" map.
+   *
+   * @param[in] http_node The http node from which to parse the settings.
+   *
+   * @return The settings, which are all unset if there is no "settings" map.
+   */
+  static swoc::Rv<H2Settings> parse_h2_settings(YAML::Node const &http_node);
+
+  /** Parse an HTTP/3 "http" node for its QUIC "settings" map.
+   *
+   * @param[in] http_node The http node from which to parse the settings.
+   *
+   * @return The settings, which are all unset if there is no "settings" map.
+   */
+  static swoc::Rv<QuicSettings> parse_quic_settings(YAML::Node const &http_node);
+
 protected:
   /** The replay file associated with this handler.
    */
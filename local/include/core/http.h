@@ -9,15 +9,20 @@
 
 #include "case_insensitive_utils.h"
 
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <list>
 #include <map>
+#include <memory>
+#include <optional>
 #include <unordered_map>
 #include <nghttp2/nghttp2.h>
 #include <nghttp3/nghttp3.h>
 #include <openssl/ssl.h>
 #include <poll.h>
 #include <string>
+#include <sys/uio.h>
 #include <vector>
 
 #include "swoc/BufferWriter.h"
@@ -178,6 +183,13 @@ public:
    */
   void merge(self_type const &other);
 
+  /** Remove all fields and rules.
+   *
+   * The capacity of _fields_sequence is kept for the fields of the next
+   * message.
+   */
+  void clear();
+
   /** Convert _fields into nghttp2_nv and add them to the provided vector.
    *
    * This assumes that the pseudo header fields are handled separately.  If
@@ -208,6 +220,131 @@ enum class HTTP_PROTOCOL_TYPE {
   HTTP_3,
 };
 
+/** The per-send values substituted into request templates.
+ *
+ * The client sets one of these on each Session it replays so that repeated
+ * replays of the same session (see --repeat) render distinct URLs and field
+ * values without copying the transactions.
+ */
+struct TemplateContext
+{
+  /// The --repeat iteration for which the session is being replayed, from 0.
+  unsigned _iteration = 0;
+  /// The index of the session in the replay corpus, from 0.
+  unsigned _session_index = 0;
+};
+
+/** A URL or field value compiled into literal and substitution segments.
+ *
+ * Client request URLs and field values may contain the following tokens:
+ *
+ *   - {{iteration}}: The --repeat iteration of the session.
+ *   - {{session}}: The index of the session in the replay corpus.
+ *   - {{random}}: Sixteen random hexadecimal digits.
+ *   - {{unique}}: A process-wide, monotonically increasing number.
+ *
+ * Templates are compiled once when the replay files are loaded and rendered
+ * when the message is sent. The server uses matches() to map a rendered
+ * value back to the template from which it was rendered.
+ */
+class RequestTemplate
+{
+public:
+  /// The kinds of segments a template is composed of.
+  enum class Token {
+    LITERAL,   ///< Text copied as is.
+    ITERATION, ///< {{iteration}}
+    SESSION,   ///< {{session}}
+    RANDOM,    ///< {{random}}
+    UNIQUE,    ///< {{unique}}
+    INVALID
+  };
+
+  /// The number of hex digits rendered for a {{random}} token.
+  static constexpr size_t RANDOM_WIDTH = 16;
+
+  /** Whether @a text contains a template token opener.
+   *
+   * @param[in] text The URL or field value to inspect.
+   *
+   * @return True if @a text should be compiled as a template.
+   */
+  static bool has_tokens(swoc::TextView text);
+
+  /** Compile @a text into a template.
+   *
+   * @param[in] text The text to compile. The template refers to the memory of
+   * this view, so it should be localized.
+   *
+   * @return The compiled template and any errata for malformed tokens.
+   */
+  static swoc::Rv<RequestTemplate> compile(swoc::TextView text);
+
+  /// The values substituted for the tokens of a message's templates.
+  struct Values
+  {
+    unsigned _iteration = 0;
+    unsigned _session_index = 0;
+    uint64_t _random = 0;
+    uint64_t _unique = 0;
+  };
+
+  /** Draw the values with which to render the templates of one message.
+   *
+   * The {{random}} and {{unique}} values are drawn anew with each call, so
+   * every template of a message should be rendered with the same Values for
+   * its URL, pseudo headers and fields to agree.
+   *
+   * @param[in] context The iteration and session values to substitute.
+   *
+   * @return The values for a single message.
+   */
+  static Values make_values(TemplateContext const &context);
+
+  /** Render the template into @a w.
+   *
+   * @param[out] w The buffer into which to write the rendered value.
+   * @param[in] values The values to substitute. See make_values().
+   */
+  void render(swoc::BufferWriter &w, Values const &values) const;
+
+  /** Render the template into memory allocated from @a arena.
+   *
+   * @param[in] arena The arena providing storage for the rendered value.
+   * @param[in] values The values to substitute. See make_values().
+   *
+   * @return A view of the rendered value in @a arena.
+   */
+  swoc::TextView render(swoc::MemArena &arena, Values const &values) const;
+
+  /** Whether @a text is a possible rendering of this template.
+   *
+   * @param[in] text The rendered value, such as a key received by the server.
+   * @param[in] is_nocase Whether literal segments are compared ignoring case.
+   *
+   * @return True if each literal segment matches and each token matches text
+   * of the form that token renders.
+   */
+  bool matches(swoc::TextView text, bool is_nocase = false) const;
+
+  /// The length of the literal text before the first token.
+  size_t literal_prefix_size() const;
+
+private:
+  struct Segment
+  {
+    Token _token = Token::LITERAL;
+    swoc::TextView _literal; ///< The text for LITERAL segments.
+  };
+
+  bool matches(size_t segment_index, swoc::TextView text, bool is_nocase) const;
+
+  std::vector<Segment> _segments;
+
+  /// The source of {{unique}} values.
+  static std::atomic<uint64_t> _next_unique;
+};
+
 // TODO: rename to HttpMessage?
 class HttpHeader
 {
@@ -247,7 +384,51 @@ public:
   swoc::Errata update_content_length(TextView method);
   swoc::Errata update_transfer_encoding();
 
-  swoc::Errata serialize(swoc::BufferWriter &w) const;
+  /** Write this message in HTTP/1 form.
+   *
+   * @param[out] w The buffer into which the message is serialized.
+   * @param[in] context The values with which to render any templates.
+   *
+   * @return Any errata from serialization.
+   */
+  swoc::Errata serialize(swoc::BufferWriter &w, TemplateContext const &context = {}) const;
+
+  /** Compile templates for the URL, pseudo header, and field values of this
+   * message that contain template tokens.
+   *
+   * This is expected to be called once after the message is loaded from the
+   * replay file. See RequestTemplate.
+   *
+   * @return Any errata from compiling malformed templates.
+   */
+  swoc::Errata compile_templates();
+
+  /// Whether this message has any values compiled as templates.
+  bool has_templates() const;
+
+  /** Replace the values of templated pseudo headers and fields in @a nva with
+   * their rendered form.
+   *
+   * @a nva is expected to have been populated with pseudo headers first and
+   * then the fields as done by HttpFields::add_fields_to_ngnva.
+   *
+   * @param[in,out] nva The header array to update.
+   * @param[in] nva_count The number of elements in @a nva.
+   * @param[in] arena The storage for the rendered values. This must outlive
+   * the use of @a nva.
+   * @param[in] context The context with which to render the templates. The
+   * {{random}} and {{unique}} values are drawn once for all of them.
+   */
+  void render_templates(
+      nghttp2_nv *nva,
+      int nva_count,
+      swoc::MemArena &arena,
+      TemplateContext const &context) const;
+  void render_templates(
+      nghttp3_nv *nva,
+      int nva_count,
+      swoc::MemArena &arena,
+      TemplateContext const &context) const;
 
   /** A marker indicating that this transaction's key is not yet set nor derived.
    */
@@ -341,6 +522,14 @@ public:
   /// Return whether this is an HTTP response.
   bool is_response() const;
 
+  /** Reset to the state of a newly constructed instance for another message.
+   *
+   * Unlike assigning a new instance, this keeps the allocated storage of the
+   * fields and key for reuse. The fields are replaced rather than cleared if
+   * another message shares them.
+   */
+  void clear();
+
   /// Whether the _fields array contains pseudo header fields.
   bool _contains_pseudo_headers_in_fields_array = false;
   int32_t _stream_id = -1; ///< For protocols with streams, this is the stream identifier.
@@ -412,6 +601,14 @@ public:
   /// Format string to generate a key from a transaction.
   static std::string _key_format;
 
+  /** Prepare _content to provide bodies of up to @a n bytes.
+   *
+   * The content is a pattern of 8 byte hex stamps of each 8 byte offset,
+   * counted modulo CONTENT_PATTERN_PERIOD. The bytes at a given offset are
+   * therefore the same for every body and every corpus, whatever the largest
+   * body is. Content larger than the period is mirrored from a region of a
+   * whole number of periods.
+   */
   static void set_max_content_length(size_t n);
 
   static void global_init();
@@ -419,8 +616,49 @@ public:
   /// Precomputed content buffer.
   static swoc::MemSpan<char> _content;
 
+  /** A memfd holding the content pattern, or -1 if one could not be created.
+   *
+   * _content is a shared mapping of this file so that bodies can be sent
+   * directly from it via sendfile. For large content, the file holds a single
+   * region of _content_region_size bytes which is mapped repeatedly to span
+   * all of _content, keeping memory use bounded by the region size.
+   */
+  static int _content_fd;
+
+  /// The size of the region of _content backed by _content_fd.
+  static size_t _content_region_size;
+
+  /** The period of the content pattern's offset stamps.
+   *
+   * Content up to this size is mapped once rather than mirrored. The stamps
+   * of this period fit in the seven hex digits of each stamp.
+   */
+  static constexpr size_t CONTENT_PATTERN_PERIOD = 1 << 24;
+  /// The most copies of the region to map when mirroring content.
+  static constexpr size_t MAX_CONTENT_REGION_COPIES = 4096;
+
+  /** The offset of @a content within _content.
+   *
+   * @return The offset, or -1 if there is no content file or @a content is
+   * not part of _content.
+   */
+  static off_t content_file_offset(swoc::TextView content);
+
   bool _verify_strictly;
 
+  /// The compiled templates of a message. See compile_templates().
+  struct Templates
+  {
+    std::optional<RequestTemplate> _url;
+    std::optional<RequestTemplate> _authority;
+    std::optional<RequestTemplate> _path;
+    /// Field value templates keyed by their index in _fields_sequence.
+    std::unordered_map<size_t, RequestTemplate> _fields;
+  };
+
+  /// This is null for messages without template tokens.
+  std::unique_ptr<Templates> _templates;
+
 protected:
   class Binding : public swoc::bwf::NameBinding
   {
@@ -467,6 +705,9 @@ struct Txn
   HttpHeader _rsp; ///< Rules for response to expect.
 };
 
+struct H2Settings;
+struct QuicSettings;
+
 struct Ssn
 {
   std::list<Txn> _transactions;
@@ -488,11 +729,241 @@ struct Ssn
   int _client_verify_mode = SSL_VERIFY_NONE;
   bool is_tls = false;
   bool is_h2 = false;
+  /// The HTTP/2 settings described for this session, if any.
+  std::shared_ptr<H2Settings> _h2_settings;
   bool is_h3 = false;
+  /// The QUIC settings described for this session, if any.
+  std::shared_ptr<QuicSettings> _quic_settings;
 
   swoc::Errata post_process_transactions();
 };
 
+/** A connection's received bytes, kept across its transactions.
+ *
+ * Headers are parsed and bodies drained directly out of this buffer. Bytes
+ * received beyond the end of one message, such as the start of a pipelined
+ * message, remain for the next message rather than being lost.
+ *
+ * The consumed bytes of the current message header are held in place since
+ * the parsed header refers to them. They are released when the next message
+ * is started.
+ */
+class ReceiveBuffer
+{
+public:
+  /** Begin a new message.
+   *
+   * The bytes of the previous message are released and any unconsumed bytes
+   * are moved to the front of the buffer.
+   */
+  void start_message();
+
+  /// The received bytes not yet consumed.
+  swoc::TextView view() const;
+
+  /** The free space into which to receive more bytes.
+   *
+   * Unconsumed bytes are compacted toward the front of the buffer if needed
+   * to make room, but never over held bytes.
+   */
+  swoc::MemSpan<char> aux_span();
+
+  /// Mark @a n bytes of aux_span() as received.
+  void commit(size_t n);
+
+  /// Mark the first @a n bytes of view() as consumed.
+  void consume(size_t n);
+
+  /// Hold the consumed bytes in place until the next start_message().
+  void hold();
+
+  /// Discard all received bytes, such as when the connection is replaced.
+  void clear();
+
+private:
+  std::unique_ptr<char[]> _data; ///< Allocated upon first use.
+  size_t _held = 0;              ///< End of the held bytes.
+  size_t _begin = 0;             ///< Start of the unconsumed bytes.
+  size_t _end = 0;               ///< End of the received bytes.
+};
+
+/** A flat, open addressing table from stream identifiers to stream states.
+ *
+ * Entries live in a single power of two sized array and are found by linear
+ * probing, so once the table has grown to fit a connection's peak number of
+ * open streams neither lookups nor insertions allocate. Erasure shifts later
+ * entries of a probe sequence back rather than leaving tombstones.
+ *
+ * The table does not own the states it refers to.
+ */
+template <typename Id, typename State> class StreamTable
+{
+public:
+  /// The state for stream @a id, or nullptr if there is none.
+  State *
+  find(Id id) const
+  {
+    if (_count == 0) {
+      return nullptr;
+    }
+    for (auto i = home(id);; i = next(i)) {
+      auto const &slot = _slots[i];
+      if (slot._state == nullptr) {
+        return nullptr;
+      } else if (slot._id == id) {
+        return slot._state;
+      }
+    }
+  }
+
+  /// Set the state for stream @a id, replacing any already set.
+  void
+  insert(Id id, State *state)
+  {
+    if ((_count + 1) * 2 > _slots.size()) {
+      grow();
+    }
+    auto i = home(id);
+    while (_slots[i]._state != nullptr && _slots[i]._id != id) {
+      i = next(i);
+    }
+    if (_slots[i]._state == nullptr) {
+      ++_count;
+    }
+    _slots[i] = {id, state};
+  }
+
+  /** Remove stream @a id from the table.
+   *
+   * @return The state which was set for the stream, or nullptr if there was
+   * none.
+   */
+  State *
+  erase(Id id)
+  {
+    if (_count == 0) {
+      return nullptr;
+    }
+    auto i = home(id);
+    while (_slots[i]._id != id || _slots[i]._state == nullptr) {
+      if (_slots[i]._state == nullptr) {
+        return nullptr;
+      }
+      i = next(i);
+    }
+    auto *const state = _slots[i]._state;
+    _slots[i] = {};
+    --_count;
+    // Move back each following entry which probing would otherwise no longer
+    // reach past the emptied slot.
+    for (auto j = next(i); _slots[j]._state != nullptr; j = next(j)) {
+      auto const k = home(_slots[j]._id);
+      bool const reachable = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+      if (!reachable) {
+        _slots[i] = _slots[j];
+        _slots[j] = {};
+        i = j;
+      }
+    }
+    return state;
+  }
+
+  size_t
+  size() const
+  {
+    return _count;
+  }
+
+  bool
+  empty() const
+  {
+    return _count == 0;
+  }
+
+private:
+  struct Slot
+  {
+    Id _id = 0;
+    State *_state = nullptr; ///< nullptr for an empty slot.
+  };
+
+  static constexpr size_t INITIAL_SIZE = 16;
+
+  /// The slot at which probing for @a id starts.
+  size_t
+  home(Id id) const
+  {
+    // Fibonacci hashing spreads the regularly spaced stream identifiers.
+    return (static_cast<uint64_t>(id) * 0x9E3779B97F4A7C15ULL) >> _shift;
+  }
+
+  size_t
+  next(size_t i) const
+  {
+    return (i + 1) & (_slots.size() - 1);
+  }
+
+  void
+  grow()
+  {
+    std::vector<Slot> old_slots(_slots.empty() ? INITIAL_SIZE : _slots.size() * 2);
+    old_slots.swap(_slots);
+    _shift = 64;
+    for (auto n = _slots.size(); n > 1; n >>= 1) {
+      --_shift;
+    }
+    _count = 0;
+    for (auto const &slot : old_slots) {
+      if (slot._state != nullptr) {
+        insert(slot._id, slot._state);
+      }
+    }
+  }
+
+  std::vector<Slot> _slots;
+  size_t _count = 0;
+  unsigned _shift = 64; ///< 64 less log2 of the number of slots.
+};
+
+/** Recycles the states of a connection's closed streams for its new ones.
+ *
+ * A released state drops what it held for its stream but keeps the capacity
+ * of its containers, so a connection's stream of transactions reuses a few
+ * states rather than allocating each one anew. State must provide @c clear(),
+ * called upon release, and @c reset() taking the constructor's arguments,
+ * called when a released state is acquired again.
+ */
+template <typename State> class StreamStatePool
+{
+public:
+  /// Return a state for a new stream constructed as if by @a args.
+  template <typename... Args>
+  State *
+  acquire(Args &&...args)
+  {
+    if (_free.empty()) {
+      _states.push_back(std::make_unique<State>(std::forward<Args>(args)...));
+      return _states.back().get();
+    }
+    auto *const state = _free.back();
+    _free.pop_back();
+    state->reset(std::forward<Args>(args)...);
+    return state;
+  }
+
+  /// Return @a state, whose stream is done, to the pool.
+  void
+  release(State *state)
+  {
+    state->clear();
+    _free.push_back(state);
+  }
+
+private:
+  std::vector<std::unique_ptr<State>> _states; ///< Every state of the pool.
+  std::vector<State *> _free;                  ///< The released states.
+};
+
 /** A session reader.
  * This is essentially a wrapper around a socket to support use of @c poll on
  * the socket. The goal is to enable a read operation that waits for data but
@@ -556,23 +1027,42 @@ public:
       std::chrono::milliseconds timeout,
       short events = POLLIN);
 
-  virtual swoc::Rv<std::shared_ptr<HttpHeader>> read_and_parse_request(swoc::FixedBufferWriter &w);
+  /** Poll until the socket is writable.
+   *
+   * While pipelined responses are outstanding, the socket is polled for
+   * readability as well. A response that arrives while the socket is not
+   * writable is received, so that a peer blocked writing to us is never left
+   * waiting on us being blocked writing to it.
+   *
+   * @param[in] timeout The timeout, in milliseconds, for each poll.
+   *
+   * @return As for poll_for_data_on_socket.
+   */
+  swoc::Rv<int> poll_for_writable(std::chrono::milliseconds timeout);
+
+  /** Read and parse the next request header from the connection.
+   *
+   * @return The parsed request, or nullptr if the peer closed the connection
+   * between requests, and an errata with any messaging.
+   */
+  virtual swoc::Rv<std::shared_ptr<HttpHeader>> read_and_parse_request();
 
   /** Read body bytes out of the socket.
+   *
+   * Body bytes already received with the header are taken from the
+   * connection's receive buffer first. Bytes beyond the end of the body are
+   * left in the buffer for the next message.
    *
    * @param[in] hdr The headers which specify how many body bytes to read.
    *
    * @param[in] expected_content_size The response's content-length value
    * or, failing that, the content:size value from the dumped response.
    *
-   * @param[in] bytes_read The content read to this put from the socket.
-   *
-   * @return The number of total drained body bytes, including the contents of
-   * initial. This count is strictly the number of body bytes and does not
-   * include any chunk header bytes (if chunk encoding was used).
+   * @return The number of total drained body bytes. This count is strictly
+   * the number of body bytes and does not include any chunk header bytes (if
+   * chunk encoding was used).
    */
-  virtual swoc::Rv<size_t>
-  drain_body(HttpHeader const &hdr, size_t expected_content_size, swoc::TextView bytes_read);
+  virtual swoc::Rv<size_t> drain_body(HttpHeader const &hdr, size_t expected_content_size);
 
   virtual swoc::Errata do_connect(swoc::TextView interface, swoc::IPEndpoint const *real_target);
 
@@ -584,6 +1074,18 @@ public:
    */
   virtual swoc::Rv<ssize_t> write(swoc::TextView data);
 
+  /** Gather write the buffers described by @a iov to the socket.
+   *
+   * This allows, for instance, a header and its body to be sent with a single
+   * system call rather than one per buffer.
+   *
+   * @param[in,out] iov The buffers to write. The entries are adjusted as
+   * content is written and should not be relied upon afterward.
+   *
+   * @return The number of bytes written and an errata with any messaging.
+   */
+  virtual swoc::Rv<ssize_t> writev(swoc::MemSpan<iovec> iov);
+
   /** Write the header to the socket.
    *
    * @param[in] hdr The headers to write to the socket.
@@ -592,6 +1094,16 @@ public:
    */
   virtual swoc::Rv<ssize_t> write(HttpHeader const &hdr);
 
+  /** Write @a hdr as the response to the request received on @a stream_id.
+   *
+   * Unlike write, this does not take the stream from @a hdr, so a response
+   * shared by the transactions of concurrent connections is sent without
+   * being modified. Protocols without streams ignore @a stream_id.
+   *
+   * @return The number of bytes written and an errata with any messaging.
+   */
+  virtual swoc::Rv<ssize_t> write_response(HttpHeader const &hdr, int64_t stream_id);
+
   /** Write the number of body bytes as specified by hdr.
    *
    * @param[in] hdr The header to inspect to determine how many body bytes to
@@ -601,6 +1113,41 @@ public:
    */
   virtual swoc::Rv<ssize_t> write_body(HttpHeader const &hdr);
 
+  /** Set the values with which request templates are rendered.
+   *
+   * @param[in] context The iteration and session index of this replay.
+   */
+  void set_template_context(TemplateContext const &context);
+
+  /** Whether a complete message header has been received but not yet read.
+   *
+   * This is the case when a peer pipelines requests.
+   */
+  virtual bool has_buffered_header() const;
+
+  /** Hold messages written from now on so they can be sent together.
+   *
+   * Messages are held until flush_output is called. Messages which cannot be
+   * held, such as chunked ones, are written immediately after what is held.
+   */
+  void hold_output();
+
+  /** Send any held messages in a single gather write and stop holding output.
+   *
+   * @return The number of bytes written and an errata with any messaging.
+   */
+  virtual swoc::Rv<ssize_t> flush_output();
+
+  /// Whether written messages are held, waiting for flush_output to send them.
+  virtual bool has_held_output() const;
+
+  /** Set the number of HTTP/1 requests that may be outstanding at once.
+   *
+   * @param[in] depth The maximum number of requests written ahead of their
+   * responses. A depth of 1, the default, disables pipelining.
+   */
+  void set_pipeline_depth(unsigned depth);
+
   /** Whether the connection is currently closed. */
   bool is_closed() const;
 
@@ -616,7 +1163,85 @@ public:
       double rate_multiplier);
   virtual swoc::Errata run_transaction(Txn const &json_txn);
 
+  /** Record how long a transaction took, for protocols which keep latency
+   * statistics. This does nothing by default.
+   *
+   * @param[in] elapsed The time from sending the request to receiving the
+   * response.
+   */
+  virtual void record_transaction_latency(std::chrono::microseconds elapsed);
+
 protected:
+  /** Write the request of @a json_txn.
+   *
+   * @return Any messaging from sending the request.
+   */
+  swoc::Errata send_request(Txn const &json_txn);
+
+  /** Read and verify the response to the request of @a json_txn.
+   *
+   * @return Any messaging from receiving and verifying the response.
+   */
+  swoc::Errata receive_response(Txn const &json_txn);
+
+  /** Run the transactions of @a txn_list with up to _pipeline_depth requests
+   * outstanding.
+   *
+   * Responses are matched to requests in order. If the connection closes with
+   * requests still outstanding, those requests are sent again on a new
+   * connection.
+   *
+   * @see run_transactions
+   */
+  swoc::Errata run_pipelined_transactions(
+      std::list<Txn> const &txn_list,
+      swoc::TextView interface,
+      swoc::IPEndpoint const *real_target,
+      double rate_multiplier);
+
+  /** Write @a header followed by the body described by @a hdr.
+   *
+   * The serialized header is sent in the same gather write as the body (or
+   * the first batch of body chunks) so that small messages need only a single
+   * write.
+   *
+   * @param[in] hdr The header to inspect to determine how many body bytes to
+   * write.
+   * @param[in] header The serialized header. This may be empty to write just
+   * the body.
+   *
+   * @return The number of header and body bytes written and an errata with
+   * any messaging.
+   */
+  swoc::Rv<ssize_t> write_message(HttpHeader const &hdr, swoc::TextView header);
+
+  /// Send the messages held by hold_output, continuing to hold output.
+  swoc::Rv<ssize_t> send_held_output();
+
+  /// The most bytes of messages held before they are written.
+  static constexpr size_t MAX_HELD_OUTPUT = 64 * 1024;
+
+  /// Bodies at least this large are sent from the content file if possible.
+  static constexpr size_t SENDFILE_MIN_SIZE = 64 * 1024;
+
+  /** Whether bodies can be sent directly from HttpHeader::_content_fd.
+   *
+   * This is only possible for plaintext sessions: the kernel cannot encrypt
+   * the content on our behalf.
+   */
+  virtual bool can_send_content_file() const;
+
+  /** Send @a header then @a size bytes of the content file via sendfile.
+   *
+   * @param[in] header The serialized header, sent ahead of the body.
+   * @param[in] offset The offset of the body within HttpHeader::_content.
+   * @param[in] size The number of body bytes to send.
+   *
+   * @return The number of header and body bytes written and an errata with
+   * any messaging.
+   */
+  swoc::Rv<ssize_t> send_content_file(swoc::TextView header, off_t offset, size_t size);
+
   /** Read from the stream's socket into span.
    *
    * @param[in] span The destination for the bytes read from the socket.
@@ -625,21 +1250,66 @@ protected:
    */
   virtual swoc::Rv<ssize_t> read(swoc::MemSpan<char> span);
 
-  /** Read the headers to a buffer.
+  /** Read and throw away up to @a n bytes from the socket.
+   *
+   * For plaintext TCP, the bytes are dropped in the kernel via MSG_TRUNC
+   * rather than being copied out.
+   *
+   * @param[in] n The maximum number of bytes to discard.
+   *
+   * @return The number of bytes discarded and an errata with any messaging.
+   */
+  virtual swoc::Rv<ssize_t> discard(size_t n);
+
+  /** A per-thread buffer for content which is read only to be discarded. */
+  static swoc::MemSpan<char> discard_buffer();
+
+  /** Read the next message header into the receive buffer.
    *
-   * @param[in] w The buffer into which to write the headers.
+   * @return A view of the header in the receive buffer, including the
+   * terminating blank line, and an errata with messaging. The view is empty
+   * if the peer closed the connection cleanly between messages. It remains
+   * valid until the next call to read_headers.
+   */
+  virtual swoc::Rv<swoc::TextView> read_headers();
+
+protected:
+  /// The values with which request templates are rendered when sent.
+  TemplateContext _template_context;
+  /// The maximum number of outstanding HTTP/1 requests.
+  unsigned _pipeline_depth = 1;
+  /** Receive the next outstanding pipelined response, if any.
    *
-   * @return The number of bytes read and an errata with messaging.
+   * This is set by run_pipelined_transactions while it writes a request and
+   * is called by poll_for_writable. It returns false if there is no response
+   * outstanding.
    */
-  virtual swoc::Rv<ssize_t> read_headers(swoc::FixedBufferWriter &w);
+  std::function<bool()> _receive_while_writing;
+
+  /// Whether written messages are held. See hold_output.
+  bool _hold_output = false;
+  /// The header and body buffers of the held messages.
+  std::vector<iovec> _held_output;
+  /// Storage for the serialized headers of the held messages.
+  swoc::MemArena _held_arena;
+  /// The number of bytes in _held_output.
+  size_t _held_size = 0;
+  /// The keys of the held messages, for reporting a failed write.
+  std::string _held_keys;
 
 private:
-  virtual swoc::Rv<size_t>
-  drain_body_internal(HttpHeader &hdr, Txn const &json_txn, swoc::TextView initial);
+  virtual swoc::Rv<size_t> drain_body_internal(HttpHeader &hdr, Txn const &json_txn);
+
+  /** Perform a read or, if @a flags are given, a recv from the socket.
+   *
+   * @see read
+   */
+  swoc::Rv<ssize_t> receive(void *buffer, size_t size, int flags);
 
 private:
   int _fd = -1; ///< Socket.
-  ssize_t _body_offset = 0;
+  /// Received bytes, kept across the transactions of the connection.
+  ReceiveBuffer _recv_buffer;
 };
 
 inline int
@@ -682,18 +1352,42 @@ public:
    */
   Result parse(swoc::TextView data, ChunkCallback const &cb);
 
+  /** Parse @a data as chunked encoded, reporting how much of it was parsed.
+   *
+   * @param data Data to parse.
+   * @param cb Callback to receive decoded chunks.
+   * @param consumed [out] The number of bytes of @a data that were parsed.
+   * This is less than the size of @a data only if the final chunk ends
+   * before the end of @a data.
+   * @return Parsing result.
+   */
+  Result parse(swoc::TextView data, ChunkCallback const &cb, size_t &consumed);
+
+  /// The default size of transmitted chunks.
+  static constexpr size_t DEFAULT_CHUNK_SIZE = 4096;
+  /// The number of chunks, with their framing, gathered into each write.
+  static constexpr size_t CHUNKS_PER_WRITE = 64;
+
   /** Write @a data to @a fd using chunked encoding.
+   *
+   * Chunks and their framing are gathered so that up to CHUNKS_PER_WRITE
+   * chunks are sent per write.
    *
    * @param fd Output file descriptor.
    * @param data [in,out] Data to write.
    * @param chunk_size Size of chunks.
+   * @param prefix Content, such as the serialized header, to send ahead of
+   * the first chunk in the same write.
    * @return A pair of
    *   - The number of bytes written from @a data (not including the chunk
-   * encoding).
+   * encoding or @a prefix).
    *   - An error code, which will be 0 if all data was successfully written.
    */
-  std::tuple<ssize_t, std::error_code>
-  transmit(Session &session, swoc::TextView data, size_t chunk_size = 4096);
+  std::tuple<ssize_t, std::error_code> transmit(
+      Session &session,
+      swoc::TextView data,
+      size_t chunk_size = DEFAULT_CHUNK_SIZE,
+      swoc::TextView prefix = {});
 
 protected:
   size_t _size = 0; ///< Size of the current chunking being decoded.
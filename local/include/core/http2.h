@@ -13,10 +13,13 @@
 #include <deque>
 #include <list>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <openssl/ssl.h>
 #include <nghttp2/nghttp2.h>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "swoc/BufferWriter.h"
 #include "swoc/Errata.h"
@@ -27,12 +30,73 @@
 class HttpHeader;
 struct Txn;
 
+/** HTTP/2 SETTINGS and flow-control window sizes for a connection.
+ *
+ * Each value is optional. Those left unset take the process-wide default
+ * given on the command line, if any, and otherwise the HTTP/2 defaults.
+ */
+struct H2Settings
+{
+  static constexpr swoc::TextView MAX_CONCURRENT_STREAMS{"max-concurrent-streams"};
+  static constexpr swoc::TextView INITIAL_WINDOW_SIZE{"initial-window-size"};
+  static constexpr swoc::TextView MAX_FRAME_SIZE{"max-frame-size"};
+  static constexpr swoc::TextView HEADER_TABLE_SIZE{"header-table-size"};
+  static constexpr swoc::TextView CONNECTION_WINDOW_SIZE{"connection-window-size"};
+
+  std::optional<uint32_t> _max_concurrent_streams;
+  /// The receive window of each stream.
+  std::optional<uint32_t> _initial_window_size;
+  std::optional<uint32_t> _max_frame_size;
+  std::optional<uint32_t> _header_table_size;
+  /** The receive window of the connection as a whole.
+   *
+   * This is not a SETTINGS parameter: it is enlarged by a connection-level
+   * WINDOW_UPDATE sent with the SETTINGS.
+   */
+  std::optional<uint32_t> _connection_window_size;
+
+  /** Set the value named by @a name.
+   *
+   * @param[in] name One of the setting names above.
+   * @param[in] value The decimal value for the setting.
+   *
+   * @return An errata describing an unknown name or an invalid value.
+   */
+  swoc::Errata set(swoc::TextView name, swoc::TextView value);
+
+  /** Set values from a comma separated list of name=value pairs.
+   *
+   * @param[in] description The list, as given on the command line.
+   *
+   * @return Any errata from setting the values.
+   */
+  swoc::Errata parse(swoc::TextView description);
+
+  /** Take each value not set in this from @a defaults.
+   *
+   * @param[in] defaults The values to use for those not set.
+   */
+  void merge(H2Settings const &defaults);
+};
+
 class H2StreamState
 {
 public:
   H2StreamState();
   ~H2StreamState();
 
+  /** Prepare this state, released by clear(), for a new stream.
+   *
+   * This leaves the state as if it were newly constructed.
+   */
+  void reset();
+
+  /** Release what this state holds for its stream.
+   *
+   * The state keeps its allocations so that it can be reused via reset().
+   */
+  void clear();
+
   /** Increment the nghttp2 reference count on buf and return a view of it.
    *
    * A reference count to the buffer will be held for the remainder of the
@@ -51,12 +115,6 @@ public:
   /** Retrieve the stream id for this stream. */
   int32_t get_stream_id() const;
 
-  /** Store the nghttp2 response headers to be freed upon destruction. */
-  void store_nv_response_headers_to_free(nghttp2_nv *hdrs);
-
-  /** Store the nghttp2 request headers to be freed upon destruction. */
-  void store_nv_request_headers_to_free(nghttp2_nv *hdrs);
-
 public:
   char const *_body_to_send = nullptr;
   size_t _send_body_length = 0;
@@ -71,8 +129,21 @@ public:
    */
   std::string _composed_url;
   std::chrono::time_point<std::chrono::system_clock> _stream_start;
+  /** How long the request waited for a stream slot before it was submitted.
+   *
+   * This is not part of the stream's latency, which is measured from
+   * _stream_start.
+   */
+  std::chrono::system_clock::duration _queue_delay{0};
   HttpHeader const *_specified_response = nullptr;
 
+  /** Storage for rendered request template values.
+   *
+   * nghttp2 refers to the pseudo header values without copying them, so these
+   * need to persist for the lifetime of the stream.
+   */
+  swoc::MemArena _rendered_values;
+
   /// The HTTP request headers for this stream.
   std::shared_ptr<HttpHeader> _request_from_client;
   /// The HTTP response headers for this stream.
@@ -80,9 +151,7 @@ public:
 
 private:
   int32_t _stream_id = -1;
-  std::deque<nghttp2_rcbuf *> _rcbufs_to_free;
-  nghttp2_nv *_request_nv_headers = nullptr;
-  nghttp2_nv *_response_nv_headers = nullptr;
+  std::vector<nghttp2_rcbuf *> _rcbufs_to_free;
 };
 
 class H2Session : public TLSSession
@@ -94,7 +163,9 @@ public:
   ~H2Session();
   swoc::Rv<ssize_t> read(swoc::MemSpan<char> span) override;
   swoc::Rv<ssize_t> write(swoc::TextView data) override;
+  swoc::Rv<ssize_t> writev(swoc::MemSpan<iovec> iov) override;
   swoc::Rv<ssize_t> write(HttpHeader const &hdr) override;
+  swoc::Rv<ssize_t> write_response(HttpHeader const &hdr, int64_t stream_id) override;
 
   /** For HTTP/2, we read on the socket until an entire stream is done.
    *
@@ -103,11 +174,20 @@ public:
    * an issue because bodies are explicitly framed.
    */
   swoc::Rv<int> poll_for_headers(std::chrono::milliseconds timeout) override;
-  swoc::Rv<std::shared_ptr<HttpHeader>> read_and_parse_request(swoc::FixedBufferWriter &w) override;
-  swoc::Rv<size_t> drain_body(
-      HttpHeader const &hdr,
-      size_t expected_content_size,
-      swoc::TextView bytes_read) override;
+  swoc::Rv<std::shared_ptr<HttpHeader>> read_and_parse_request() override;
+  swoc::Rv<size_t> drain_body(HttpHeader const &hdr, size_t expected_content_size) override;
+
+  /** Whether another stream has been entirely received but not yet read.
+   *
+   * A server uses this to submit the responses to all such streams before
+   * sending any of them, letting nghttp2 interleave their frames.
+   */
+  bool has_buffered_header() const override;
+
+  /** Send the frames of the responses submitted while output was held. */
+  swoc::Rv<ssize_t> flush_output() override;
+
+  bool has_held_output() const override;
 
   swoc::Errata accept() override;
   swoc::Errata connect() override;
@@ -120,6 +200,13 @@ public:
    */
   static swoc::Errata init(int *process_exit_code);
 
+  /** Perform the HTTP/2 global initialization needed if only cleartext
+   * (h2c) connections are made.
+   *
+   * @param[in] process_exit_code: As for init.
+   */
+  static swoc::Errata init_cleartext(int *process_exit_code);
+
   /** Delete global instances. */
   static void terminate();
 
@@ -128,7 +215,45 @@ public:
   /** Perform the HTTP/2 (nghttp2) configuration for a server connection. */
   swoc::Errata server_session_init();
 
+  /** Submit the SETTINGS frame and any connection-level WINDOW_UPDATE.
+   *
+   * The values come from those set for this session via set_settings, then
+   * from the process-wide defaults, then from the HTTP/2 defaults.
+   */
   swoc::Errata send_connection_settings();
+
+  /** Speak HTTP/2 with prior knowledge over cleartext TCP (h2c).
+   *
+   * Rather than negotiating HTTP/2 via ALPN in a TLS handshake, the client
+   * starts the connection with the HTTP/2 connection preface and the server
+   * expects it. This must be set before connecting or accepting.
+   *
+   * @param[in] is_cleartext Whether the session is h2c.
+   */
+  void set_is_cleartext(bool is_cleartext);
+
+  /** Set the HTTP/2 settings for this session.
+   *
+   * @param[in] settings The settings to send once HTTP/2 is negotiated.
+   */
+  void set_settings(H2Settings const &settings);
+
+  /** Set the HTTP/2 settings used for values a session does not specify.
+   *
+   * @param[in] settings The process-wide settings, such as from the command
+   * line.
+   */
+  static void set_default_settings(H2Settings const &settings);
+
+  /** Register the HTTP/2 settings for server connections with the given SNI.
+   *
+   * A server sends its SETTINGS before it has read any request, so the SNI is
+   * all it has by which to select the settings of a replay session.
+   *
+   * @param[in] sni The SNI the client sends for the connection.
+   * @param[in] settings The settings to use for such connections.
+   */
+  static void register_settings_for_sni(std::string_view sni, H2Settings const &settings);
   swoc::Errata run_transactions(
       std::list<Txn> const &txn,
       swoc::TextView interface,
@@ -136,6 +261,36 @@ public:
       double rate_multiplier) override;
   swoc::Errata run_transaction(Txn const &txn) override;
 
+  /** Run a session's transactions on this connection while other sessions'
+   * threads use it too.
+   *
+   * @a mutex is held only while the connection is used, so the streams of
+   * the sessions sharing the connection interleave. Whichever thread reads a
+   * response processes it, verifying it against the stream's own expected
+   * response. This returns once the streams of @a txn_list have closed.
+   *
+   * If the connection closes, each of this session's streams still awaiting
+   * its response is reported as an error. The connection is reopened for
+   * further transactions only once no session has a stream in flight on it.
+   *
+   * @param[in] txn_list The transactions of the session.
+   * @param[in] template_context The context for rendering the session's
+   * request templates.
+   * @param[in] mutex The mutex guarding this connection.
+   * @param[in] interface The interface from which to reconnect, if needed.
+   * @param[in] real_target The target to which to reconnect, if needed.
+   * @param[in] rate_multiplier As for run_transactions.
+   *
+   * @return Any errata from running the transactions.
+   */
+  swoc::Errata run_shared_transactions(
+      std::list<Txn> const &txn_list,
+      TemplateContext const &template_context,
+      std::mutex &mutex,
+      swoc::TextView interface,
+      swoc::IPEndpoint const *real_target,
+      double rate_multiplier);
+
   nghttp2_session *
   get_session()
   {
@@ -155,7 +310,77 @@ public:
   /// Return whether this session is for a listening server.
   bool get_is_server() const;
 
-  void record_stream_state(int32_t stream_id, std::shared_ptr<H2StreamState> stream_state);
+  /** Read frames from the connection, waiting up to @a timeout for them.
+   *
+   * @param[in] span The buffer into which to read.
+   * @param[in] timeout How long to wait if nothing has arrived yet.
+   *
+   * @return The number of bytes read, 0 if none arrived in time, or -1 if the
+   * connection is closed or failed.
+   */
+  swoc::Rv<ssize_t> receive_frames(swoc::MemSpan<char> span, std::chrono::milliseconds timeout);
+
+  /** Add serialized frames to those waiting to be written.
+   *
+   * Frames are accumulated so that the many small frames nghttp2 produces,
+   * such as SETTINGS, HEADERS, and WINDOW_UPDATE, share TLS records and
+   * writes. The buffered frames are written once they would exceed a TLS
+   * record's worth of data.
+   *
+   * @param[in] frames The serialized frames to buffer.
+   *
+   * @return The number of bytes written, if any, and an errata with any
+   * messaging.
+   */
+  swoc::Rv<ssize_t> buffer_frames(swoc::TextView frames);
+
+  /** Write the buffered frames followed by @a iov in a single gather write.
+   *
+   * @param[in] iov Further data to write after the buffered frames. This may
+   * be empty to write just the buffered frames.
+   *
+   * @return The number of bytes written and an errata with any messaging.
+   */
+  swoc::Rv<ssize_t> write_frames(swoc::MemSpan<iovec> iov = {});
+
+  /** Count a frame sent, for the statistics reported when the session ends.
+   *
+   * @param[in] frame The frame that was sent.
+   */
+  void count_frame_sent(nghttp2_frame const &frame);
+
+  /** Obtain a state for a new stream, reusing that of a closed stream if
+   * there is one.
+   *
+   * @return The stream state, owned by this session.
+   */
+  H2StreamState *new_stream_state();
+
+  /** Track the state of an open stream.
+   *
+   * @param[in] stream_id The identifier of the stream.
+   * @param[in] stream_state The state from new_stream_state.
+   */
+  void record_stream_state(int32_t stream_id, H2StreamState *stream_state);
+
+  /** Indicate that a stream recorded via record_stream_state has closed.
+   *
+   * The stream's state is returned for reuse by a later stream.
+   *
+   * @param[in] stream_id The identifier of the closed stream.
+   */
+  void record_stream_closed(int32_t stream_id);
+
+  /** Limit the number of streams a client keeps open at once.
+   *
+   * Transactions beyond the limit wait for a stream to close before their
+   * requests are sent. The peer's SETTINGS_MAX_CONCURRENT_STREAMS is honored
+   * regardless.
+   *
+   * @param[in] limit The maximum number of open streams, or 0 to be limited
+   * only by the peer.
+   */
+  void set_stream_limit(unsigned limit);
 
   /** Indicates that that the user should receive a non-zero status code.
    *
@@ -168,7 +393,7 @@ public:
 
 public:
   /// A mapping from stream_id to H2StreamState.
-  std::unordered_map<int32_t, std::shared_ptr<H2StreamState>> _stream_map;
+  StreamTable<int32_t, H2StreamState> _stream_map;
 
 protected:
   static swoc::Errata client_init(SSL_CTX *&client_context);
@@ -176,6 +401,39 @@ protected:
   static void terminate(SSL_CTX *&client_context);
 
 private:
+  /** Perform a single non-blocking read from the connection.
+   *
+   * @return The result of SSL_read, or of read(2) for an h2c session.
+   */
+  ssize_t read_some(swoc::MemSpan<char> span);
+
+  /** Determine why read_some returned no data.
+   *
+   * @param[in] read_result The value read_some returned.
+   *
+   * @return The poll(2) events to wait for before reading again, or 0 if the
+   * connection is closed or failed.
+   */
+  swoc::Rv<short> get_events_to_await(ssize_t read_result);
+
+  /** Submit @a hdr to nghttp2 and send what it produces.
+   *
+   * @param[in] hdr The request or response to submit.
+   * @param[in] response_stream_id For a response, the stream of its request.
+   */
+  swoc::Rv<ssize_t> submit_message(HttpHeader const &hdr, int32_t response_stream_id);
+
+  /// The number of streams which may be open at once.
+  size_t get_max_open_streams() const;
+
+  /** Process responses until fewer than get_max_open_streams() streams are
+   * open or the connection closes.
+   *
+   * @return Any errata from receiving the responses, including an error if
+   * Poll_Timeout passes without any data arriving.
+   */
+  swoc::Errata wait_for_stream_slot();
+
   /** Populate an nghttp2 vector from the information in an HttpHeader instance.
    *
    * @param[in] hdr The instance from which to pack headers.
@@ -196,9 +454,47 @@ private:
   nghttp2_session_callbacks *_callbacks = nullptr;
   nghttp2_option *_options = nullptr;
   bool _h2_is_negotiated = false;
+  /// Whether HTTP/2 is spoken over cleartext TCP with prior knowledge.
+  bool _is_cleartext = false;
+  /// The settings described for this session.
+  H2Settings _settings;
 
   std::deque<int32_t> _ended_streams;
-  std::shared_ptr<H2StreamState> _last_added_stream;
+  /// The states of the open streams in _stream_map and those kept for reuse.
+  StreamStatePool<H2StreamState> _stream_states;
+  H2StreamState *_last_added_stream = nullptr;
+  /** Storage for the header fields of a submitted message.
+   *
+   * nghttp2 copies the array upon submission, so one buffer serves every
+   * stream.
+   */
+  std::vector<nghttp2_nv> _nv_buffer;
+  /// The number of streams of the current connection which are open.
+  size_t _open_streams = 0;
+  /// The client's limit on _open_streams, or 0 for no limit of its own.
+  unsigned _stream_limit = 0;
+  /** The number of connections this client session has made.
+   *
+   * Stream identifiers start over with each connection, so this tells those
+   * of a previous connection apart.
+   */
+  size_t _connection_count = 0;
+  /** The streams submitted by run_shared_transactions, for all the sessions
+   * sharing this connection, which have not yet closed or been given up on.
+   */
+  size_t _shared_streams = 0;
+
+  /// The amount of frame data to accumulate before writing it.
+  static constexpr size_t FRAME_BUFFER_SIZE = 16 * 1024;
+  /// Serialized frames waiting to be written.
+  swoc::LocalBufferWriter<FRAME_BUFFER_SIZE> _frame_buffer;
+
+  /// The number of frames sent on this session.
+  size_t _frames_sent = 0;
+  /// The number of those frames which opened a stream with a HEADERS frame.
+  size_t _streams_sent = 0;
+  /// The number of writes used to send those frames.
+  size_t _frame_writes = 0;
 
 #ifndef OPENSSL_NO_NEXTPROTONEG
   static unsigned char next_proto_list[256];
@@ -216,6 +512,106 @@ private:
    */
   static SSL_CTX *h2_client_context;
 
+  /// The settings for values which a session does not specify.
+  static H2Settings _default_settings;
+
+  /// The server's settings by the SNI of the connection.
+  static std::unordered_map<std::string, H2Settings> _settings_per_sni;
+
   /// The system status code. This is set to non-zero if problems are detected.
   static int *process_exit_code;
 };
+
+/** HTTP/2 connections shared by the replayed sessions with the same target
+ * and SNI.
+ *
+ * By default each replayed HTTP/2 session opens its own connection. When
+ * coalescing is enabled, sessions instead lease a pooled connection and
+ * multiplex their transactions onto it as streams, as a browser would. A
+ * connection is shared by at most as many sessions as it may have open
+ * streams, beyond which another connection is opened.
+ */
+class H2ConnectionPool
+{
+public:
+  /** Enable coalescing.
+   *
+   * @param[in] stream_limit The number of streams each pooled connection may
+   * have open at once. 0 disables coalescing.
+   */
+  static void set_stream_limit(unsigned stream_limit);
+
+  /// Whether sessions are coalesced onto pooled connections.
+  static bool is_enabled();
+
+  /** Run the transactions of a session on a pooled connection.
+   *
+   * A connection is opened, using the parameters of this session, if none
+   * for the target and SNI has room for another session.
+   *
+   * @param[in] client_sni The SNI of the session.
+   * @param[in] client_verify_mode The TLS verify mode of the session.
+   * @param[in] is_cleartext Whether the session is h2c.
+   * @param[in] settings The HTTP/2 settings for a connection opened for it.
+   * @param[in] txn_list The transactions of the session.
+   * @param[in] template_context The context for rendering the session's
+   * request templates.
+   * @param[in] interface The interface from which to connect.
+   * @param[in] real_target The target to which to connect.
+   * @param[in] rate_multiplier As for Session::run_transactions.
+   *
+   * @return Any errata from running the transactions.
+   */
+  static swoc::Errata run_transactions(
+      std::string_view client_sni,
+      int client_verify_mode,
+      bool is_cleartext,
+      H2Settings const &settings,
+      std::list<Txn> const &txn_list,
+      TemplateContext const &template_context,
+      swoc::TextView interface,
+      swoc::IPEndpoint const *real_target,
+      double rate_multiplier);
+
+  /** Close the pooled connections. */
+  static void terminate();
+
+private:
+  /// A pooled connection.
+  struct Connection
+  {
+    /// Guards the use of _session, which is set before the connection is
+    /// visible to other leases.
+    std::mutex _mutex;
+    std::unique_ptr<H2Session> _session;
+    /// The number of sessions using this connection. Guarded by _pool_mutex.
+    unsigned _leases = 0;
+  };
+
+  /** Lease the connection for @a key with the fewest leases, adding one if
+   * each has as many leases as streams.
+   *
+   * The session of an added connection is made from the remaining parameters,
+   * which are as for run_transactions, but is not yet connected.
+   *
+   * @return The leased connection and whether it was just added.
+   */
+  static std::pair<Connection *, bool> lease(
+      std::string const &key,
+      std::string_view client_sni,
+      int client_verify_mode,
+      bool is_cleartext,
+      H2Settings const &settings);
+
+  /** Return a connection obtained from lease. */
+  static void release(Connection *connection);
+
+  /// Guards _connections and the leases of the connections.
+  static std::mutex _pool_mutex;
+
+  /// The connections by target and SNI. A list keeps them in place.
+  static std::unordered_map<std::string, std::list<Connection>> _connections;
+
+  /// The number of streams each connection may have open, or 0 if disabled.
+  static unsigned _stream_limit;
+};
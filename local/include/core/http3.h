@@ -9,16 +9,22 @@
 
 #include "http.h"
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <functional>
 #include <list>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <ngtcp2/ngtcp2.h>
 #include <nghttp3/nghttp3.h>
 #include <openssl/ssl.h>
 #include <random>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -31,6 +37,64 @@
 class HttpHeader;
 struct Txn;
 
+/** QUIC transport parameters and congestion control for an HTTP/3
+ * connection.
+ *
+ * Each value is optional. Those left unset take the process-wide default
+ * from the command line, if any, and otherwise our built in values.
+ */
+struct QuicSettings
+{
+  static constexpr swoc::TextView INITIAL_MAX_DATA{"initial-max-data"};
+  static constexpr swoc::TextView INITIAL_MAX_STREAM_DATA{"initial-max-stream-data"};
+  static constexpr swoc::TextView INITIAL_MAX_STREAMS_BIDI{"initial-max-streams-bidi"};
+  static constexpr swoc::TextView INITIAL_MAX_STREAMS_UNI{"initial-max-streams-uni"};
+  static constexpr swoc::TextView MAX_UDP_PAYLOAD_SIZE{"max-udp-payload-size"};
+  static constexpr swoc::TextView CONGESTION_CONTROL{"congestion-control"};
+  static constexpr swoc::TextView PACING{"pacing"};
+
+  /// The congestion controllers provided by ngtcp2.
+  enum class CongestionControl { RENO, CUBIC, BBR };
+
+  /// The receive window of the connection as a whole.
+  std::optional<uint64_t> _initial_max_data;
+  /// The receive window of each stream.
+  std::optional<uint64_t> _initial_max_stream_data;
+  /// The number of request streams the peer may have open at once.
+  std::optional<uint64_t> _initial_max_streams_bidi;
+  std::optional<uint64_t> _initial_max_streams_uni;
+  /// The largest UDP payload to send, and to accept from the peer.
+  std::optional<uint64_t> _max_udp_payload_size;
+  std::optional<CongestionControl> _congestion_control;
+  /** Whether to spread the packets of each congestion window over the round
+   * trip rather than sending them as they are written. */
+  std::optional<bool> _pacing;
+
+  /** Set the value named by @a name.
+   *
+   * @param[in] name One of the setting names above.
+   * @param[in] value The value: a decimal number, except for the congestion
+   * control algorithm ("reno", "cubic", or "bbr") and pacing ("on" or "off").
+   *
+   * @return An errata describing an unknown name or an invalid value.
+   */
+  swoc::Errata set(swoc::TextView name, swoc::TextView value);
+
+  /** Set values from a comma separated list of name=value pairs.
+   *
+   * @param[in] description The list, as given on the command line.
+   *
+   * @return Any errata from setting the values.
+   */
+  swoc::Errata parse(swoc::TextView description);
+
+  /** Take each value not set in this from @a defaults.
+   *
+   * @param[in] defaults The values to use for those not set.
+   */
+  void merge(QuicSettings const &defaults);
+};
+
 namespace swoc
 {
 inline namespace SWOC_VERSION_NS
@@ -121,7 +185,8 @@ public:
 
   /** The callback function for ngtcp2 QUIC logging.
    *
-   * For details, see the ngtcp2 document for ngtcp2_qlog_write.
+   * The log is collected in qlog_buffer and handed to the LogFileWriter in
+   * large pieces. For details, see the ngtcp2 document for ngtcp2_qlog_write.
    */
   static void qlog_callback(void *user_data, uint32_t flags, const void *data, size_t datalen);
 
@@ -146,6 +211,25 @@ public:
   nghttp3_conn *h3conn = nullptr;
   nghttp3_settings h3settings;
   int qlogfd = -1;
+  /// QUIC log data not yet handed to the LogFileWriter.
+  std::string qlog_buffer;
+  /** Whether packets are paced: written no faster than ngtcp2's pacing rate
+   * allows, rather than as fast as the congestion window allows. */
+  bool pacing = false;
+
+  /// UDP traffic counters, used to report how well datagram batching works.
+  struct Stats {
+    size_t datagrams_received = 0;
+    size_t bytes_received = 0;
+    /** The number of batches of datagrams received: recvmmsg calls on a
+     * socket of the connection's own, and takes from the connection's queue
+     * on a QuicSharedSocket. */
+    size_t receive_calls = 0;
+    size_t datagrams_sent = 0;
+    size_t bytes_sent = 0;
+    /// The number of sendmmsg calls that sent datagrams.
+    size_t send_calls = 0;
+  } stats;
 
 private:
   // Members to support random number generation for connection id.
@@ -159,8 +243,21 @@ private:
    */
   static swoc::file::path _qlog_dir;
 
-  /// A mutex to ensure serialized writing to qlogfd.
-  static std::mutex _qlog_mutex;
+  /// Serializes the use of _rng across session threads.
+  static std::mutex _rng_mutex;
+};
+
+/** A UDP datagram received by a QuicSharedSocket for one of its connections.
+ */
+struct QuicDatagram
+{
+  /// The largest UDP payload a datagram holds. This is advertised to peers as
+  /// our max_udp_payload_size transport parameter.
+  static constexpr size_t max_payload_size = 2048;
+
+  swoc::IPEndpoint remote; ///< The address of the peer that sent the datagram.
+  size_t size = 0;         ///< The number of bytes of data in use.
+  std::array<uint8_t, max_payload_size> data;
 };
 
 /** Representation of an HTTP/3 stream (a single transaction). */
@@ -175,6 +272,18 @@ public:
   H3StreamState(bool is_client);
   ~H3StreamState();
 
+  /** Prepare this state, released by clear(), for a new stream.
+   *
+   * @param[in] is_client As for the constructor.
+   */
+  void reset(bool is_client);
+
+  /** Release what this state holds for its stream.
+   *
+   * The state keeps its allocations so that it can be reused via reset().
+   */
+  void clear();
+
   /// Whether this stream is for a server receiving a request from a client.
   bool will_receive_request() const;
 
@@ -228,6 +337,9 @@ public:
   // This is only used when will_receive_response is True.
   HttpHeader const *specified_response = nullptr;
 
+  /// Storage for rendered request template values sent on this stream.
+  swoc::MemArena rendered_values;
+
   /// The body that will be sent for this message.
   swoc::TextView body_to_send;
 
@@ -245,9 +357,11 @@ private:
 
   /** The QUIC stream ID for this stream. */
   int64_t _stream_id = 0;
-  std::deque<nghttp3_rcbuf *> _rcbufs_to_free;
+  std::vector<nghttp3_rcbuf *> _rcbufs_to_free;
 };
 
+class QuicSharedConnection;
+
 /** Representation of an HTTP/3 connection.
  *
  * An H3Session has a one to many relationship with H3StreamState objects.
@@ -258,10 +372,19 @@ public:
   using super_type = Session;
   H3Session();
   H3Session(swoc::TextView const &client_sni, int client_verify_mode = SSL_VERIFY_NONE);
+
+  /** Construct a server-side session.
+   *
+   * @param[in] connection The connection, created by a QuicSharedSocket upon
+   * receiving the client's Initial packet, whose datagrams this session will
+   * process.
+   */
+  explicit H3Session(std::shared_ptr<QuicSharedConnection> connection);
   ~H3Session();
   swoc::Rv<ssize_t> read(swoc::MemSpan<char> span) override;
   swoc::Rv<ssize_t> write(swoc::TextView data) override;
   swoc::Rv<ssize_t> write(HttpHeader const &hdr) override;
+  swoc::Rv<ssize_t> write_response(HttpHeader const &hdr, int64_t stream_id) override;
 
   /** Populate an nghttp3_nv header vector structure from an HttpHeader. */
   swoc::Errata pack_headers(HttpHeader const &hdr, nghttp3_nv *&nv_hdr, int &hdr_count);
@@ -273,11 +396,22 @@ public:
    * an issue because bodies are explicitly framed.
    */
   swoc::Rv<int> poll_for_headers(std::chrono::milliseconds timeout) override;
-  swoc::Rv<std::shared_ptr<HttpHeader>> read_and_parse_request(swoc::FixedBufferWriter &w) override;
-  swoc::Rv<size_t> drain_body(
-      HttpHeader const &hdr,
-      size_t expected_content_size,
-      swoc::TextView bytes_read) override;
+
+  /** Wait for the socket to become ready.
+   *
+   * A session on a QuicSharedSocket does not read the socket, which it shares
+   * with other connections. Waiting for POLLIN instead waits for datagrams to
+   * be queued for it by the socket.
+   */
+  swoc::Rv<int> poll_for_data_on_socket(
+      std::chrono::milliseconds timeout,
+      short events = POLLIN) override;
+
+  /** Close the connection, sending a CONNECTION_CLOSE to the peer if the
+   * connection is still open. */
+  void close() override;
+  swoc::Rv<std::shared_ptr<HttpHeader>> read_and_parse_request() override;
+  swoc::Rv<size_t> drain_body(HttpHeader const &hdr, size_t expected_content_size) override;
 
   /** Perform the server-side QUIC handshake for a connection. */
   swoc::Errata accept() override;
@@ -289,6 +423,20 @@ public:
    * address. */
   swoc::Errata do_connect(swoc::TextView interface, swoc::IPEndpoint const *target) override;
 
+  /** Set the QUIC settings for this session.
+   *
+   * @param[in] settings The settings for the connection, applied when it is
+   * opened.
+   */
+  void set_settings(QuicSettings const &settings);
+
+  /** Set the QUIC settings used for values a session does not specify.
+   *
+   * @param[in] settings The process-wide settings, such as from the command
+   * line.
+   */
+  static void set_default_settings(QuicSettings const &settings);
+
   /** Perform HTTP/3 global initialization.
    *
    * @param[in] process_exit_code: The integer to set to non-zero on failure
@@ -340,11 +488,38 @@ public:
   /// Whether an entire stream has been received and is ready for processing.
   bool get_a_stream_has_ended() const;
 
-  void record_stream_state(int64_t stream_id, std::shared_ptr<H3StreamState> stream_state);
+  /// @return Whether this is a server-side session.
+  bool is_server() const;
+
+  /** The connection state shared with a QuicSharedSocket.
+   *
+   * @return The connection, or nullptr if the session has a socket of its
+   * own.
+   */
+  QuicSharedConnection *shared_connection() const;
+
+  /** Obtain a state for a new stream, reusing that of a closed stream if
+   * there is one.
+   *
+   * @param[in] is_client As for the H3StreamState constructor.
+   *
+   * @return The stream state, owned by this session.
+   */
+  H3StreamState *new_stream_state(bool is_client);
+
+  void record_stream_state(int64_t stream_id, H3StreamState *stream_state);
+
+  /** Indicate that a stream recorded via record_stream_state has closed.
+   *
+   * The stream's state is kept for reuse by a later stream.
+   *
+   * @param[in] stream_id The identifier of the closed stream.
+   */
+  void record_stream_closed(int64_t stream_id);
 
 public:
   /// A mapping from stream_id to H3StreamState.
-  std::unordered_map<int64_t, std::shared_ptr<H3StreamState>> stream_map;
+  StreamTable<int64_t, H3StreamState> stream_map;
 
   /// The representation of the QUIC socket for this stream (connection).
   QuicSocket quic_socket;
@@ -373,20 +548,52 @@ protected:
 private:
   nghttp3_nv tv_to_nv(char const *name, swoc::TextView v);
 
+  /** Submit @a hdr to nghttp3 and send what it produces.
+   *
+   * @param[in] hdr The request or response to submit.
+   * @param[in] response_stream_id For a response, the stream of its request.
+   */
+  swoc::Rv<ssize_t> submit_message(HttpHeader const &hdr, int64_t response_stream_id);
+
   /** Create and configure the UDP socket for this connection. */
   swoc::Errata configure_udp_socket(swoc::TextView interface, swoc::IPEndpoint const *target);
 
   /** Create and configure the SSL instance for this session. */
   swoc::Errata client_ssl_session_init(SSL_CTX *client_context);
 
+  /** Create and configure the SSL instance for a server-side session. */
+  swoc::Errata server_ssl_session_init(SSL_CTX *server_context);
+
   swoc::Errata receive_responses();
 
+  /** Write a CONNECTION_CLOSE to the peer unless the connection is already
+   * closing or draining. */
+  void send_connection_close();
+
+  /// Add the UDP traffic counters of this connection to @a errata.
+  void note_udp_stats(swoc::Errata &errata) const;
+
 private:
   /** The streams which have completed */
   std::deque<int64_t> _ended_streams;
   swoc::IPEndpoint const *_endpoint = nullptr;
 
-  std::shared_ptr<H3StreamState> _last_added_stream;
+  /// For a session on a QuicSharedSocket, the state shared with the socket.
+  std::shared_ptr<QuicSharedConnection> _shared_connection;
+  bool _is_server = false;
+
+  /// The states of the streams in stream_map and those kept for reuse.
+  StreamStatePool<H3StreamState> _stream_states;
+  H3StreamState *_last_added_stream = nullptr;
+
+  /// Storage for the header fields of a message, which nghttp3 copies.
+  std::vector<nghttp3_nv> _nv_buffer;
+
+  /// The QUIC settings of this session, before the defaults are merged in.
+  QuicSettings _settings;
+
+  /// The settings for values not given by a session's own settings.
+  static QuicSettings _default_settings;
 
   /** The client context to use for HTTP/3 connections.
    *
@@ -407,3 +614,240 @@ private:
   /// The system status code. This is set to non-zero if problems are detected.
   static int *process_exit_code;
 };
+
+class QuicSharedSocket;
+
+/** The state of a QUIC connection shared between its H3Session and the
+ * QuicSharedSocket that receives the connection's datagrams.
+ *
+ * The socket's thread queues datagrams here, and the thread running the
+ * session takes them.
+ */
+class QuicSharedConnection : public std::enable_shared_from_this<QuicSharedConnection>
+{
+public:
+  /** Construct a client-side connection.
+   *
+   * @param[in] socket The socket upon which to connect.
+   * @param[in] remote The address of the server.
+   */
+  QuicSharedConnection(std::shared_ptr<QuicSharedSocket> socket, swoc::IPEndpoint const &remote);
+
+  /** Construct a server-side connection.
+   *
+   * @param[in] socket The socket upon which the connection was accepted.
+   * @param[in] remote The address of the client.
+   * @param[in] initial_header The header of the client's first Initial packet.
+   */
+  QuicSharedConnection(
+      std::shared_ptr<QuicSharedSocket> socket,
+      swoc::IPEndpoint const &remote,
+      ngtcp2_pkt_hd const &initial_header);
+
+  QuicSharedConnection(QuicSharedConnection const &) = delete;
+  QuicSharedConnection &operator=(QuicSharedConnection const &) = delete;
+
+  /// The most datagrams queued for a connection. As when a socket's receive
+  /// buffer is full, further datagrams are dropped and QUIC recovers them.
+  static constexpr size_t max_queued = 1024;
+
+  /** Queue a datagram for the connection.
+   *
+   * @return false if the connection is closed or max_queued datagrams are
+   * already queued, in which case the datagram was dropped.
+   */
+  bool push(swoc::IPEndpoint const &from, uint8_t const *data, size_t size);
+
+  /** Wait for datagrams to be queued.
+   *
+   * @return 1 if datagrams are queued, 0 on timeout, -1 if the connection is
+   * closed.
+   */
+  int wait(std::chrono::milliseconds timeout);
+
+  /** Take the queued datagrams.
+   *
+   * @return The datagrams, which are valid until the next call.
+   */
+  std::vector<QuicDatagram> const &take();
+
+  /// Route datagrams addressed to @a cid to this connection.
+  void add_connection_id(ngtcp2_cid const &cid);
+
+  /// Stop routing datagrams addressed to @a cid to this connection.
+  void remove_connection_id(ngtcp2_cid const &cid);
+
+  /** Stop receiving datagrams, dropping the connection's IDs from its socket
+   * and waking a thread in wait(). */
+  void close();
+
+public:
+  /// The socket that receives this connection's datagrams.
+  std::shared_ptr<QuicSharedSocket> const socket;
+
+  /// The address of the peer. Packets are sent here.
+  swoc::IPEndpoint const remote;
+
+  /// For a server, the connection ID chosen by the client for its Initial
+  /// packets.
+  ngtcp2_cid original_dcid;
+
+  /// For a server, the client's source connection ID, the destination of our
+  /// packets.
+  ngtcp2_cid client_scid;
+
+  /// For a server, the QUIC version of the client's Initial packet.
+  uint32_t version = 0;
+
+private:
+  std::mutex _mutex;
+  std::condition_variable _cvar;
+  /// Datagrams received but not yet taken.
+  std::vector<QuicDatagram> _queued;
+  /// The datagrams returned by the last take(), kept for its storage.
+  std::vector<QuicDatagram> _taken;
+  /// The connection IDs routed to this connection.
+  std::vector<ngtcp2_cid> _connection_ids;
+  bool _closed = false;
+};
+
+/** A UDP socket which carries the datagrams of many QUIC connections.
+ *
+ * The socket receives datagrams in batches and routes them to their
+ * connections by destination connection ID. A server socket also accepts new
+ * connections from Initial packets. Several server sockets may be bound to the
+ * same address via SO_REUSEPORT, in which case the kernel spreads the clients
+ * across them by address.
+ */
+class QuicSharedSocket : public std::enable_shared_from_this<QuicSharedSocket>
+{
+public:
+  /// Called with the session of each newly accepted connection.
+  using AcceptHandler = std::function<void(std::unique_ptr<H3Session>)>;
+
+  /** Open a non-blocking UDP socket bound to @a addr.
+   *
+   * @param[in] addr The address to bind to. A port of 0 binds to an ephemeral
+   * port.
+   *
+   * @return The socket, or nullptr on failure.
+   */
+  static swoc::Rv<std::shared_ptr<QuicSharedSocket>> open(swoc::IPEndpoint const &addr);
+
+  ~QuicSharedSocket();
+
+  /** Receive datagrams and route them to their connections.
+   *
+   * @param[in] timeout How long to wait for datagrams.
+   * @param[in] accept_session Called with a session for each new connection.
+   * It runs on this thread, so it should hand the session off rather than
+   * serve it. If empty, as for a client socket, packets for unknown
+   * connections are dropped.
+   */
+  swoc::Errata receive(std::chrono::milliseconds timeout, AcceptHandler const &accept_session);
+
+  /// @return The socket's file descriptor, upon which connections send.
+  int get_fd() const;
+
+  /// @return The address to which the socket is bound.
+  swoc::IPEndpoint const &get_local_addr() const;
+
+  /// Route datagrams addressed to @a cid to @a connection.
+  void add_connection_id(ngtcp2_cid const &cid, std::shared_ptr<QuicSharedConnection> connection);
+
+  /// Stop routing datagrams addressed to @a cid.
+  void remove_connection_id(ngtcp2_cid const &cid);
+
+private:
+  QuicSharedSocket(int fd, swoc::IPEndpoint const &local_addr);
+
+  /** Deliver a received datagram to its connection, accepting a new
+   * connection if it starts one. */
+  void route(
+      swoc::IPEndpoint const &remote,
+      uint8_t const *data,
+      size_t size,
+      AcceptHandler const &accept_session,
+      swoc::Errata &errata);
+
+  struct CidHash
+  {
+    size_t operator()(ngtcp2_cid const &cid) const;
+  };
+
+  struct CidEqual
+  {
+    bool operator()(ngtcp2_cid const &lhs, ngtcp2_cid const &rhs) const;
+  };
+
+private:
+  int _fd = -1;
+  swoc::IPEndpoint _local_addr;
+
+  /// Guards _connections, which session threads update as IDs change.
+  std::mutex _mutex;
+  std::unordered_map<ngtcp2_cid, std::shared_ptr<QuicSharedConnection>, CidHash, CidEqual>
+      _connections;
+};
+
+/** The UDP sockets shared by the client's HTTP/3 connections.
+ *
+ * By default each client H3Session opens a UDP socket of its own. Once enabled,
+ * connections are instead spread across a few sockets per core, each drained
+ * by a thread of its own which routes the received datagrams to their
+ * connections.
+ */
+class QuicClientSocketPool
+{
+public:
+  /** Enable socket sharing.
+   *
+   * @param[in] sockets_per_core The number of sockets to open per core for
+   * each address family. 0 disables sharing.
+   */
+  static void set_sockets_per_core(unsigned sockets_per_core);
+
+  /// Whether client connections share sockets.
+  static bool is_enabled();
+
+  /** Obtain a socket for a connection to @a target, opening the sockets for
+   * its address family on first use.
+   *
+   * @param[in] interface The interface to bind the sockets to, if not empty.
+   * @param[in] target The address to which the connection will be made.
+   *
+   * @return The socket, or nullptr on failure.
+   */
+  static swoc::Rv<std::shared_ptr<QuicSharedSocket>>
+  get_socket(swoc::TextView interface, swoc::IPEndpoint const &target);
+
+  /** Stop the receiving threads and close the sockets. */
+  static void terminate();
+
+private:
+  /// The sockets of an address family.
+  struct Sockets
+  {
+    std::vector<std::shared_ptr<QuicSharedSocket>> _sockets;
+    /// The index of the socket for the next connection.
+    size_t _next = 0;
+  };
+
+  /// Route the datagrams received on @a socket until terminate is called.
+  static void receive(std::shared_ptr<QuicSharedSocket> socket);
+
+  /// Guards _sockets and _threads.
+  static std::mutex _pool_mutex;
+
+  /// The sockets by address family.
+  static std::unordered_map<int, Sockets> _sockets;
+
+  /// The receiving thread of each socket.
+  static std::vector<std::thread> _threads;
+
+  /// Set by terminate to stop the receiving threads.
+  static std::atomic<bool> _shutdown;
+
+  /// The number of sockets per core, or 0 if disabled.
+  static unsigned _sockets_per_core;
+};
@@ -11,6 +11,8 @@
 
 #include <openssl/err.h>
 #include <openssl/ssl.h>
+#include <atomic>
+#include <chrono>
 #include <mutex>
 #include <string>
 #include <string_view>
@@ -158,8 +160,21 @@ public:
 
   /** @see Session::read */
   swoc::Rv<ssize_t> read(swoc::MemSpan<char> span) override;
+  /** Decrypt and discard up to @a n bytes into the per-thread discard buffer.
+   *
+   * @see Session::discard
+   */
+  swoc::Rv<ssize_t> discard(size_t n) override;
   /** @see Session::write */
   swoc::Rv<ssize_t> write(swoc::TextView data) override;
+  /** Coalesce the buffers in @a iov into as few SSL_write calls as possible.
+   *
+   * Buffers are copied into a single TLS record sized buffer so that a small
+   * message is sent as one record rather than one record per buffer.
+   *
+   * @see Session::writev
+   */
+  swoc::Rv<ssize_t> writev(swoc::MemSpan<iovec> iov) override;
   /** @see Session::write */
   swoc::Rv<ssize_t>
   write(HttpHeader const &hdr) override
@@ -188,11 +203,45 @@ public:
 
   /** @see Session::close */
   void close() override;
-  /** @see Session::accept */
+  /** TLS content must be encrypted in user space, so bodies cannot be sent
+   * with sendfile. */
+  bool can_send_content_file() const override;
+  /** @see Session::accept
+   *
+   * If server_max_early_data is set, any early data the client sends is read
+   * during the handshake and returned by the first reads.
+   */
   swoc::Errata accept() override;
+  /** Report a request received as early data as ready to be read.
+   *
+   * @see Session::poll_for_headers
+   */
+  swoc::Rv<int> poll_for_headers(std::chrono::milliseconds timeout) override;
   /** @see Session::connect */
   swoc::Errata connect() override;
+  /** Connect using @a ctx.
+   *
+   * If early data is enabled and a cached session allowing it is offered, the
+   * handshake is deferred: what is written before the first read is sent as
+   * TLS 1.3 early data along with the client hello.
+   */
   swoc::Errata connect(SSL_CTX *ctx);
+  /** Time the first transaction on the connection for the early data
+   * statistics.
+   *
+   * @see Session::run_transaction
+   */
+  swoc::Errata run_transaction(Txn const &json_txn) override;
+
+  /** Record the latency of a transaction for the early data statistics.
+   *
+   * Only the first transaction on a connection is recorded, since it is the
+   * one whose request may have been sent as early data.
+   *
+   * @param[in] elapsed The time from sending the request to receiving the
+   * response. The handshake time is added if it preceded the request.
+   */
+  void record_transaction_latency(std::chrono::microseconds elapsed) override;
 
   SSL *
   get_ssl()
@@ -304,6 +353,17 @@ public:
    */
   static swoc::Errata configure_certificates(SSL_CTX *&context);
 
+  /** Configure how a server context caches sessions for resumption.
+   *
+   * This applies server_session_cache_size, ticket_key_file, and
+   * server_max_early_data.
+   *
+   * @param[in] context The server context to configure.
+   *
+   * @return An errata indicating the status of the configuration.
+   */
+  static swoc::Errata configure_session_resumption(SSL_CTX *context);
+
   /** Return whether TLS secrets are currently being logged.
    *
    * @return true if TLS secrets are currently being logged, false otherwise.
@@ -317,6 +377,15 @@ public:
    */
   static void keylog_callback(SSL const *ssl, char const *line);
 
+  /** Hand the key log lines the calling thread has collected to the
+   * LogFileWriter.
+   *
+   * keylog_callback collects lines per thread. This is called once a
+   * handshake completes or its connection closes, so that the keys of a
+   * connection are queued together.
+   */
+  static void flush_keylog();
+
 public:
   /// The client or server public key file. This may also contain the private
   /// key.
@@ -331,7 +400,62 @@ public:
   /// The CA directory containing one or more CA cert files.
   static swoc::file::path ca_certificate_dir;
 
+  /// The number of sessions the server caches for session ID resumption. A
+  /// negative value keeps OpenSSL's default and 0 disables the cache.
+  static int server_session_cache_size;
+
+  /// The file of session ticket keys, which lets separate server processes
+  /// resume each other's sessions. The keys are generated if the file does not
+  /// exist.
+  static swoc::file::path ticket_key_file;
+
+  /// The amount of TLS 1.3 early data the server's session tickets allow. 0,
+  /// the default, disables early data.
+  static uint32_t server_max_early_data;
+
 protected:
+  /** Complete the client handshake, polling as necessary.
+   *
+   * @return logging and status information via an Errata.
+   */
+  swoc::Errata complete_handshake();
+
+  /** Complete the handshake of a connection which has deferred it to send
+   * early data, resending the data if the proxy rejected it.
+   *
+   * This is called before the first read, or before a write that would exceed
+   * the session's early data limit.
+   *
+   * @return logging and status information via an Errata.
+   */
+  swoc::Errata complete_early_data();
+
+  /** Read the early data sent with the client hello into
+   * _early_data_received, completing the handshake's first flight.
+   *
+   * @return logging and status information via an Errata.
+   */
+  swoc::Errata read_early_data();
+
+  /** Move the oldest bytes of _early_data_received into @a span.
+   *
+   * @return The number of bytes moved.
+   */
+  size_t take_early_data(swoc::MemSpan<char> span);
+
+  /** Write @a data as early data, before the handshake completes.
+   *
+   * @return The number of bytes written.
+   */
+  swoc::Rv<ssize_t> write_early_data(swoc::TextView data);
+
+  /// Whether the handshake is deferred for early data.
+  bool
+  early_data_is_pending() const
+  {
+    return _early_data == EarlyData::PENDING;
+  }
+
   static swoc::Errata client_init(SSL_CTX *&client_context);
   static swoc::Errata server_init(SSL_CTX *&server_context);
   static void terminate(SSL_CTX *&context);
@@ -348,6 +472,40 @@ protected:
    */
   int _client_verify_mode = SSL_VERIFY_NONE;
 
+  /** The key under which TLSSessionCache stores the sessions of this
+   * connection. This only applies to the client.
+   */
+  std::string _session_cache_key;
+
+  /// The progress of TLS 1.3 early data on a client connection.
+  enum class EarlyData {
+    NONE,     ///< Early data is not being sent.
+    PENDING,  ///< Early data is being written and the handshake is deferred.
+    ACCEPTED, ///< The proxy accepted the early data.
+    REJECTED, ///< The proxy rejected the early data, which was then resent.
+  };
+  EarlyData _early_data = EarlyData::NONE;
+
+  /// The data written as early data, kept for resending if it is rejected.
+  std::string _early_data_sent;
+
+  /// The amount of early data the offered session allows.
+  uint32_t _max_early_data = 0;
+
+  /// The early data received by a server, not yet read.
+  std::string _early_data_received;
+
+  /// Whether TLSSessionCache offered a session in the client hello.
+  bool _offered_session = false;
+
+  /// When the client hello was sent, and how long the handshake took.
+  std::chrono::system_clock::time_point _handshake_start;
+  std::chrono::microseconds _handshake_duration{0};
+
+  /// Whether the next transaction is the first on the connection and is to
+  /// be recorded via record_transaction_latency.
+  bool _time_first_transaction = false;
+
   static SSL_CTX *server_context;
   static SSL_CTX *client_context;
 
@@ -363,13 +521,153 @@ private:
    */
   static swoc::Errata open_tls_secrets_log_file(swoc::TextView tls_secrets_log_file);
 
-private:
-  /// A mutex to ensure serialized writing to tls_secrets_log_file_fd.
-  static std::mutex tls_secrets_log_file_fd_mutex;
+  /** Load the session ticket keys from ticket_key_file.
+   *
+   * If the file does not exist, it is created with random keys. Concurrently
+   * starting processes agree on a single set of keys since the file is linked
+   * into place only if no other process has done so.
+   *
+   * @return The keys, or errata on failure.
+   */
+  static swoc::Rv<std::string> load_ticket_keys();
 
-  /// The file descriptor for TLS secrets logging.
+private:
+  /** The file descriptor for TLS secrets logging.
+   *
+   * Entries are written by the LogFileWriter, so the callback does not block
+   * handshakes on the file. */
   static int tls_secrets_log_file_fd;
 
   /// The file to which TLS secrets will be logged.
   static swoc::file::path tls_secrets_log_file;
+
+  /// The key log lines collected by a thread. See flush_keylog.
+  struct KeylogLines;
+  static thread_local KeylogLines keylog_lines;
+};
+
+/** A client-side cache of TLS sessions for resumption.
+ *
+ * Sessions are keyed by SNI, or by target address if no SNI is sent, and by
+ * client context, which determines the offered ALPN protocols. As with a
+ * browser keying sessions by host name, the targets serving a name share its
+ * sessions, so those sharing ticket keys resume each other's. Whatever the
+ * server issues is cached, be it a TLS 1.2 session ID or a TLS 1.2 or 1.3
+ * session ticket, and the most recently issued session for a key is the one
+ * offered.
+ */
+class TLSSessionCache
+{
+public:
+  /** Enable the cache.
+   *
+   * @param[in] ratio The fraction, from 0 to 1, of client handshakes which
+   * offer a cached session. 0 disables the cache.
+   */
+  static void set_resumption_ratio(double ratio);
+
+  /// Whether sessions are cached and offered for resumption.
+  static bool is_enabled();
+
+  /** Send the first data on connections offering a cached session as TLS 1.3
+   * early data, provided the session allows it.
+   *
+   * @param[in] enable Whether to send early data.
+   */
+  static void set_early_data(bool enable);
+
+  /// Whether early data is sent on resumed connections.
+  static bool early_data_is_enabled();
+
+  /** Have @a context pass the sessions issued by servers to the cache.
+   *
+   * @param[in] context A client context.
+   */
+  static void configure_context(SSL_CTX *context);
+
+  /** Build the cache key of a connection.
+   *
+   * @param[in] fd The connected socket, from which the target is taken if
+   * @a sni is empty.
+   * @param[in] sni The SNI sent in the client hello.
+   * @param[in] context The context from which the connection's SSL object is
+   * created.
+   *
+   * @return The key.
+   */
+  static std::string make_key(int fd, std::string_view sni, SSL_CTX const *context);
+
+  /** Prepare a connection for its handshake.
+   *
+   * The connection's new sessions are stored under @a key, and a cached
+   * session is offered if it is this handshake's turn to resume per the ratio.
+   *
+   * @param[in] ssl The connection, before SSL_connect.
+   * @param[in] key The cache key. This must outlive @a ssl.
+   *
+   * @return Whether a cached session was offered.
+   */
+  static bool prepare(SSL *ssl, std::string const &key);
+
+  /** Tally a completed client handshake.
+   *
+   * @param[in] offered Whether a cached session was offered.
+   * @param[in] resumed Whether the server resumed the session.
+   * @param[in] duration The time the handshake took.
+   */
+  static void record_handshake(bool offered, bool resumed, std::chrono::microseconds duration);
+
+  /** Tally the outcome of early data.
+   *
+   * @param[in] accepted Whether the proxy accepted the early data.
+   */
+  static void record_early_data(bool accepted);
+
+  /** Tally the latency of the first transaction on a connection.
+   *
+   * @param[in] zero_rtt Whether the request was accepted as early data.
+   * @param[in] latency The transaction's latency, including any handshake
+   * which preceded it.
+   */
+  static void record_first_transaction(bool zero_rtt, std::chrono::microseconds latency);
+
+  /** Report the handshake and transaction tallies and free the cached
+   * sessions. */
+  static void terminate();
+
+private:
+  /// The callback for SSL_CTX_sess_set_new_cb.
+  static int new_session_callback(SSL *ssl, SSL_SESSION *session);
+
+  /// Guards _sessions.
+  static std::mutex _sessions_mutex;
+
+  /// The most recently issued session per key. The cache owns a reference.
+  static std::unordered_map<std::string, SSL_SESSION *> _sessions;
+
+  /// The ex_data index of the cache key of an SSL object.
+  static int _key_index;
+
+  /// The fraction of handshakes which offer a cached session.
+  static double _resumption_ratio;
+
+  /// Whether early data is sent on resumed connections.
+  static bool _early_data;
+
+  /// The number of handshakes prepared with a cached session available,
+  /// which spreads out the resumptions.
+  static std::atomic<uint64_t> _prepared;
+
+  /// Handshake tallies.
+  static std::atomic<uint64_t> _full_handshakes;
+  static std::atomic<uint64_t> _resumed_handshakes;
+  static std::atomic<uint64_t> _rejected_resumptions;
+  static std::atomic<uint64_t> _full_handshake_us;
+  static std::atomic<uint64_t> _resumed_handshake_us;
+  static std::atomic<uint64_t> _accepted_early_data;
+  static std::atomic<uint64_t> _rejected_early_data;
+  static std::atomic<uint64_t> _zero_rtt_transactions;
+  static std::atomic<uint64_t> _one_rtt_transactions;
+  static std::atomic<uint64_t> _zero_rtt_us;
+  static std::atomic<uint64_t> _one_rtt_us;
 };
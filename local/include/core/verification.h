@@ -10,6 +10,7 @@
 #include "http.h"
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -526,10 +527,20 @@ public:
     return _expects_duplicate_fields;
   }
 
+private:
+  /** Whether @a value equals the expected value.
+   *
+   * If the expected value is a request template, @a value is compared against
+   * the template's possible renderings.
+   */
+  bool value_matches(swoc::TextView value) const;
+
 private:
   swoc::TextView _value;                  ///< Only EqualityChecks require value comparisons.
   std::vector<swoc::TextView> _values;    ///< Only EqualityChecks require value comparisons.
   bool _expects_duplicate_fields = false; ///< Whether the Rule is configured for duplicate fields.
+  /// Set if _value contains request template tokens.
+  std::optional<RequestTemplate> _value_template;
 };
 
 class PresenceCheck : public RuleCheck
@@ -15,6 +15,7 @@
 
 #include <assert.h>
 #include <chrono>
+#include <cstdlib>
 #include <list>
 #include <mutex>
 #include <string>
@@ -56,6 +57,16 @@ using std::this_thread::sleep_for;
  */
 bool Use_Strict_Checking = false;
 
+/** The number of HTTP/1 requests each session may have outstanding. A depth
+ * of 1 disables pipelining.
+ */
+unsigned Pipeline_Depth = 1;
+
+/** The number of streams each HTTP/2 session may have open at once, beyond
+ * the limit the peer sets. 0 means only the peer's limit applies.
+ */
+unsigned H2_Stream_Limit = 0;
+
 std::unordered_set<std::string> Keys_Whitelist;
 
 swoc::TextView specified_interface;
@@ -108,14 +119,30 @@ struct TargetSelector
     return http3_target;
   }
 
+  /** Round robin retrieval of h2c (cleartext HTTP/2) addresses. */
+  swoc::IPEndpoint const *
+  get_h2c_target()
+  {
+    if (h2c_targets.empty()) {
+      return nullptr;
+    }
+    auto const *h2c_target = &h2c_targets[h2c_target_index];
+    if (++h2c_target_index >= h2c_targets.size()) {
+      h2c_target_index = 0;
+    }
+    return h2c_target;
+  }
+
   std::deque<swoc::IPEndpoint> http_targets;
   std::deque<swoc::IPEndpoint> https_targets;
   std::deque<swoc::IPEndpoint> http3_targets;
+  std::deque<swoc::IPEndpoint> h2c_targets;
 
 private:
   size_t http_target_index = 0;
   size_t https_target_index = 0;
   size_t http3_target_index = 0;
+  size_t h2c_target_index = 0;
 };
 
 TargetSelector Target_Selector;
@@ -186,6 +213,8 @@ class ClientThreadInfo : public ThreadInfo
 {
 public:
   Ssn *_ssn = nullptr;
+  /// The values with which to render the session's request templates.
+  TemplateContext _template_context;
   bool
   data_ready() override
   {
@@ -269,8 +298,22 @@ ClientReplayFileHandler::ssn_open(YAML::Node const &node)
     if (http_node.result().IsDefined() && http_node.result()[YAML_SSN_PROTOCOL_VERSION]) {
       if (http_node.result()[YAML_SSN_PROTOCOL_VERSION].Scalar() == "2") {
         _ssn->is_h2 = true;
+        auto &&[h2_settings, settings_errata] = parse_h2_settings(http_node);
+        if (!settings_errata.is_ok()) {
+          errata.note(std::move(settings_errata));
+          errata.error(R"(Session at "{}":{} has bad HTTP/2 settings.)", _path, _ssn->_line_no);
+          return errata;
+        }
+        _ssn->_h2_settings = std::make_shared<H2Settings>(h2_settings);
       } else if (http_node.result()[YAML_SSN_PROTOCOL_VERSION].Scalar() == "3") {
         _ssn->is_h3 = true;
+        auto &&[quic_settings, settings_errata] = parse_quic_settings(http_node);
+        if (!settings_errata.is_ok()) {
+          errata.note(std::move(settings_errata));
+          errata.error(R"(Session at "{}":{} has bad QUIC settings.)", _path, _ssn->_line_no);
+          return errata;
+        }
+        _ssn->_quic_settings = std::make_shared<QuicSettings>(quic_settings);
       }
     }
   }
@@ -359,6 +402,7 @@ ClientReplayFileHandler::client_request(YAML::Node const &node)
       _txn._req.set_is_http3();
     }
     errata.note(YamlParser::populate_http_message(node, _txn._req));
+    errata.note(_txn._req.compile_templates());
     if (_txn._req._method.empty()) {
       errata.error(R"(client-request node without a method at "{}":{}.)", _path, node.Mark().line);
     }
@@ -391,6 +435,7 @@ ClientReplayFileHandler::proxy_request(YAML::Node const &node)
       _txn._req.set_is_http3();
     }
     errata.note(YamlParser::populate_http_message(node, _txn._req));
+    errata.note(_txn._req.compile_templates());
     if (_txn._req._method.empty()) {
       errata.error(R"(proxy-request node without a method at "{}":{}.)", _path, node.Mark().line);
     }
@@ -524,11 +569,15 @@ struct Engine
 int Engine::process_exit_code = 0;
 
 void
-Run_Session(Ssn const &ssn, TargetSelector &target_selector)
+Run_Session(
+    Ssn const &ssn,
+    TargetSelector &target_selector,
+    TemplateContext const &template_context)
 {
   swoc::Errata errata;
   std::unique_ptr<Session> session;
   swoc::IPEndpoint const *real_target = nullptr;
+  bool is_h2c = false;
 
   errata.diag(
       R"(Starting session "{}":{} protocol={}.)",
@@ -541,15 +590,37 @@ Run_Session(Ssn const &ssn, TargetSelector &target_selector)
     if (real_target == nullptr) {
       errata.error("Could not replay an HTTP/3 session because no HTTP/3 ports are provided.");
     } else {
-      session = std::make_unique<H3Session>(ssn._client_sni, ssn._client_verify_mode);
+      auto h3_session = std::make_unique<H3Session>(ssn._client_sni, ssn._client_verify_mode);
+      if (ssn._quic_settings) {
+        h3_session->set_settings(*ssn._quic_settings);
+      }
+      session = std::move(h3_session);
       errata.diag("Connecting via HTTP/3 over QUIC.");
     }
+  } else if (ssn.is_h2 && !ssn.is_tls && !target_selector.h2c_targets.empty()) {
+    // An HTTP/2 session without a TLS layer is replayed as h2c if there is
+    // an h2c target to replay it to.
+    real_target = target_selector.get_h2c_target();
+    is_h2c = true;
+    auto h2_session = std::make_unique<H2Session>(ssn._client_sni, ssn._client_verify_mode);
+    h2_session->set_is_cleartext(true);
+    if (ssn._h2_settings) {
+      h2_session->set_settings(*ssn._h2_settings);
+    }
+    h2_session->set_stream_limit(H2_Stream_Limit);
+    session = std::move(h2_session);
+    errata.diag("Connecting via HTTP/2 over cleartext TCP (h2c).");
   } else if (ssn.is_h2) {
     real_target = target_selector.get_https_target();
     if (real_target == nullptr) {
       errata.error("Could not replay an HTTP/2 session because no HTTPS ports are provided.");
     } else {
-      session = std::make_unique<H2Session>(ssn._client_sni, ssn._client_verify_mode);
+      auto h2_session = std::make_unique<H2Session>(ssn._client_sni, ssn._client_verify_mode);
+      if (ssn._h2_settings) {
+        h2_session->set_settings(*ssn._h2_settings);
+      }
+      h2_session->set_stream_limit(H2_Stream_Limit);
+      session = std::move(h2_session);
       errata.diag("Connecting via HTTP/2 over TLS.");
     }
   } else if (ssn.is_tls) {
@@ -575,6 +646,27 @@ Run_Session(Ssn const &ssn, TargetSelector &target_selector)
     return;
   }
 
+  if (ssn.is_h2 && H2ConnectionPool::is_enabled()) {
+    // The transactions become streams of a connection shared with other
+    // sessions rather than of one of their own.
+    errata.note(H2ConnectionPool::run_transactions(
+        ssn._client_sni,
+        ssn._client_verify_mode,
+        is_h2c,
+        ssn._h2_settings ? *ssn._h2_settings : H2Settings{},
+        ssn._transactions,
+        template_context,
+        specified_interface,
+        real_target,
+        ssn._rate_multiplier));
+    if (!errata.is_ok()) {
+      Engine::process_exit_code = 1;
+    }
+    return;
+  }
+
+  session->set_template_context(template_context);
+  session->set_pipeline_depth(Pipeline_Depth);
   errata.note(session->do_connect(specified_interface, real_target));
   if (errata.is_ok()) {
     errata.note(session->run_transactions(
@@ -600,7 +692,7 @@ TF_Client(std::thread *t)
     Client_Thread_Pool.wait_for_work(&thread_info);
 
     if (thread_info._ssn != nullptr) {
-      Run_Session(*thread_info._ssn, Target_Selector);
+      Run_Session(*thread_info._ssn, Target_Selector, thread_info._template_context);
     }
   }
 }
@@ -628,12 +720,103 @@ Engine::command_run()
     Use_Strict_Checking = true;
   }
 
+  auto pipeline_depth_arg{arguments.get("pipeline-depth")};
+  if (pipeline_depth_arg.size() == 1) {
+    auto const pipeline_depth = atoi(pipeline_depth_arg[0].c_str());
+    if (pipeline_depth < 1) {
+      errata.error(R"("--pipeline-depth" must be a positive integer.)");
+      process_exit_code = 1;
+      return;
+    }
+    Pipeline_Depth = pipeline_depth;
+  }
+
+  auto h2_stream_limit_arg{arguments.get("h2-stream-limit")};
+  if (h2_stream_limit_arg.size() == 1) {
+    auto const h2_stream_limit = atoi(h2_stream_limit_arg[0].c_str());
+    if (h2_stream_limit < 0) {
+      errata.error(R"("--h2-stream-limit" must not be negative.)");
+      process_exit_code = 1;
+      return;
+    }
+    H2_Stream_Limit = h2_stream_limit;
+  }
+
+  auto h2_coalesce_arg{arguments.get("h2-coalesce")};
+  if (h2_coalesce_arg.size() == 1) {
+    auto const h2_coalesce = atoi(h2_coalesce_arg[0].c_str());
+    if (h2_coalesce < 0) {
+      errata.error(R"("--h2-coalesce" must not be negative.)");
+      process_exit_code = 1;
+      return;
+    }
+    H2ConnectionPool::set_stream_limit(h2_coalesce);
+  }
+
+  auto h3_sockets_per_core_arg{arguments.get("h3-sockets-per-core")};
+  if (h3_sockets_per_core_arg.size() == 1) {
+    auto const h3_sockets_per_core = atoi(h3_sockets_per_core_arg[0].c_str());
+    if (h3_sockets_per_core < 0) {
+      errata.error(R"("--h3-sockets-per-core" must not be negative.)");
+      process_exit_code = 1;
+      return;
+    }
+    QuicClientSocketPool::set_sockets_per_core(h3_sockets_per_core);
+  }
+
+  auto tls_resumption_arg{arguments.get("tls-resumption")};
+  if (tls_resumption_arg.size() == 1) {
+    char const *const text = tls_resumption_arg[0].c_str();
+    char *end = nullptr;
+    auto const tls_resumption = strtod(text, &end);
+    if (end == text || *end != '\0' || !(tls_resumption >= 0.0 && tls_resumption <= 1.0)) {
+      errata.error(R"("--tls-resumption" must be from 0 to 1.)");
+      process_exit_code = 1;
+      return;
+    }
+    TLSSessionCache::set_resumption_ratio(tls_resumption);
+  }
+
+  if (arguments.get("tls-early-data")) {
+    if (!TLSSessionCache::is_enabled()) {
+      errata.error(R"("--tls-early-data" requires "--tls-resumption".)");
+      process_exit_code = 1;
+      return;
+    }
+    TLSSessionCache::set_early_data(true);
+  }
+
+  if (auto h2_settings_arg{arguments.get("h2-settings")}; h2_settings_arg.size() == 1) {
+    H2Settings h2_settings;
+    errata.note(h2_settings.parse(h2_settings_arg[0]));
+    if (!errata.is_ok()) {
+      errata.error(R"(Invalid "--h2-settings" value "{}".)", h2_settings_arg[0]);
+      process_exit_code = 1;
+      return;
+    }
+    H2Session::set_default_settings(h2_settings);
+  }
+
+  if (auto quic_settings_arg{arguments.get("quic-settings")}; quic_settings_arg.size() == 1) {
+    QuicSettings quic_settings;
+    errata.note(quic_settings.parse(quic_settings_arg[0]));
+    if (!errata.is_ok()) {
+      errata.error(R"(Invalid "--quic-settings" value "{}".)", quic_settings_arg[0]);
+      process_exit_code = 1;
+      return;
+    }
+    H3Session::set_default_settings(quic_settings);
+  }
+
   auto server_addr_http_arg{arguments.get("connect-http")};
   auto server_addr_https_arg{arguments.get("connect-https")};
   auto server_addr_http3_arg{arguments.get("connect-http3")};
-  if (!server_addr_http_arg && !server_addr_https_arg && !server_addr_http3_arg) {
+  auto server_addr_h2c_arg{arguments.get("connect-h2c")};
+  if (!server_addr_http_arg && !server_addr_https_arg && !server_addr_http3_arg &&
+      !server_addr_h2c_arg)
+  {
     errata.error(
-        R"(Must provide at least one of "--connect-http", "--connect-https", or "--connect-http3" arguments")");
+        R"(Must provide at least one of "--connect-http", "--connect-https", "--connect-http3", or "--connect-h2c" arguments")");
     process_exit_code = 1;
     return;
   }
@@ -662,6 +845,14 @@ Engine::command_run()
     }
   }
 
+  if (server_addr_h2c_arg) {
+    errata.note(resolve_ips(server_addr_h2c_arg[0], Target_Selector.h2c_targets));
+    if (!errata.is_ok()) {
+      process_exit_code = 1;
+      return;
+    }
+  }
+
   auto key_format_arg{arguments.get("format")};
   if (key_format_arg) {
     HttpHeader::_key_format = key_format_arg[0];
@@ -878,6 +1069,7 @@ Engine::command_run()
   unsigned n_txn = 0;
   for (int i = 0; i < repeat_count; i++) {
     auto const this_iteration_start_time = ClockType::now();
+    unsigned session_index = 0;
     for (auto ssn : Session_List) {
       if (ssn->_user_specified_delay_duration > 0us) {
         sleep_for(ssn->_user_specified_delay_duration);
@@ -902,9 +1094,12 @@ Engine::command_run()
         {
           std::unique_lock<std::mutex> lock(thread_info->_mutex);
           thread_info->_ssn = ssn.get();
+          thread_info->_template_context._iteration = i;
+          thread_info->_template_context._session_index = session_index;
           thread_info->_cvar.notify_one();
         }
       }
+      ++session_index;
       ++n_ssn;
       n_txn += ssn->_transactions.size();
     }
@@ -923,9 +1118,13 @@ Engine::command_run()
       replay_duration.count(),
       n_txn / static_cast<double>(replay_duration.count()));
 
+  H2ConnectionPool::terminate();
+  QuicClientSocketPool::terminate();
+  TLSSessionCache::terminate();
   TLSSession::terminate();
   H2Session::terminate();
   H3Session::terminate();
+  LogFileWriter::terminate();
 };
 
 int
@@ -985,6 +1184,15 @@ main(int /* argc */, char const *argv[])
           "",
           1,
           "")
+      .add_option(
+          "--connect-h2c",
+          "",
+          "Address and port to connect on with HTTP/2 over cleartext TCP (h2c) "
+          "for HTTP/2 sessions without a TLS layer. Can be a comma separated "
+          "list.",
+          "",
+          1,
+          "")
       .add_option(
           "--qlog-dir",
           "",
@@ -1017,6 +1225,81 @@ main(int /* argc */, char const *argv[])
           1,
           "")
       .add_option("--thread-limit", "", thread_limit_description.c_str(), "", 1, "")
+      .add_option(
+          "--pipeline-depth",
+          "",
+          "The number of HTTP/1 requests per session to write ahead of their "
+          "responses. The default of 1 disables pipelining.",
+          "",
+          1,
+          "")
+      .add_option(
+          "--h2-stream-limit",
+          "",
+          "The number of streams per HTTP/2 session to keep open at once. "
+          "Further transactions wait for a stream to close. The peer's "
+          "SETTINGS_MAX_CONCURRENT_STREAMS is always honored. The default of 0 "
+          "applies only the peer's limit.",
+          "",
+          1,
+          "")
+      .add_option(
+          "--h2-coalesce",
+          "",
+          "Share HTTP/2 connections among the sessions with the same target "
+          "and SNI, each connection keeping up to this many streams open. "
+          "Another connection is opened once a connection has as many "
+          "sessions as streams. The default of 0 gives each session its own "
+          "connection.",
+          "",
+          1,
+          "")
+      .add_option(
+          "--quic-settings",
+          "",
+          "A comma separated list of QUIC settings for HTTP/3 sessions which "
+          "do not specify their own, such as "
+          "\"initial-max-data=16777216,congestion-control=cubic\". Also "
+          "accepted are initial-max-stream-data, initial-max-streams-bidi, "
+          "initial-max-streams-uni, max-udp-payload-size, and pacing.",
+          "",
+          1,
+          "")
+      .add_option(
+          "--h3-sockets-per-core",
+          "",
+          "Carry the HTTP/3 connections over this many UDP sockets per core, "
+          "routing the received datagrams to their connections by connection "
+          "ID. The default of 0 gives each connection a socket of its own.",
+          "",
+          1,
+          "")
+      .add_option(
+          "--tls-resumption",
+          "",
+          "Cache the TLS sessions issued by the proxy per target and SNI and "
+          "offer them for resumption in this fraction, from 0 to 1, of "
+          "HTTP/1 and HTTP/2 handshakes. The default of 0 performs a full "
+          "handshake for every connection.",
+          "",
+          1,
+          "")
+      .add_option(
+          "--tls-early-data",
+          "",
+          "On connections offering a cached session that allows it, send the "
+          "first request as TLS 1.3 early data. Requires --tls-resumption.")
+      .add_option(
+          "--h2-settings",
+          "",
+          "A comma separated list of HTTP/2 settings for sessions which do not "
+          "specify their own, such as "
+          "\"initial-window-size=1048576,connection-window-size=16777216\". "
+          "Also accepted are max-concurrent-streams, max-frame-size, and "
+          "header-table-size.",
+          "",
+          1,
+          "")
       .add_option(
           "--rate",
           "",
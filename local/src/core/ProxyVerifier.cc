@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <climits>
 #include <csignal>
 #include <dirent.h>
 #include <fcntl.h>
@@ -21,6 +22,7 @@
 #include <sys/time.h>
 #include <thread>
 #include <unistd.h>
+#include <unordered_map>
 
 #include "swoc/bwf_ex.h"
 #include "swoc/bwf_ip.h"
@@ -72,6 +74,7 @@ configure_logging(const std::string_view verbose_argument)
     return errata;
   }
   errata.diag("Configuring logging at level {}", severity_cutoff);
+  Verbose = severity_cutoff == swoc::Severity::DIAG;
 
   static std::mutex logging_mutex;
 
@@ -258,3 +261,153 @@ ThreadPool::set_max_threads(size_t new_max)
 {
   max_threads = new_max;
 }
+
+std::mutex LogFileWriter::_mutex;
+std::condition_variable LogFileWriter::_cvar;
+std::condition_variable LogFileWriter::_space_cvar;
+std::vector<LogFileWriter::Chunk> LogFileWriter::_queue;
+size_t LogFileWriter::_queued_bytes = 0;
+std::thread LogFileWriter::_thread;
+bool LogFileWriter::_terminated = false;
+
+// static
+void
+LogFileWriter::write(int fd, std::string &&data, bool close_fd)
+{
+  Chunk chunk{fd, std::move(data), close_fd};
+  {
+    std::unique_lock lock{_mutex};
+    if (!_terminated) {
+      if (!_thread.joinable()) {
+        _thread = std::thread{LogFileWriter::run};
+      }
+      // Rather than let the queue grow without bound when logging outpaces
+      // the disk, wait for the writer to take what is queued.
+      _space_cvar.wait(lock, []() { return _queued_bytes < MAX_QUEUED_BYTES; });
+    }
+    if (!_terminated) {
+      // The writer only needs waking if it may have found the queue empty.
+      bool const was_empty = _queue.empty();
+      _queued_bytes += chunk._data.size();
+      _queue.push_back(std::move(chunk));
+      if (was_empty) {
+        _cvar.notify_one();
+      }
+      return;
+    }
+  }
+  write_chunk(chunk);
+}
+
+// static
+void
+LogFileWriter::terminate()
+{
+  {
+    std::scoped_lock _{_mutex};
+    _terminated = true;
+  }
+  _cvar.notify_one();
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+}
+
+// static
+void
+LogFileWriter::run()
+{
+  std::vector<Chunk> chunks;
+  // The indices of the chunks of each file not yet written.
+  std::unordered_map<int, std::vector<size_t>> groups;
+  std::vector<iovec> iov;
+  for (;;) {
+    {
+      std::unique_lock lock{_mutex};
+      _cvar.wait(lock, []() { return _terminated || !_queue.empty(); });
+      if (_queue.empty()) {
+        // Terminated, with everything written.
+        return;
+      }
+      // Swapping keeps the storage of both vectors for reuse.
+      chunks.swap(_queue);
+      _queued_bytes = 0;
+    }
+    _space_cvar.notify_all();
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      auto &group = groups[chunks[i]._fd];
+      group.push_back(i);
+      // Once closed, the descriptor may be reused for another file, so what
+      // is queued after this chunk is not gathered with it.
+      if (chunks[i]._close_fd) {
+        write_group(chunks, group, iov);
+      }
+    }
+    for (auto &[fd, group] : groups) {
+      write_group(chunks, group, iov);
+    }
+    groups.clear();
+    chunks.clear();
+  }
+}
+
+// static
+void
+LogFileWriter::write_group(
+    std::vector<Chunk> &chunks,
+    std::vector<size_t> &group,
+    std::vector<iovec> &iov)
+{
+  if (group.empty()) {
+    return;
+  }
+  iov.clear();
+  for (auto const i : group) {
+    auto &data = chunks[i]._data;
+    if (!data.empty()) {
+      iov.push_back({data.data(), data.size()});
+    }
+  }
+  auto const &last = chunks[group.back()];
+  write_all(last._fd, {iov.data(), iov.size()}, last._close_fd);
+  group.clear();
+}
+
+// static
+void
+LogFileWriter::write_chunk(Chunk &chunk)
+{
+  iovec iov{chunk._data.data(), chunk._data.size()};
+  write_all(chunk._fd, {&iov, 1}, chunk._close_fd);
+}
+
+// static
+void
+LogFileWriter::write_all(int fd, swoc::MemSpan<iovec> iov, bool close_fd)
+{
+  while (!iov.empty()) {
+    auto const iov_count = static_cast<int>(std::min<size_t>(iov.count(), IOV_MAX));
+    auto const rc = ::writev(fd, iov.data(), iov_count);
+    if (rc == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      Errata errata;
+      errata.error("Failed to write to log file descriptor {}: {}", fd, swoc::bwf::Errno{});
+      break;
+    }
+    // Skip what was written, which may end part way through a buffer.
+    size_t written = rc;
+    while (!iov.empty() && written >= iov[0].iov_len) {
+      written -= iov[0].iov_len;
+      iov.remove_prefix(1);
+    }
+    if (written > 0) {
+      iov[0].iov_base = static_cast<char *>(iov[0].iov_base) + written;
+      iov[0].iov_len -= written;
+    }
+  }
+  if (close_fd) {
+    ::close(fd);
+  }
+}
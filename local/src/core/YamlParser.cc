@@ -7,6 +7,8 @@
 
 #include "core/YamlParser.h"
 #include "core/ProxyVerifier.h"
+#include "core/http2.h"
+#include "core/http3.h"
 #include "core/verification.h"
 
 #include "core/Localizer.h"
@@ -343,6 +345,32 @@ YamlParser::parse_global_rules(YAML::Node const &node, HttpFields &fields)
   return errata;
 }
 
+/** Check that a rule value containing template tokens compiles.
+ *
+ * Equality rules compare received values against such a value as a request
+ * template, so a malformed template is reported rather than being compared
+ * literally.
+ *
+ * @param[in] value The localized rule value.
+ * @param[in] mark The location of the rule in the replay file.
+ *
+ * @return Any errata from compiling @a value.
+ */
+static Errata
+check_rule_value_template(TextView value, YAML::Mark const &mark)
+{
+  Errata errata;
+  if (!RequestTemplate::has_tokens(value)) {
+    return errata;
+  }
+  auto &&[value_template, compile_errata] = RequestTemplate::compile(value);
+  if (!compile_errata.is_ok()) {
+    errata.note(std::move(compile_errata));
+    errata.error("Rule at {} has a malformed template value.", mark);
+  }
+  return errata;
+}
+
 Errata
 YamlParser::parse_url_rules(
     YAML::Node const &url_rules_node,
@@ -377,6 +405,7 @@ YamlParser::parse_url_rules(
       // URL part verification rules can't support multiple values,
       // so there's no IsSequence() case
       TextView value{Localizer::localize(node[YAML_RULE_VALUE_INDEX].Scalar())};
+      errata.note(check_rule_value_template(value, node.Mark()));
       if (node_size == 2 && assume_equality_rule) {
         fields._url_rules[static_cast<size_t>(part_id)].push_back(
             RuleCheck::make_equality(part_id, value));
@@ -434,6 +463,7 @@ YamlParser::parse_url_rules(
         if (url_value_node.IsScalar()) {
           // Single value
           value = Localizer::localize(url_value_node.Scalar());
+          errata.note(check_rule_value_template(value, node.Mark()));
         } else if (url_value_node.IsSequence()) {
           errata.error("URL rule at {} has multiple values, which is not allowed.", node.Mark());
           continue;
@@ -486,6 +516,7 @@ YamlParser::parse_fields_and_rules(
       // There's only a single value associated with this field name.
       TextView value{Localizer::localize(node[YAML_RULE_VALUE_INDEX].Scalar())};
       fields.add_field(name, value);
+      errata.note(check_rule_value_template(value, node.Mark()));
       if (node_size == 2 && assume_equality_rule) {
         fields._rules.emplace(name, RuleCheck::make_equality(name, value));
       } else if (node_size == 3) {
@@ -574,6 +605,7 @@ YamlParser::parse_fields_and_rules(
           // Single value
           value = Localizer::localize(field_value_node.Scalar());
           fields.add_field(name, value);
+          errata.note(check_rule_value_template(value, node.Mark()));
           tester = RuleCheck::make_rule_check(name, value, rule_type, is_inverted, is_nocase);
         } else if (field_value_node.IsSequence()) {
           // Verification is for duplicate fields:
@@ -834,6 +866,54 @@ ReplayFileHandler::parse_alpn_protocols_node(YAML::Node const &tls_node)
   return alpn_protocol_string;
 }
 
+/** Parse the "settings" map of an "http" node into @a Settings.
+ *
+ * @param[in] http_node The http node from which to parse the settings.
+ * @param[in] protocol The protocol of the settings, for error messages.
+ */
+template <typename Settings>
+static swoc::Rv<Settings>
+parse_settings_map(YAML::Node const &http_node, TextView protocol)
+{
+  swoc::Rv<Settings> settings;
+  auto const settings_node{http_node[YAML_SSN_HTTP_SETTINGS_KEY]};
+  if (!settings_node) {
+    return settings;
+  }
+  if (!settings_node.IsMap()) {
+    settings.error(
+        R"(The "{}" node at {} is not a map as required.)",
+        YAML_SSN_HTTP_SETTINGS_KEY,
+        settings_node.Mark());
+    return settings;
+  }
+  for (auto const &setting : settings_node) {
+    auto const &name = setting.first.Scalar();
+    if (!setting.second.IsScalar()) {
+      settings.error(
+          R"({} setting "{}" at {} is not a scalar as required.)",
+          protocol,
+          name,
+          setting.second.Mark());
+      continue;
+    }
+    settings.note(settings.result().set(name, setting.second.Scalar()));
+  }
+  return settings;
+}
+
+swoc::Rv<H2Settings>
+ReplayFileHandler::parse_h2_settings(YAML::Node const &http_node)
+{
+  return parse_settings_map<H2Settings>(http_node, "HTTP/2");
+}
+
+swoc::Rv<QuicSettings>
+ReplayFileHandler::parse_quic_settings(YAML::Node const &http_node)
+{
+  return parse_settings_map<QuicSettings>(http_node, "QUIC");
+}
+
 /** RAII for managing the handler's file. */
 struct HandlerOpener
 {
@@ -9,12 +9,20 @@
 #include "core/verification.h"
 #include "core/ProxyVerifier.h"
 
+#include <algorithm>
+#include <array>
 #include <arpa/inet.h>
 #include <cassert>
+#include <climits>
+#include <deque>
 #include <fcntl.h>
 #include <ifaddrs.h>
+#include <limits>
 #include <netinet/tcp.h>
+#include <random>
+#include <sys/mman.h>
 #include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -42,7 +50,24 @@ constexpr int MAX_NOFILE = 300000;
 
 std::string HttpHeader::_key_format{"{field.uuid}"};
 swoc::MemSpan<char> HttpHeader::_content;
+int HttpHeader::_content_fd = -1;
+size_t HttpHeader::_content_region_size = 0;
 std::bitset<600> HttpHeader::STATUS_NO_CONTENT;
+std::atomic<uint64_t> RequestTemplate::_next_unique{0};
+
+/// Delimiters of a template token, such as "{{iteration}}".
+static constexpr TextView TEMPLATE_TOKEN_OPEN{"{{"};
+static constexpr TextView TEMPLATE_TOKEN_CLOSE{"}}"};
+
+/// The size of the per-thread buffer into which discarded content is read.
+static constexpr size_t DISCARD_BUFFER_SIZE = 64 * 1024;
+
+static const swoc::Lexicon<RequestTemplate::Token> TEMPLATE_TOKEN_NAMES{
+    {{RequestTemplate::Token::ITERATION, {"iteration"}},
+     {RequestTemplate::Token::SESSION, {"session"}},
+     {RequestTemplate::Token::RANDOM, {"random"}},
+     {RequestTemplate::Token::UNIQUE, {"unique"}}},
+    {RequestTemplate::Token::INVALID}};
 
 memoized_ip_endpoints_t InterfaceNameToEndpoint::memoized_ip_endpoints;
 
@@ -99,17 +124,84 @@ Ssn::post_process_transactions()
   return errata;
 }
 
+/** Map the first @a region bytes of @a fd repeatedly across @a size bytes of
+ * contiguous address space.
+ *
+ * Every copy shares the same physical pages, so the resident cost is that of
+ * @a region no matter how large @a size is.
+ *
+ * @return The start of the mapping, or nullptr on failure.
+ */
+static char *
+map_mirrored_region(int fd, size_t region, size_t size)
+{
+  size = ((size + region - 1) / region) * region;
+  void *const reserved =
+      ::mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (reserved == MAP_FAILED) {
+    return nullptr;
+  }
+  char *const base = static_cast<char *>(reserved);
+  for (size_t offset = 0; offset < size; offset += region) {
+    // The first copy is writable so that the pattern can be filled through it.
+    int const prot = offset == 0 ? PROT_READ | PROT_WRITE : PROT_READ;
+    if (::mmap(base + offset, region, prot, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+      ::munmap(base, size);
+      return nullptr;
+    }
+  }
+  return base;
+}
+
 void
 HttpHeader::set_max_content_length(size_t n)
 {
   n = swoc::round_up<16>(n);
-  _content.assign(static_cast<char *>(malloc(n)), n);
-  for (size_t k = 0; k < n; k += 8) {
+  // Content up to CONTENT_PATTERN_PERIOD is mapped once. Beyond that, a
+  // region of whole pattern periods is mirrored, so that the stamps continue
+  // across copies, sized so that no more than MAX_CONTENT_REGION_COPIES
+  // mappings are needed.
+  size_t region = n;
+  if (n > CONTENT_PATTERN_PERIOD) {
+    size_t const periods = n / CONTENT_PATTERN_PERIOD / MAX_CONTENT_REGION_COPIES + 1;
+    region = periods * CONTENT_PATTERN_PERIOD;
+  }
+  char *content = nullptr;
+  // Back the content with a memfd so that plaintext bodies can be sent from
+  // it with sendfile rather than copied through user space on each send.
+  int const fd = ::memfd_create("proxy-verifier-content", MFD_CLOEXEC);
+  if (fd >= 0 && n > 0 && ::ftruncate(fd, region) == 0) {
+    content = map_mirrored_region(fd, region, n);
+  }
+  if (content != nullptr) {
+    _content_fd = fd;
+    _content_region_size = region;
+  } else {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    content = static_cast<char *>(malloc(n));
+    region = n;
+  }
+  _content.assign(content, n);
+  for (size_t k = 0; k < region; k += 8) {
     swoc::FixedBufferWriter w{_content.data() + k, 8};
-    w.print("{:07x} ", k / 8);
+    w.print("{:07x} ", (k % CONTENT_PATTERN_PERIOD) / 8);
   };
 }
 
+// static
+off_t
+HttpHeader::content_file_offset(TextView content)
+{
+  if (_content_fd < 0 || content.data() < _content.data() ||
+      content.data_end() > _content.data() + _content.size())
+  {
+    return -1;
+  }
+  return content.data() - _content.data();
+}
+
 swoc::Errata
 HttpHeader::update_content_length(swoc::TextView method)
 {
@@ -147,26 +239,307 @@ HttpHeader::update_transfer_encoding()
 }
 
 swoc::Errata
-HttpHeader::serialize(swoc::BufferWriter &w) const
+HttpHeader::serialize(swoc::BufferWriter &w, TemplateContext const &context) const
 {
   swoc::Errata errata;
+  // Draw the values once so that the URL and the fields render alike.
+  auto const values =
+      _templates ? RequestTemplate::make_values(context) : RequestTemplate::Values{};
 
   if (is_response()) {
     w.print("HTTP/{} {} {}{}", _http_version, _status, _reason, HTTP_EOL);
   } else if (is_request()) {
-    w.print("{} {} HTTP/{}{}", _method, _url, _http_version, HTTP_EOL);
+    w.print("{} ", _method);
+    if (_templates && _templates->_url) {
+      _templates->_url->render(w, values);
+    } else {
+      w.write(_url);
+    }
+    w.print(" HTTP/{}{}", _http_version, HTTP_EOL);
   } else {
     errata.error(R"(Unable to write header: could not determine request/response state.)");
   }
 
-  for (auto const &[name, value] : _fields_rules->_fields_sequence) {
-    w.write(name).write(": ").write(value).write(HTTP_EOL);
+  auto const &fields = _fields_rules->_fields_sequence;
+  for (size_t index = 0; index < fields.size(); ++index) {
+    auto const &[name, value] = fields[index];
+    w.write(name).write(": ");
+    if (_templates) {
+      if (auto spot{_templates->_fields.find(index)}; spot != _templates->_fields.end()) {
+        spot->second.render(w, values);
+        w.write(HTTP_EOL);
+        continue;
+      }
+    }
+    w.write(value).write(HTTP_EOL);
   }
   w.write(HTTP_EOL);
 
   return errata;
 }
 
+swoc::Errata
+HttpHeader::compile_templates()
+{
+  swoc::Errata errata;
+  auto templates = std::make_unique<Templates>();
+  bool found_tokens = false;
+  auto compile_into = [&](TextView text, std::optional<RequestTemplate> &destination) {
+    if (!RequestTemplate::has_tokens(text)) {
+      return;
+    }
+    auto &&[compiled, compile_errata] = RequestTemplate::compile(text);
+    errata.note(std::move(compile_errata));
+    destination = std::move(compiled);
+    found_tokens = true;
+  };
+  compile_into(_url, templates->_url);
+  compile_into(_authority, templates->_authority);
+  compile_into(_path, templates->_path);
+
+  auto const &fields = _fields_rules->_fields_sequence;
+  for (size_t index = 0; index < fields.size(); ++index) {
+    if (!RequestTemplate::has_tokens(fields[index].value)) {
+      continue;
+    }
+    auto &&[compiled, compile_errata] = RequestTemplate::compile(fields[index].value);
+    errata.note(std::move(compile_errata));
+    templates->_fields.emplace(index, std::move(compiled));
+    found_tokens = true;
+  }
+
+  if (found_tokens) {
+    _templates = std::move(templates);
+  }
+  return errata;
+}
+
+bool
+HttpHeader::has_templates() const
+{
+  return _templates != nullptr;
+}
+
+/** Update the values of an nghttp2 or nghttp3 header array with the rendered
+ * values of the message's templates.
+ *
+ * The pseudo headers lead the array and the remaining fields follow in
+ * _fields_sequence order, as populated by HttpFields::add_fields_to_ngnva.
+ */
+template <typename NV>
+static void
+render_nv_templates(
+    HttpHeader const &hdr,
+    NV *nva,
+    int nva_count,
+    swoc::MemArena &arena,
+    TemplateContext const &context)
+{
+  auto const &templates = *hdr._templates;
+  auto const values = RequestTemplate::make_values(context);
+  auto set_value = [](NV &nv, TextView value) {
+    nv.value = const_cast<uint8_t *>(reinterpret_cast<uint8_t const *>(value.data()));
+    nv.valuelen = value.size();
+  };
+  int offset = 0;
+  for (; offset < nva_count && nva[offset].namelen > 0 && nva[offset].name[0] == ':'; ++offset) {
+    TextView const name{reinterpret_cast<char const *>(nva[offset].name), nva[offset].namelen};
+    if (name == ":path" && templates._path) {
+      set_value(nva[offset], templates._path->render(arena, values));
+    } else if (name == ":authority" && templates._authority) {
+      set_value(nva[offset], templates._authority->render(arena, values));
+    }
+  }
+  auto const &fields = hdr._fields_rules->_fields_sequence;
+  for (size_t index = 0; index < fields.size() && offset < nva_count; ++index) {
+    if (fields[index].name.starts_with(":")) {
+      continue;
+    }
+    if (auto spot{templates._fields.find(index)}; spot != templates._fields.end()) {
+      set_value(nva[offset], spot->second.render(arena, values));
+    }
+    ++offset;
+  }
+}
+
+void
+HttpHeader::render_templates(
+    nghttp2_nv *nva,
+    int nva_count,
+    swoc::MemArena &arena,
+    TemplateContext const &context) const
+{
+  if (_templates) {
+    render_nv_templates(*this, nva, nva_count, arena, context);
+  }
+}
+
+void
+HttpHeader::render_templates(
+    nghttp3_nv *nva,
+    int nva_count,
+    swoc::MemArena &arena,
+    TemplateContext const &context) const
+{
+  if (_templates) {
+    render_nv_templates(*this, nva, nva_count, arena, context);
+  }
+}
+
+// static
+bool
+RequestTemplate::has_tokens(TextView text)
+{
+  return text.find(TEMPLATE_TOKEN_OPEN) != TextView::npos;
+}
+
+// static
+swoc::Rv<RequestTemplate>
+RequestTemplate::compile(TextView text)
+{
+  swoc::Rv<RequestTemplate> zret;
+  auto &segments = zret.result()._segments;
+  TextView const original{text};
+  while (!text.empty()) {
+    auto const open = text.find(TEMPLATE_TOKEN_OPEN);
+    if (open == TextView::npos) {
+      segments.push_back({Token::LITERAL, text});
+      break;
+    }
+    if (open > 0) {
+      segments.push_back({Token::LITERAL, text.prefix(open)});
+    }
+    text.remove_prefix(open + TEMPLATE_TOKEN_OPEN.size());
+    auto const close = text.find(TEMPLATE_TOKEN_CLOSE);
+    if (close == TextView::npos) {
+      zret.error(R"(Unterminated template token in "{}".)", original);
+      return zret;
+    }
+    TextView name{text.prefix(close)};
+    name.trim_if(&isspace);
+    auto const token = TEMPLATE_TOKEN_NAMES[name];
+    if (token == Token::INVALID) {
+      zret.error(R"(Unknown template token "{}" in "{}".)", name, original);
+      return zret;
+    }
+    segments.push_back({token, {}});
+    text.remove_prefix(close + TEMPLATE_TOKEN_CLOSE.size());
+  }
+  return zret;
+}
+
+// static
+RequestTemplate::Values
+RequestTemplate::make_values(TemplateContext const &context)
+{
+  thread_local std::mt19937_64 rng{std::random_device{}()};
+  Values values;
+  values._iteration = context._iteration;
+  values._session_index = context._session_index;
+  values._random = rng();
+  values._unique = _next_unique++;
+  return values;
+}
+
+TextView
+RequestTemplate::render(swoc::MemArena &arena, Values const &values) const
+{
+  // Render once to size the allocation and again to fill it.
+  swoc::FixedBufferWriter sizer{nullptr};
+  render(sizer, values);
+  auto span{arena.alloc(sizer.extent()).rebind<char>()};
+  swoc::FixedBufferWriter w{span.data(), span.size()};
+  render(w, values);
+  return {span.data(), span.size()};
+}
+
+void
+RequestTemplate::render(swoc::BufferWriter &w, Values const &values) const
+{
+  for (auto const &segment : _segments) {
+    switch (segment._token) {
+    case Token::LITERAL:
+      w.write(segment._literal);
+      break;
+    case Token::ITERATION:
+      w.print("{}", values._iteration);
+      break;
+    case Token::SESSION:
+      w.print("{}", values._session_index);
+      break;
+    case Token::RANDOM:
+      w.print("{:016x}", values._random);
+      break;
+    case Token::UNIQUE:
+      w.print("{}", values._unique);
+      break;
+    case Token::INVALID:
+      break;
+    }
+  }
+}
+
+size_t
+RequestTemplate::literal_prefix_size() const
+{
+  if (_segments.empty() || _segments.front()._token != Token::LITERAL) {
+    return 0;
+  }
+  return _segments.front()._literal.size();
+}
+
+bool
+RequestTemplate::matches(TextView text, bool is_nocase) const
+{
+  return matches(0, text, is_nocase);
+}
+
+bool
+RequestTemplate::matches(size_t segment_index, TextView text, bool is_nocase) const
+{
+  if (segment_index == _segments.size()) {
+    return text.empty();
+  }
+  auto const &segment = _segments[segment_index];
+  switch (segment._token) {
+  case Token::LITERAL: {
+    bool const literal_matches = is_nocase ? text.starts_with_nocase(segment._literal)
+                                           : text.starts_with(segment._literal);
+    return literal_matches &&
+           matches(segment_index + 1, text.substr(segment._literal.size()), is_nocase);
+  }
+  case Token::RANDOM: {
+    if (text.size() < RANDOM_WIDTH) {
+      return false;
+    }
+    TextView const digits{text.prefix(RANDOM_WIDTH)};
+    if (!std::all_of(digits.begin(), digits.end(), [](char c) { return isxdigit(c); })) {
+      return false;
+    }
+    return matches(segment_index + 1, text.substr(RANDOM_WIDTH), is_nocase);
+  }
+  case Token::ITERATION:
+  case Token::SESSION:
+  case Token::UNIQUE: {
+    // Numeric tokens render one or more digits. The following segment may
+    // itself begin with digits, so back off from the longest run.
+    size_t num_digits = 0;
+    while (num_digits < text.size() && isdigit(text[num_digits])) {
+      ++num_digits;
+    }
+    for (; num_digits > 0; --num_digits) {
+      if (matches(segment_index + 1, text.substr(num_digits), is_nocase)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  case Token::INVALID:
+    break;
+  }
+  return false;
+}
+
 HttpFields::HttpFields()
 {
   _fields_sequence.reserve(num_fields_to_reserve);
@@ -193,6 +566,20 @@ HttpFields::merge(HttpFields const &other)
   }
 }
 
+void
+HttpFields::clear()
+{
+  _rules.clear();
+  _fields.clear();
+  _fields_sequence.clear();
+  for (auto &rules : _url_rules) {
+    rules.clear();
+  }
+  for (auto &part : _url_parts) {
+    part.clear();
+  }
+}
+
 void
 HttpFields::add_fields_to_ngnva(nghttp2_nv *l) const
 {
@@ -455,6 +842,45 @@ HttpHeader::HttpHeader(bool verify_strictly)
 {
 }
 
+void
+HttpHeader::clear()
+{
+  _contains_pseudo_headers_in_fields_array = false;
+  _stream_id = -1;
+  _status = 0;
+  _status_string.clear();
+  _reason.clear();
+  _content_data = nullptr;
+  _content_size = 0;
+  _recorded_content_size = 0;
+  _method.clear();
+  _http_version.clear();
+  _url.clear();
+  _send_continue = false;
+  _scheme.clear();
+  _authority.clear();
+  _path.clear();
+  uri_scheme.clear();
+  uri_host.clear();
+  uri_port.clear();
+  uri_authority.clear();
+  uri_path.clear();
+  uri_query.clear();
+  uri_fragment.clear();
+  if (_fields_rules.use_count() == 1) {
+    _fields_rules->clear();
+  } else {
+    _fields_rules = std::make_shared<HttpFields>();
+  }
+  _chunked_p = false;
+  _has_transfer_encoding_chunked = false;
+  _content_length_p = false;
+  _templates.reset();
+  _key = TRANSACTION_KEY_NOT_SET;
+  _http_protocol = HTTP_PROTOCOL_TYPE::HTTP_1;
+  _is_request = false;
+}
+
 HTTP_PROTOCOL_TYPE
 HttpHeader::get_http_protocol() const
 {
@@ -683,10 +1109,89 @@ Session::~Session()
   this->close();
 }
 
+void
+ReceiveBuffer::start_message()
+{
+  if (_begin > 0) {
+    memmove(_data.get(), _data.get() + _begin, _end - _begin);
+    _end -= _begin;
+    _begin = 0;
+  }
+  _held = 0;
+}
+
+TextView
+ReceiveBuffer::view() const
+{
+  return {_data.get() + _begin, _end - _begin};
+}
+
+swoc::MemSpan<char>
+ReceiveBuffer::aux_span()
+{
+  if (!_data) {
+    _data.reset(new char[MAX_HDR_SIZE]);
+  }
+  if (_begin == _end) {
+    // Everything received has been consumed: start over after the held bytes.
+    _begin = _end = _held;
+  } else if (_end == MAX_HDR_SIZE && _begin > _held) {
+    memmove(_data.get() + _held, _data.get() + _begin, _end - _begin);
+    _end -= _begin - _held;
+    _begin = _held;
+  }
+  return {_data.get() + _end, MAX_HDR_SIZE - _end};
+}
+
+void
+ReceiveBuffer::commit(size_t n)
+{
+  _end += n;
+}
+
+void
+ReceiveBuffer::consume(size_t n)
+{
+  _begin += n;
+}
+
+void
+ReceiveBuffer::hold()
+{
+  _held = _begin;
+}
+
+void
+ReceiveBuffer::clear()
+{
+  _held = _begin = _end = 0;
+}
+
 swoc::Rv<ssize_t>
 Session::read(swoc::MemSpan<char> span)
 {
-  swoc::Rv<ssize_t> zret{::read(_fd, span.data(), span.size())};
+  return receive(span.data(), span.size(), 0);
+}
+
+swoc::Rv<ssize_t>
+Session::discard(size_t n)
+{
+  return receive(nullptr, n, MSG_TRUNC);
+}
+
+// static
+swoc::MemSpan<char>
+Session::discard_buffer()
+{
+  static thread_local char buffer[DISCARD_BUFFER_SIZE];
+  return {buffer, sizeof(buffer)};
+}
+
+swoc::Rv<ssize_t>
+Session::receive(void *buffer, size_t size, int flags)
+{
+  swoc::Rv<ssize_t> zret{
+      flags == 0 ? ::read(_fd, buffer, size) : ::recv(_fd, buffer, size, flags)};
   if (zret == 0) {
     // End of file.
     this->close();
@@ -700,7 +1205,7 @@ Session::read(swoc::MemSpan<char> span)
         this->close();
       } else if (poll_return > 0) {
         // Simply repeat the read now that poll says something is ready.
-        return read(span);
+        return receive(buffer, size, flags);
       } else if (poll_return == 0) {
         zret.error("Poll timed out waiting for content.");
         this->close();
@@ -721,24 +1226,22 @@ Session::read(swoc::MemSpan<char> span)
 }
 
 swoc::Rv<std::shared_ptr<HttpHeader>>
-Session::read_and_parse_request(swoc::FixedBufferWriter &buffer)
+Session::read_and_parse_request()
 {
   swoc::Rv<std::shared_ptr<HttpHeader>> zret{nullptr};
-  auto &&[header_bytes_read, read_header_errata] = read_headers(buffer);
+  auto &&[received_data, read_header_errata] = read_headers();
   zret.note(read_header_errata);
   if (!read_header_errata.is_ok()) {
     zret.error("Could not read the header.");
     return zret;
   }
 
-  _body_offset = header_bytes_read;
-  if (_body_offset == 0) {
+  if (received_data.empty()) {
     return zret;
   }
 
   zret = std::make_shared<HttpHeader>();
   auto &hdr = zret.result();
-  auto received_data = TextView(buffer.data(), _body_offset);
   auto &&[parse_result, parse_errata] = hdr->parse_request(received_data);
   zret.note(parse_errata);
 
@@ -753,24 +1256,38 @@ Session::read_and_parse_request(swoc::FixedBufferWriter &buffer)
 
 swoc::Rv<ssize_t>
 Session::write(TextView view)
+{
+  iovec iov{const_cast<char *>(view.data()), view.size()};
+  return Session::writev({&iov, 1});
+}
+
+/** Call @a write_some until @a size bytes are written.
+ *
+ * @a write_some is passed the number of bytes written so far and returns the
+ * result of a single non-blocking write system call. The socket is polled for
+ * writability whenever the call would block.
+ *
+ * @return The number of bytes written and an errata with any messaging.
+ */
+template <typename F>
+static swoc::Rv<ssize_t>
+write_until_done(Session &session, size_t size, F &&write_some)
 {
   swoc::Rv<ssize_t> zret{0};
-  TextView remaining = view;
-  while (!remaining.empty()) {
-    if (this->is_closed()) {
+  while (static_cast<size_t>(zret.result()) < size) {
+    if (session.is_closed()) {
       zret.diag("write failed: session is closed");
       break;
     }
-    auto const n = ::write(_fd, remaining.data(), remaining.size());
+    auto const n = write_some(static_cast<size_t>(zret.result()));
     if (n > 0) {
-      remaining = remaining.suffix(remaining.size() - n);
       zret.result() += n;
     } else if (n == 0) {
       zret.error("Write failed to write any bytes to the socket.");
       break;
     } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
       // Poll on the socket for writeability.
-      auto &&[poll_return, poll_errata] = poll_for_data_on_socket(Poll_Timeout, POLLOUT);
+      auto &&[poll_return, poll_errata] = session.poll_for_writable(Poll_Timeout);
       zret.note(std::move(poll_errata));
       if (poll_return > 0) {
         // The socket is available again for writing. Simply repeat the write.
@@ -793,30 +1310,92 @@ Session::write(TextView view)
   return zret;
 }
 
+swoc::Rv<ssize_t>
+Session::writev(swoc::MemSpan<iovec> iov)
+{
+  size_t size = 0;
+  for (auto const &buffer : iov) {
+    size += buffer.iov_len;
+  }
+  return write_until_done(*this, size, [&](size_t) -> ssize_t {
+    while (!iov.empty() && iov[0].iov_len == 0) {
+      iov.remove_prefix(1);
+    }
+    auto const iov_count = static_cast<int>(std::min<size_t>(iov.count(), IOV_MAX));
+    auto const n = ::writev(_fd, iov.data(), iov_count);
+    // Advance past the written content, which may end partway through a
+    // buffer.
+    size_t consumed = std::max<ssize_t>(n, 0);
+    while (consumed > 0 && consumed >= iov[0].iov_len) {
+      consumed -= iov[0].iov_len;
+      iov.remove_prefix(1);
+    }
+    if (consumed > 0) {
+      iov[0].iov_base = static_cast<char *>(iov[0].iov_base) + consumed;
+      iov[0].iov_len -= consumed;
+    }
+    return n;
+  });
+}
+
+void
+Session::record_transaction_latency(chrono::microseconds /* elapsed */)
+{
+}
+
+bool
+Session::can_send_content_file() const
+{
+  return HttpHeader::_content_fd >= 0;
+}
+
+swoc::Rv<ssize_t>
+Session::send_content_file(TextView header, off_t offset, size_t size)
+{
+  swoc::Rv<ssize_t> zret{0};
+  if (!header.empty()) {
+    // MSG_MORE lets the header share a segment with the start of the body.
+    auto &&[n, header_errata] = write_until_done(*this, header.size(), [&](size_t written) {
+      return ::send(_fd, header.data() + written, header.size() - written, MSG_MORE);
+    });
+    zret.note(std::move(header_errata));
+    zret.result() += n;
+    if (n != static_cast<ssize_t>(header.size())) {
+      return zret;
+    }
+  }
+  auto const region = HttpHeader::_content_region_size;
+  auto &&[n, body_errata] = write_until_done(*this, size, [&](size_t written) {
+    // The content file holds a single copy of the mirrored region, so each
+    // send stops at the end of the region and wraps to its start.
+    off_t file_offset = (offset + written) % region;
+    auto const count = std::min(size - written, region - file_offset);
+    return ::sendfile(_fd, HttpHeader::_content_fd, &file_offset, count);
+  });
+  zret.note(std::move(body_errata));
+  zret.result() += n;
+  return zret;
+}
+
 swoc::Rv<ssize_t>
 Session::write(HttpHeader const &hdr)
 {
-  // 1. header.serialize, write it out
-  // 2. transmit the body
+  // Serialize the header, then send it along with the body.
   swoc::LocalBufferWriter<MAX_HDR_SIZE> w;
   swoc::Rv<ssize_t> zret{-1};
 
-  zret.errata() = hdr.serialize(w);
+  zret.errata() = hdr.serialize(w, _template_context);
 
   if (!zret.is_ok()) {
     zret.error("Header serialization failed for key: {}", hdr.get_key());
     return zret;
   }
 
-  auto &&[header_bytes_written, header_write_errata] = write(w.view());
-  zret.note(std::move(header_write_errata));
+  auto &&[bytes_written, write_errata] = write_message(hdr, w.view());
+  zret.note(std::move(write_errata));
+  zret.result() = bytes_written;
 
-  if (header_bytes_written == static_cast<ssize_t>(w.size())) {
-    zret.result() = header_bytes_written;
-    auto &&[body_bytes_written, body_write_errata] = write_body(hdr);
-    zret.note(std::move(body_write_errata));
-    zret.result() += body_bytes_written;
-  } else {
+  if (bytes_written < static_cast<ssize_t>(w.size())) {
     zret.error(
         R"(Header write for key {} failed with {} of {} bytes written: {}.)",
         hdr.get_key(),
@@ -827,6 +1406,12 @@ Session::write(HttpHeader const &hdr)
   return zret;
 }
 
+swoc::Rv<ssize_t>
+Session::write_response(HttpHeader const &hdr, int64_t /* stream_id */)
+{
+  return write(hdr);
+}
+
 swoc::Rv<int>
 Session::poll_for_data_on_socket(chrono::milliseconds timeout, short events)
 {
@@ -837,47 +1422,83 @@ Session::poll_for_data_on_socket(chrono::milliseconds timeout, short events)
   return ::poll(&pfd, 1, timeout.count());
 }
 
+swoc::Rv<int>
+Session::poll_for_writable(chrono::milliseconds timeout)
+{
+  while (_receive_while_writing) {
+    if (is_closed()) {
+      return {-1, Errata().diag("Poll called on a closed connection.")};
+    }
+    struct pollfd pfd = {.fd = _fd, .events = POLLIN | POLLOUT, .revents = 0};
+    int const poll_return = ::poll(&pfd, 1, timeout.count());
+    if (poll_return <= 0 || (pfd.revents & POLLOUT) || !(pfd.revents & POLLIN)) {
+      return poll_return;
+    }
+    // The peer is sending while we cannot: take in a response so that it
+    // can go on to read what we are writing.
+    if (!_receive_while_writing()) {
+      break;
+    }
+  }
+  return poll_for_data_on_socket(timeout, POLLOUT);
+}
+
 swoc::Rv<int>
 Session::poll_for_headers(chrono::milliseconds timeout)
 {
+  if (!_recv_buffer.view().empty()) {
+    // The start of the next message was received with the previous one.
+    return 1;
+  }
   return poll_for_data_on_socket(timeout);
 }
 
-swoc::Rv<ssize_t>
-Session::read_headers(swoc::FixedBufferWriter &w)
-{
-  swoc::Rv<ssize_t> zret{-1};
-  while (w.remaining() > 0) {
-    auto n = read(w.aux_span());
+swoc::Rv<TextView>
+Session::read_headers()
+{
+  swoc::Rv<TextView> zret;
+  _recv_buffer.start_message();
+  // The number of received bytes already searched for the EOH string.
+  size_t searched = 0;
+  while (true) {
+    auto const received = _recv_buffer.view();
+    // Where to start searching for the EOH string.
+    size_t start = std::max<size_t>(searched, HTTP_EOH.size()) - HTTP_EOH.size();
+    size_t offset = received.substr(start).find(HTTP_EOH);
+    if (TextView::npos != offset) {
+      zret = received.prefix(start + offset + HTTP_EOH.size());
+      _recv_buffer.consume(zret.result().size());
+      // The parsed header will refer to these bytes.
+      _recv_buffer.hold();
+      break;
+    }
+    searched = received.size();
+    auto const span = _recv_buffer.aux_span();
+    if (span.empty()) {
+      zret.error(R"(Header exceeded maximum size {}.)", MAX_HDR_SIZE);
+      break;
+    }
+    auto n = read(span);
     if (!is_closed()) {
-      // Where to start searching for the EOH string.
-      size_t start = std::max<size_t>(w.size(), HTTP_EOH.size()) - HTTP_EOH.size();
-      w.commit(n);
-      size_t offset = w.view().substr(start).find(HTTP_EOH);
-      if (TextView::npos != offset) {
-        zret = start + offset + HTTP_EOH.size();
-        break;
+      if (n > 0) {
+        _recv_buffer.commit(n);
       }
     } else {
-      if (w.size()) {
+      if (received.size()) {
         zret.error(
             R"(Connection closed unexpectedly after {} bytes while waiting for header: {}.)",
-            w.size(),
+            received.size(),
             swoc::bwf::Errno{});
-      } else {
-        zret = 0; // clean close between transactions.
       }
+      // Otherwise this is a clean close between transactions.
       break;
     }
   }
-  if (zret.is_ok() && zret == -1) {
-    zret.error(R"(Header exceeded maximum size {}.)", w.capacity());
-  }
   return zret;
 }
 
 swoc::Rv<size_t>
-Session::drain_body_internal(HttpHeader &rsp_hdr_from_wire, Txn const &json_txn, TextView initial)
+Session::drain_body_internal(HttpHeader &rsp_hdr_from_wire, Txn const &json_txn)
 {
   // The number of body bytes strictly considered. This does not include
   // any chunk headers, if present.
@@ -891,55 +1512,17 @@ Session::drain_body_internal(HttpHeader &rsp_hdr_from_wire, Txn const &json_txn,
     expected_content_size = rsp_hdr_from_wire._content_size;
   }
   auto &&[bytes_drained, drain_errata] =
-      this->drain_body(rsp_hdr_from_wire, expected_content_size, initial);
+      this->drain_body(rsp_hdr_from_wire, expected_content_size);
   num_drained_body_bytes = bytes_drained;
   num_drained_body_bytes.note(std::move(drain_errata));
   return num_drained_body_bytes;
 }
 
 swoc::Rv<size_t>
-Session::drain_body(HttpHeader const &hdr, size_t expected_content_size, TextView bytes_read)
-{
-  // The number of content body bytes drained. initial contains the body bytes
-  // already drained, so we initialize it to that size.
-  TextView initial{bytes_read.substr(_body_offset)};
-  swoc::Rv<size_t> num_drained_body_bytes = initial.size();
-  // Check whether we got all the content already. Note that the expected size,
-  // which is the expected body size, should not equal the received size if it
-  // is chunked because chunked content will include extra chunk header
-  // content. Thus if the expected and received sizes are equal and the body is
-  // chunked, then the equality of size is a coincidence and a few more bytes
-  // are needed.
-  if (expected_content_size == num_drained_body_bytes && !hdr._chunked_p) {
-    num_drained_body_bytes.diag(
-        "Drained with headers body of {} bytes with content: {}",
-        num_drained_body_bytes.result(),
-        initial);
-    return num_drained_body_bytes;
-  }
-  if (expected_content_size < initial.size()) {
-    if (hdr._chunked_p) {
-      // See the comment below for why chunked responses are special. Since we
-      // don't know how much content will come in, arbitrarily initialize our
-      // expectations to twice what we've received already for the body.
-      expected_content_size = initial.size() * 2;
-    } else {
-      // We do not emit this error for chunked responses as a concession. If
-      // the response has a Content-Length header, we already adjusted the
-      // expected size of the body based upon the value of that header in the
-      // response (see the calling function). If the response is chunked, there
-      // is no such advertised value in the response headers to use. In this
-      // case, expected_content_size is the content:size value in the dump. But
-      // the proxy may use a slightly different body with a different size. For
-      // this reason, we do not fail the transaction based upon such chunked
-      // responses having a larger than recorded body size.
-      num_drained_body_bytes.error(
-          R"(Body overrun: received {} bytes of content, expected {}.)",
-          initial.size(),
-          expected_content_size);
-      return num_drained_body_bytes;
-    }
-  }
+Session::drain_body(HttpHeader const &hdr, size_t expected_content_size)
+{
+  // The number of content body bytes drained.
+  swoc::Rv<size_t> num_drained_body_bytes = 0;
 
   // If there's a status, and it indicates no body, we're done. This is true
   // regardless of the presence of a non-zero Content-Length header. Consider
@@ -949,87 +1532,48 @@ Session::drain_body(HttpHeader const &hdr, size_t expected_content_size, TextVie
     return num_drained_body_bytes;
   }
 
-  // Read the above conditionals: they should guaranteed that
-  // expected_content_size > initial.size()
-  assert(expected_content_size > num_drained_body_bytes);
-  auto buff_storage_size = expected_content_size;
-  if (expected_content_size > MAX_DRAIN_BUFFER_SIZE) {
-    num_drained_body_bytes.diag(
-        "Truncating the number of body bytes to store from {} to {}.",
-        expected_content_size,
-        MAX_DRAIN_BUFFER_SIZE);
-    buff_storage_size = MAX_DRAIN_BUFFER_SIZE;
-  }
-  if (hdr._chunked_p) {
-    // Allow a bit of extra room on top of the body size for chunk headers and trailers.
-    buff_storage_size += 50;
-  }
-  std::string body{initial};
-  body.reserve(buff_storage_size);
-
-  if (is_closed()) {
-    num_drained_body_bytes.error(
-        R"(Stream closed before finishing reading the body. Read {} bytes of {} expected bytes)",
-        num_drained_body_bytes.result(),
-        expected_content_size);
-    return num_drained_body_bytes;
-  }
+  // The body is only stored so that it can be logged at diag level. Body
+  // content is not otherwise verified, so otherwise it is just counted.
+  std::string body;
+  auto const store = [&body](TextView content) {
+    if (Verbose && body.size() < MAX_DRAIN_BUFFER_SIZE) {
+      body.append(content.prefix(MAX_DRAIN_BUFFER_SIZE - body.size()));
+    }
+  };
 
   if (hdr._chunked_p) {
     ChunkCodex::ChunkCallback cb{
-        // TODO: Note that @a block is the set of body bytes in this chunk and
-        // does not include chunk header content. It would be more accurate to
-        // make @a body populated from @a block, and if we add body validation
-        // we'll need to consider that. However we're using @a body as our read
-        // buffer (thus it includes the entire body stream, including chunk
-        // headers), and it would be expensive to have two buffers holding
-        // copies of this same memory.
         [&num_drained_body_bytes](TextView block, size_t /* offset */, size_t /* size */) -> bool {
           num_drained_body_bytes.result() += block.size();
           return true;
         }};
     ChunkCodex codex;
-
-    // num_drained_body_bytes was initialized to initial.size(), which was
-    // sufficient and handy in the above code. However, for chunked content it
-    // is slightly inaccurate because it includes chunk headers and EOL
-    // trailers.  We reset it to zero here and count the body bytes accurately
-    // via the chunk parsing callback.
-    num_drained_body_bytes = 0;
-    auto result = codex.parse(initial, cb);
-    while (result == ChunkCodex::CONTINUE) {
-      if (buff_storage_size <= body.size()) {
-        // We've filled up our buffer. Try to expand it.
-        if (buff_storage_size == MAX_DRAIN_BUFFER_SIZE) {
-          // We do not want to expand it passed the MAX_DRAIN_BUFFER_SIZE. But
-          // we have to read the rest of the body bytes from the socket. To do
-          // this, we just start our buffer over from the beginning. We
-          // currently don't validate body bytes anyway and just print the
-          // buffer for debug purposes, so nothing critical depends upon an
-          // accurate body content. We did the best we could. The
-          // num_drained_body_bytes value will, however, be accurate.
-          body.resize(0);
-          num_drained_body_bytes.diag(
-              "Drained {} bytes of a chunked body. "
-              "Resetting storage since we hit capacity limit: {}.",
-              num_drained_body_bytes.result(),
-              buff_storage_size);
-        } else {
-          // Since it is chunked, there's no way for us to know how much is
-          // coming in. We continue by using the doubling heuristic we
-          // previously used to initialize the buffer.
-          buff_storage_size = std::min<size_t>(buff_storage_size * 2, MAX_DRAIN_BUFFER_SIZE);
-          body.reserve(buff_storage_size);
-        }
+    // The chunk stream is parsed in place in the receive buffer. Only what the
+    // parser consumes is taken from it so that content after the final chunk
+    // remains for the next message.
+    auto result = ChunkCodex::CONTINUE;
+    while (true) {
+      auto const received = _recv_buffer.view();
+      size_t consumed = 0;
+      result = codex.parse(received, cb, consumed);
+      // Note that this stores the chunk stream, including chunk headers.
+      store(received.prefix(consumed));
+      _recv_buffer.consume(consumed);
+      if (result != ChunkCodex::CONTINUE) {
+        break;
       }
-      auto const old_size = body.size();
-      body.resize(buff_storage_size);
-      ssize_t const n = read({body.data() + old_size, buff_storage_size - old_size});
+      auto const span = _recv_buffer.aux_span();
+      if (span.empty()) {
+        // The held header and an incomplete chunk header fill the buffer.
+        // Reading into no space would look like the peer closing.
+        num_drained_body_bytes.error(
+            R"(Header too large: no room left in the {} byte receive buffer for the chunked body.)",
+            MAX_HDR_SIZE);
+        break;
+      }
+      ssize_t const n = read(span);
       if (n > 0) {
-        body.resize(old_size + n);
-        result = codex.parse(TextView(body.data() + old_size, n), cb);
-      } else {
-        body.resize(old_size);
+        _recv_buffer.commit(n);
       }
       if (is_closed()) {
         if (num_drained_body_bytes < expected_content_size) {
@@ -1049,33 +1593,34 @@ Session::drain_body(HttpHeader const &hdr, size_t expected_content_size, TextVie
           expected_content_size,
           num_drained_body_bytes.result());
     }
-    // As described above in the chunk callback comment, this will print the
-    // entire chunk stream, including chunk headers.
     num_drained_body_bytes.diag(
         "Drained {} chunked body bytes with chunk stream: {}",
         num_drained_body_bytes.result(),
         body);
   } else { // Content-Length instead of chunked.
+    auto const initial = _recv_buffer.view().prefix(expected_content_size);
+    store(initial);
+    _recv_buffer.consume(initial.size());
+    num_drained_body_bytes = initial.size();
+    if (num_drained_body_bytes < expected_content_size && is_closed()) {
+      num_drained_body_bytes.error(
+          R"(Stream closed before finishing reading the body. Read {} bytes of {} expected bytes)",
+          num_drained_body_bytes.result(),
+          expected_content_size);
+      return num_drained_body_bytes;
+    }
+    // The rest of the body is read directly, never more than what remains of
+    // it, so nothing of the next message is consumed.
+    auto const buffer = discard_buffer();
     while (num_drained_body_bytes < expected_content_size) {
-      if (buff_storage_size <= body.size()) {
-        // See the comment above in the corresponding chunk code for an
-        // explanation of the logic here.
-        body.resize(0);
-        num_drained_body_bytes.diag(
-            "Drained {} of {} expected bytes. Not storing any more since we hit buffer capacity: "
-            "{}.",
-            num_drained_body_bytes.result(),
-            expected_content_size,
-            buff_storage_size);
-      }
-      auto const old_size = body.size();
-      body.resize(buff_storage_size);
-      ssize_t const n = read({body.data() + old_size, buff_storage_size - old_size});
+      auto const remaining = expected_content_size - num_drained_body_bytes;
+      ssize_t const n = Verbose ? read({buffer.data(), std::min(remaining, buffer.size())})
+                                : discard(remaining);
       if (n > 0) {
-        body.resize(old_size + n);
+        if (Verbose) {
+          store({buffer.data(), static_cast<size_t>(n)});
+        }
         num_drained_body_bytes.result() += n;
-      } else {
-        body.resize(old_size);
       }
       if (is_closed()) {
         num_drained_body_bytes.error(
@@ -1086,21 +1631,94 @@ Session::drain_body(HttpHeader const &hdr, size_t expected_content_size, TextVie
         break;
       }
     }
-    if (num_drained_body_bytes > expected_content_size) {
+    // Content received past the body is the next message when requests are
+    // pipelined. Otherwise nothing should follow a response, so the body was
+    // longer than its Content-Length. This is not checked for chunked bodies
+    // because their size is not advertised.
+    if (hdr.is_response() && _pipeline_depth == 1 && !_recv_buffer.view().empty()) {
       num_drained_body_bytes.error(
-          R"(Body overrun while reading it: received {} bytes of content, expected {}.)",
-          num_drained_body_bytes.result(),
+          R"(Body overrun: received {} bytes of content, expected {}.)",
+          num_drained_body_bytes.result() + _recv_buffer.view().size(),
           expected_content_size);
     }
-    num_drained_body_bytes.diag("Drained body of {} bytes with content: {}", body.size(), body);
+    num_drained_body_bytes.diag(
+        "Drained body of {} bytes with content: {}",
+        num_drained_body_bytes.result(),
+        body);
   }
   return num_drained_body_bytes;
 }
 
+/** The body content to send for @a hdr. */
+static TextView
+body_content(HttpHeader const &hdr)
+{
+  if (hdr._content_data) {
+    return {hdr._content_data, hdr._content_size};
+  }
+  // If hdr._content_data is null, then there was no explicit description of
+  // the body data via the data node. Instead we'll use our generated
+  // HttpHeader::_content.
+  return {HttpHeader::_content.data(), hdr._content_size};
+}
+
+void
+Session::hold_output()
+{
+  _hold_output = true;
+}
+
+bool
+Session::has_buffered_header() const
+{
+  return _recv_buffer.view().find(HTTP_EOH) != TextView::npos;
+}
+
+swoc::Rv<ssize_t>
+Session::flush_output()
+{
+  _hold_output = false;
+  return send_held_output();
+}
+
+bool
+Session::has_held_output() const
+{
+  return !_held_output.empty();
+}
+
+swoc::Rv<ssize_t>
+Session::send_held_output()
+{
+  swoc::Rv<ssize_t> zret{0};
+  if (!_held_output.empty()) {
+    zret = writev({_held_output.data(), _held_output.size()});
+    if (zret.result() != static_cast<ssize_t>(_held_size)) {
+      zret.error(
+          R"(Write of held messages with keys {} failed with {} of {} bytes written.)",
+          _held_keys,
+          zret.result(),
+          _held_size);
+    }
+    _held_output.clear();
+    _held_arena.clear();
+    _held_size = 0;
+    _held_keys.clear();
+  }
+  return zret;
+}
+
 swoc::Rv<ssize_t>
 Session::write_body(HttpHeader const &hdr)
+{
+  return write_message(hdr, TextView{});
+}
+
+swoc::Rv<ssize_t>
+Session::write_message(HttpHeader const &hdr, TextView header)
 {
   swoc::Rv<ssize_t> bytes_written{0};
+  ssize_t header_bytes_written = 0;
   std::error_code ec;
   auto const key = hdr.get_key();
 
@@ -1115,25 +1733,57 @@ Session::write_body(HttpHeader const &hdr)
    * for HEAD requests via update_content_length. */
   auto const message_type_permits_body =
       (hdr.is_request() || (hdr._status && !HttpHeader::STATUS_NO_CONTENT[hdr._status]));
+
+  if (_hold_output) {
+    // Only messages whose end the peer can find from the header are held. A
+    // chunked message or one ended by closing the connection is written
+    // directly, after whatever is already held.
+    auto const content = message_type_permits_body ? body_content(hdr) : TextView{};
+    bool const is_delimited =
+        !hdr._chunked_p && (hdr._content_length_p || !message_type_permits_body);
+    if (is_delimited && _held_size + header.size() + content.size() <= MAX_HELD_OUTPUT) {
+      auto held_header = _held_arena.alloc(header.size()).rebind<char>();
+      memcpy(held_header.data(), header.data(), header.size());
+      _held_output.push_back({held_header.data(), header.size()});
+      if (!content.empty()) {
+        _held_output.push_back({const_cast<char *>(content.data()), content.size()});
+      }
+      _held_size += header.size() + content.size();
+      if (!_held_keys.empty()) {
+        _held_keys += ", ";
+      }
+      _held_keys += key;
+      bytes_written.result() = header.size() + content.size();
+      return bytes_written;
+    }
+    bytes_written.note(send_held_output().errata());
+  }
+
   // Note that zero-length chunked bodies must send a zero-length encoded chunk.
   if (message_type_permits_body && (hdr._content_size > 0 || hdr._chunked_p)) {
-    TextView content;
-    if (hdr._content_data) {
-      content = TextView{hdr._content_data, hdr._content_size};
-    } else {
-      // If hdr._content_data is null, then there was no explicit description
-      // of the body data via the data node. Instead we'll use our generated
-      // HttpHeader::_content.
-      content = TextView{HttpHeader::_content.data(), hdr._content_size};
-    }
+    auto const content = body_content(hdr);
 
     if (hdr._chunked_p) {
       ChunkCodex codex;
-      std::tie(bytes_written, ec) = codex.transmit(*this, content);
+      std::tie(bytes_written, ec) =
+          codex.transmit(*this, content, ChunkCodex::DEFAULT_CHUNK_SIZE, header);
+      if (bytes_written > 0 || !ec) {
+        header_bytes_written = header.size();
+      }
     } else {
-      auto &&[n, write_errata] = write(content);
-      bytes_written.note(write_errata);
-      bytes_written.result() += n;
+      swoc::Rv<ssize_t> n;
+      auto const file_offset = HttpHeader::content_file_offset(content);
+      if (file_offset >= 0 && content.size() >= SENDFILE_MIN_SIZE && can_send_content_file()) {
+        n = send_content_file(header, file_offset, content.size());
+      } else {
+        iovec iov[] = {
+            {const_cast<char *>(header.data()), header.size()},
+            {const_cast<char *>(content.data()), content.size()}};
+        n = writev({iov, 2});
+      }
+      bytes_written.note(n.errata());
+      header_bytes_written = std::min<ssize_t>(n, header.size());
+      bytes_written.result() += n - header_bytes_written;
       ec = std::error_code(errno, std::system_category());
 
       if (!hdr._content_length_p && !hdr._has_transfer_encoding_chunked) {
@@ -1158,127 +1808,146 @@ Session::write_body(HttpHeader const &hdr)
           hdr._content_size,
           ec);
     }
-  } else if (
-      hdr._status && !HttpHeader::STATUS_NO_CONTENT[hdr._status] && !hdr._chunked_p &&
-      !hdr._content_length_p)
-  {
-    // Note the conditions:
-    //
-    //   1. This is a response since there is a hdr._status. Only responses
-    //   have a status.
-    //
-    //   2. There's no body since hdr._content_size must be zero in this code
-    //   block (see the if condition matching this else).
-    //
-    //   3. The response headers give no indication that there is no more body
-    //   forthcoming since there is neither a zero-value Content-Length header
-    //   nor a Transfer-Encoding header which would have a zero-length chunk.
-    //
-    // This being the case, we must close this connection lest the client
-    // timeout waiting for a body it will never receive. Unfortunately, this
-    // will result in the client needing to reconnect more frequently than it
-    // would otherwise need to, but we have logic for handling this in
-    // run_transaction.
-    bytes_written.diag("No CL or TE, status {}: closing conection for key {}.", hdr._status, key);
-    close();
+  } else {
+    if (!header.empty()) {
+      auto &&[n, write_errata] = write(header);
+      bytes_written.note(write_errata);
+      header_bytes_written = n;
+    }
+    if (hdr._status && !HttpHeader::STATUS_NO_CONTENT[hdr._status] && !hdr._chunked_p &&
+        !hdr._content_length_p)
+    {
+      // Note the conditions:
+      //
+      //   1. This is a response since there is a hdr._status. Only responses
+      //   have a status.
+      //
+      //   2. There's no body since hdr._content_size must be zero in this code
+      //   block (see the if condition matching this else).
+      //
+      //   3. The response headers give no indication that there is no more body
+      //   forthcoming since there is neither a zero-value Content-Length header
+      //   nor a Transfer-Encoding header which would have a zero-length chunk.
+      //
+      // This being the case, we must close this connection lest the client
+      // timeout waiting for a body it will never receive. Unfortunately, this
+      // will result in the client needing to reconnect more frequently than it
+      // would otherwise need to, but we have logic for handling this in
+      // run_transaction.
+      bytes_written.diag(
+          "No CL or TE, status {}: closing conection for key {}.",
+          hdr._status,
+          key);
+      close();
+    }
   }
 
+  bytes_written.result() += header_bytes_written;
   return bytes_written;
 }
 
 Errata
 Session::run_transaction(Txn const &json_txn)
+{
+  Errata errata = send_request(json_txn);
+  if (errata.is_ok()) {
+    errata.note(receive_response(json_txn));
+  }
+  return errata;
+}
+
+Errata
+Session::send_request(Txn const &json_txn)
 {
   Errata errata;
   auto &&[bytes_written, write_errata] = this->write(json_txn._req);
   errata.note(std::move(write_errata));
   errata.diag("Sent the following HTTP/1 {} request:\n{}", json_txn._req._method, json_txn._req);
+  return errata;
+}
 
-  if (errata.is_ok()) {
-    auto const key{json_txn._req.get_key()};
-    HttpHeader rsp_hdr_from_wire;
-    rsp_hdr_from_wire.set_is_response();
-    // The response headers are not required to have the key. For logging
-    // purposes, explicitly make sure it is set with the expected value we have
-    // from the client-request.
-    rsp_hdr_from_wire.set_key(key);
-    swoc::LocalBufferWriter<MAX_HDR_SIZE> w;
-    errata.diag("Reading response header.");
-
-    auto read_result{this->read_headers(w)};
-    errata.note(read_result);
-
-    if (read_result.is_ok()) {
-      _body_offset = read_result;
-      auto result{rsp_hdr_from_wire.parse_response(TextView(w.data(), _body_offset))};
-      errata.note(result);
-
-      if (result.is_ok()) {
-        if (result != HttpHeader::PARSE_OK) {
-          // We don't expect this since read_headers loops on reading until we
-          // get HTTP_EOH.
-          errata.error(
-              R"(Failed to find a well-formed, completed HTTP response: {})",
-              (result == HttpHeader::PARSE_INCOMPLETE ? "PARSE_INCOMPLETE" : "PARSE_ERROR"));
-          return errata;
-        }
-        if (rsp_hdr_from_wire._status == 100) {
-          errata.diag("100-Continue response. Read another header.");
-          rsp_hdr_from_wire = HttpHeader{};
-          w.clear();
-          auto read_result{this->read_headers(w)};
-
-          if (read_result.is_ok()) {
-            _body_offset = read_result;
-            auto result{rsp_hdr_from_wire.parse_response(TextView(w.data(), _body_offset))};
-
-            if (!result.is_ok()) {
-              errata.error(R"(Failed to parse post 100 header.)");
-              return errata;
-            }
-          } else {
-            errata.error(R"(Failed to read post 100 header.)");
+Errata
+Session::receive_response(Txn const &json_txn)
+{
+  Errata errata;
+  auto const key{json_txn._req.get_key()};
+  HttpHeader rsp_hdr_from_wire;
+  rsp_hdr_from_wire.set_is_response();
+  // The response headers are not required to have the key. For logging
+  // purposes, explicitly make sure it is set with the expected value we have
+  // from the client-request.
+  rsp_hdr_from_wire.set_key(key);
+  errata.diag("Reading response header.");
+
+  auto read_result{this->read_headers()};
+  errata.note(read_result);
+
+  if (read_result.is_ok()) {
+    auto result{rsp_hdr_from_wire.parse_response(read_result)};
+    errata.note(result);
+
+    if (result.is_ok()) {
+      if (result != HttpHeader::PARSE_OK) {
+        // We don't expect this since read_headers loops on reading until we
+        // get HTTP_EOH.
+        errata.error(
+            R"(Failed to find a well-formed, completed HTTP response: {})",
+            (result == HttpHeader::PARSE_INCOMPLETE ? "PARSE_INCOMPLETE" : "PARSE_ERROR"));
+        return errata;
+      }
+      if (rsp_hdr_from_wire._status == 100) {
+        errata.diag("100-Continue response. Read another header.");
+        rsp_hdr_from_wire = HttpHeader{};
+        auto read_result{this->read_headers()};
+
+        if (read_result.is_ok()) {
+          auto result{rsp_hdr_from_wire.parse_response(read_result)};
+
+          if (!result.is_ok()) {
+            errata.error(R"(Failed to parse post 100 header.)");
             return errata;
           }
-        }
-        errata.diag(
-            "Received an HTTP/1 {} response for key {} with headers:\n{}",
-            rsp_hdr_from_wire._status,
-            key,
-            rsp_hdr_from_wire);
-        if (json_txn._rsp._status != 0 && rsp_hdr_from_wire._status != json_txn._rsp._status &&
-            (rsp_hdr_from_wire._status != 200 || json_txn._rsp._status != 304) &&
-            (rsp_hdr_from_wire._status != 304 || json_txn._rsp._status != 200))
-        {
-          errata.error(
-              R"(HTTP/1 Status Violation: expected {} got {}, key={}.)",
-              json_txn._rsp._status,
-              rsp_hdr_from_wire._status,
-              key);
-          // Drain the rest of the body so it's not in the buffer to confuse the
-          // next transaction.
-          auto &&[bytes_drained, drain_errata] =
-              this->drain_body_internal(rsp_hdr_from_wire, json_txn, w.view());
-          errata.note(std::move(drain_errata));
-
+        } else {
+          errata.error(R"(Failed to read post 100 header.)");
           return errata;
         }
-        if (rsp_hdr_from_wire.verify_headers(key, *json_txn._rsp._fields_rules)) {
-          errata.error(R"(Response headers did not match expected response headers.)");
-        }
+      }
+      errata.diag(
+          "Received an HTTP/1 {} response for key {} with headers:\n{}",
+          rsp_hdr_from_wire._status,
+          key,
+          rsp_hdr_from_wire);
+      if (json_txn._rsp._status != 0 && rsp_hdr_from_wire._status != json_txn._rsp._status &&
+          (rsp_hdr_from_wire._status != 200 || json_txn._rsp._status != 304) &&
+          (rsp_hdr_from_wire._status != 304 || json_txn._rsp._status != 200))
+      {
+        errata.error(
+            R"(HTTP/1 Status Violation: expected {} got {}, key={}.)",
+            json_txn._rsp._status,
+            rsp_hdr_from_wire._status,
+            key);
+        // Drain the rest of the body so it's not in the buffer to confuse the
+        // next transaction.
         auto &&[bytes_drained, drain_errata] =
-            this->drain_body_internal(rsp_hdr_from_wire, json_txn, w.view());
+            this->drain_body_internal(rsp_hdr_from_wire, json_txn);
         errata.note(std::move(drain_errata));
 
-        if (!errata.is_ok()) {
-          errata.error("Failed to replay transaction with key: {}", key);
-        }
-      } else {
-        errata.error(R"(Invalid response. key={})", key);
+        return errata;
+      }
+      if (rsp_hdr_from_wire.verify_headers(key, *json_txn._rsp._fields_rules)) {
+        errata.error(R"(Response headers did not match expected response headers.)");
+      }
+      auto &&[bytes_drained, drain_errata] = this->drain_body_internal(rsp_hdr_from_wire, json_txn);
+      errata.note(std::move(drain_errata));
+
+      if (!errata.is_ok()) {
+        errata.error("Failed to replay transaction with key: {}", key);
       }
     } else {
-      errata.error(R"(Invalid response read key={}.)", key);
+      errata.error(R"(Invalid response. key={})", key);
     }
+  } else {
+    errata.error(R"(Invalid response read key={}.)", key);
   }
   return errata;
 }
@@ -1290,6 +1959,9 @@ Session::run_transactions(
     swoc::IPEndpoint const *real_target,
     double rate_multiplier)
 {
+  if (_pipeline_depth > 1) {
+    return run_pipelined_transactions(txn_list, interface, real_target, rate_multiplier);
+  }
   Errata session_errata;
 
   auto const first_time = ClockType::now();
@@ -1333,11 +2005,145 @@ Session::run_transactions(
   return session_errata;
 }
 
+Errata
+Session::run_pipelined_transactions(
+    std::list<Txn> const &txn_list,
+    swoc::TextView interface,
+    swoc::IPEndpoint const *real_target,
+    double rate_multiplier)
+{
+  Errata session_errata;
+  // A request written ahead of its response.
+  struct Outstanding
+  {
+    std::list<Txn>::const_iterator _txn;
+    ClockType::time_point _sent;
+  };
+  std::deque<Outstanding> outstanding;
+
+  auto const first_time = ClockType::now();
+  auto next_txn = txn_list.begin();
+
+  // Set when the connection closes while a request is being written.
+  bool closed_while_writing = false;
+  // Receive and verify the response to the oldest outstanding request.
+  auto const receive_next_response = [&]() {
+    auto const [txn_p, sent] = outstanding.front();
+    outstanding.pop_front();
+    auto const &txn = *txn_p;
+    Errata txn_errata;
+    txn_errata.note(this->receive_response(txn));
+    auto const after = ClockType::now();
+    if (!txn_errata.is_ok()) {
+      txn_errata.error(R"(Failed HTTP/1 transaction with key={}.)", txn._req.get_key());
+    } else {
+      this->record_transaction_latency(duration_cast<chrono::microseconds>(after - sent));
+    }
+    // Timing covers the time from when the request was sent, including any
+    // time spent waiting behind earlier responses in the pipeline.
+    auto const elapsed_ms = duration_cast<chrono::milliseconds>(after - sent);
+    if (elapsed_ms > Transaction_Delay_Cutoff) {
+      txn_errata.error(R"(HTTP/1 transaction for key={} took {}.)", txn._req.get_key(), elapsed_ms);
+    }
+    session_errata.note(std::move(txn_errata));
+
+    if (this->is_closed() && !outstanding.empty()) {
+      // The server closed the connection, such as after a response without a
+      // Content-Length, so the remaining requests will get no response on it.
+      // Send them again on a new connection.
+      session_errata.diag(
+          "Connection closed with {} pipelined requests outstanding. Resending them.",
+          outstanding.size());
+      next_txn = outstanding.front()._txn;
+      outstanding.clear();
+    }
+  };
+
+  while (next_txn != txn_list.end() || !outstanding.empty()) {
+    // Write requests ahead until the pipeline is full.
+    while (next_txn != txn_list.end() && outstanding.size() < _pipeline_depth) {
+      auto const &txn = *next_txn;
+      Errata txn_errata;
+      if (this->is_closed()) {
+        if (!outstanding.empty()) {
+          // Collect the responses to what was sent before reconnecting.
+          break;
+        }
+        // See run_transactions: the server may have closed the connection.
+        txn_errata.note(this->do_connect(interface, real_target));
+        if (!txn_errata.is_ok()) {
+          txn_errata.error(R"(Failed to reconnect HTTP/1 key={}.)", txn._req.get_key());
+          session_errata.note(std::move(txn_errata));
+          return session_errata;
+        }
+      }
+      if (txn._user_specified_delay_duration > 0us) {
+        sleep_for(txn._user_specified_delay_duration);
+      } else if (rate_multiplier != 0) {
+        auto const next_time = (rate_multiplier * txn._start) + first_time;
+        if (next_time > ClockType::now()) {
+          sleep_until(next_time);
+        }
+      }
+      auto const sent = ClockType::now();
+      // Responses to earlier requests are received if they arrive while this
+      // one cannot be written, such as when its body is large.
+      _receive_while_writing = [&]() {
+        if (outstanding.empty()) {
+          return false;
+        }
+        receive_next_response();
+        closed_while_writing = this->is_closed();
+        return !closed_while_writing;
+      };
+      txn_errata.note(this->send_request(txn));
+      _receive_while_writing = nullptr;
+      if (closed_while_writing) {
+        // The request was cut short with the connection. next_txn now refers
+        // to the oldest request still needing a response, and it and those
+        // after it are sent again on a new connection.
+        closed_while_writing = false;
+        continue;
+      }
+      if (!txn_errata.is_ok()) {
+        txn_errata.error(R"(Failed HTTP/1 transaction with key={}.)", txn._req.get_key());
+        session_errata.note(std::move(txn_errata));
+        ++next_txn;
+        continue;
+      }
+      session_errata.note(std::move(txn_errata));
+      outstanding.push_back({next_txn, sent});
+      ++next_txn;
+    }
+    if (outstanding.empty()) {
+      continue;
+    }
+
+    // Responses arrive in the order the requests were sent.
+    receive_next_response();
+  }
+  return session_errata;
+}
+
+void
+Session::set_pipeline_depth(unsigned depth)
+{
+  _pipeline_depth = std::max(depth, 1u);
+}
+
+void
+Session::set_template_context(TemplateContext const &context)
+{
+  _template_context = context;
+}
+
 Errata
 Session::set_fd(int fd)
 {
   Errata errata;
   _fd = fd;
+  // Anything received on a previous connection is meaningless on this one.
+  _recv_buffer.clear();
   return errata;
 }
 
@@ -1539,6 +2345,14 @@ Session::init(int num_transactions)
 ChunkCodex::Result
 ChunkCodex::parse(swoc::TextView data, ChunkCallback const &cb)
 {
+  size_t consumed = 0;
+  return parse(data, cb, consumed);
+}
+
+ChunkCodex::Result
+ChunkCodex::parse(swoc::TextView data, ChunkCallback const &cb, size_t &consumed)
+{
+  auto const size = data.size();
   while (data) {
     switch (_state) {
     case State::INIT:
@@ -1574,6 +2388,7 @@ ChunkCodex::parse(swoc::TextView data, ChunkCallback const &cb)
           _state = State::FINAL;
           ++data;
           _off = 0;
+          consumed = size - data.size();
           return DONE;
         } else {
           _state = State::SIZE;
@@ -1582,6 +2397,7 @@ ChunkCodex::parse(swoc::TextView data, ChunkCallback const &cb)
         }
       } else {
         _state = State::FINAL;
+        consumed = size - data.size();
         return DONE;
       }
       break;
@@ -1605,47 +2421,61 @@ ChunkCodex::parse(swoc::TextView data, ChunkCallback const &cb)
       }
     } break;
     case State::FINAL:
+      consumed = size - data.size();
       return DONE;
     }
   }
+  consumed = size;
   return CONTINUE;
 }
 
 std::tuple<ssize_t, std::error_code>
-ChunkCodex::transmit(Session &session, swoc::TextView data, size_t chunk_size)
+ChunkCodex::transmit(Session &session, swoc::TextView data, size_t chunk_size, TextView prefix)
 {
   static const std::error_code NO_ERROR;
   static constexpr swoc::TextView ZERO_CHUNK{"0\r\n\r\n"};
+  auto const to_iovec = [](TextView view) -> iovec {
+    return {const_cast<char *>(view.data()), view.size()};
+  };
 
-  swoc::LocalBufferWriter<10> w; // 8 bytes of size (32 bits) CR LF
-  ssize_t n = 0;
+  // Each chunk takes three buffers: size line, data, and CRLF. Room is left
+  // for the prefix and the zero chunk.
+  std::array<iovec, 3 * CHUNKS_PER_WRITE + 2> iov;
+  // 8 bytes of size (32 bits) CR LF for each chunk.
+  std::array<swoc::LocalBufferWriter<10>, CHUNKS_PER_WRITE> size_lines;
   ssize_t total = 0;
-  while (data) {
-    if (data.size() < chunk_size) {
-      chunk_size = data.size();
+  bool done = false;
+  while (!done) {
+    size_t iov_count = 0;
+    size_t write_size = 0;
+    size_t data_size = 0;
+    if (!prefix.empty()) {
+      iov[iov_count++] = to_iovec(prefix);
+      write_size += prefix.size();
+      prefix.clear();
     }
-    w.clear().print("{:x}{}", chunk_size, HTTP_EOL);
-    n = session.write(w.view());
-    if (n > 0) {
-      n = session.write({data.data(), chunk_size});
-      if (n > 0) {
-        total += n;
-        if (n == static_cast<ssize_t>(chunk_size)) {
-          w.clear().print("{}",
-                          HTTP_EOL); // Each chunk much terminate with CRLF
-          session.write(w.view());
-          data.remove_prefix(chunk_size);
-        } else {
-          return {total, std::error_code(errno, std::system_category())};
-        }
-      }
-    } else {
+    for (size_t i = 0; i < CHUNKS_PER_WRITE && !data.empty(); ++i) {
+      auto const size = std::min(chunk_size, data.size());
+      auto &w = size_lines[i];
+      w.clear().print("{:x}{}", size, HTTP_EOL);
+      iov[iov_count++] = to_iovec(w.view());
+      iov[iov_count++] = to_iovec(data.prefix(size));
+      // Each chunk much terminate with CRLF.
+      iov[iov_count++] = to_iovec(HTTP_EOL);
+      write_size += w.size() + size + HTTP_EOL.size();
+      data_size += size;
+      data.remove_prefix(size);
+    }
+    if (data.empty()) {
+      iov[iov_count++] = to_iovec(ZERO_CHUNK);
+      write_size += ZERO_CHUNK.size();
+      done = true;
+    }
+    ssize_t const n = session.writev({iov.data(), iov_count});
+    if (n != static_cast<ssize_t>(write_size)) {
       return {total, std::error_code(errno, std::system_category())};
     }
-  }
-  n = session.write(ZERO_CHUNK);
-  if (n != static_cast<ssize_t>(ZERO_CHUNK.size())) {
-    return {total, std::error_code(errno, std::system_category())};
+    total += data_size;
   }
   return {total, NO_ERROR};
 };
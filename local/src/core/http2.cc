@@ -8,8 +8,12 @@
 #include "core/http2.h"
 #include "core/ProxyVerifier.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <limits>
 #include <netdb.h>
+#include <unistd.h>
 
 #include "swoc/bwf_ex.h"
 #include "swoc/bwf_ip.h"
@@ -20,6 +24,7 @@ using swoc::TextView;
 using namespace swoc::literals;
 using namespace std::literals;
 using std::this_thread::sleep_for;
+using std::this_thread::sleep_until;
 
 namespace chrono = std::chrono;
 using ClockType = std::chrono::system_clock;
@@ -68,16 +73,20 @@ H2Session::poll_for_headers(chrono::milliseconds timeout)
     return 1;
   }
   swoc::Rv<int> zret{-1};
-  auto &&[poll_result, poll_errata] = Session::poll_for_data_on_socket(timeout);
-  zret.note(std::move(poll_errata));
-  if (!zret.is_ok()) {
-    return zret;
-  } else if (poll_result == 0) {
-    return 0;
-  } else if (poll_result < 0) {
-    // Connection closed.
-    close();
-    return -1;
+  // Frames received as early data are processed without waiting on the
+  // socket.
+  if (_early_data_received.empty()) {
+    auto &&[poll_result, poll_errata] = Session::poll_for_data_on_socket(timeout);
+    zret.note(std::move(poll_errata));
+    if (!zret.is_ok()) {
+      return zret;
+    } else if (poll_result == 0) {
+      return 0;
+    } else if (poll_result < 0) {
+      // Connection closed.
+      close();
+      return -1;
+    }
   }
   auto const received_bytes =
       receive_nghttp2_request(this->get_session(), nullptr, 0, 0, this, timeout);
@@ -108,11 +117,137 @@ H2Session::set_non_zero_exit_status()
   *H2Session::process_exit_code = 1;
 }
 
+swoc::Rv<ssize_t>
+H2Session::buffer_frames(TextView frames)
+{
+  swoc::Rv<ssize_t> zret{0};
+  if (frames.size() > _frame_buffer.remaining()) {
+    // Write what is buffered along with these frames rather than copying
+    // them in.
+    iovec iov{const_cast<char *>(frames.data()), frames.size()};
+    return write_frames({&iov, 1});
+  }
+  _frame_buffer.write(frames);
+  return zret;
+}
+
+swoc::Rv<ssize_t>
+H2Session::write_frames(swoc::MemSpan<iovec> iov)
+{
+  swoc::Rv<ssize_t> zret{0};
+  size_t const buffered_size = _frame_buffer.size();
+  if (buffered_size == 0 && iov.empty()) {
+    return zret;
+  }
+  // Callers pass at most a DATA frame's few pieces, so the gather list fits
+  // on the stack.
+  static constexpr size_t MAX_GATHERED = 8;
+  iovec gathered[MAX_GATHERED];
+  size_t gathered_count = 0;
+  if (buffered_size > 0) {
+    gathered[gathered_count++] = {const_cast<char *>(_frame_buffer.data()), buffered_size};
+  }
+  size_t expected_size = buffered_size;
+  for (auto const &buffer : iov) {
+    assert(gathered_count < MAX_GATHERED);
+    gathered[gathered_count++] = buffer;
+    expected_size += buffer.iov_len;
+  }
+  ++_frame_writes;
+  zret = writev({gathered, gathered_count});
+  _frame_buffer.clear();
+  if (zret.result() != static_cast<ssize_t>(expected_size)) {
+    zret.error(
+        R"(Write of HTTP/2 frames failed with {} of {} bytes written.)",
+        zret.result(),
+        expected_size);
+  }
+  return zret;
+}
+
+void
+H2Session::count_frame_sent(nghttp2_frame const &frame)
+{
+  ++_frames_sent;
+  if (frame.hd.type == NGHTTP2_HEADERS && frame.headers.cat != NGHTTP2_HCAT_HEADERS) {
+    ++_streams_sent;
+  }
+}
+
+H2StreamState *
+H2Session::new_stream_state()
+{
+  return _stream_states.acquire();
+}
+
 void
-H2Session::record_stream_state(int32_t stream_id, std::shared_ptr<H2StreamState> stream_state)
+H2Session::record_stream_state(int32_t stream_id, H2StreamState *stream_state)
 {
-  _stream_map[stream_id] = stream_state;
+  _stream_map.insert(stream_id, stream_state);
   _last_added_stream = stream_state;
+  ++_open_streams;
+}
+
+void
+H2Session::record_stream_closed(int32_t stream_id)
+{
+  auto *const stream_state = _stream_map.erase(stream_id);
+  if (stream_state == nullptr) {
+    return;
+  }
+  if (stream_state == _last_added_stream) {
+    _last_added_stream = nullptr;
+  }
+  _stream_states.release(stream_state);
+  if (_open_streams > 0) {
+    --_open_streams;
+  }
+}
+
+void
+H2Session::set_is_cleartext(bool is_cleartext)
+{
+  _is_cleartext = is_cleartext;
+}
+
+void
+H2Session::set_stream_limit(unsigned limit)
+{
+  _stream_limit = limit;
+}
+
+size_t
+H2Session::get_max_open_streams() const
+{
+  // Until the peer's SETTINGS arrive, nghttp2 assumes a conservative limit.
+  size_t const peer_max =
+      nghttp2_session_get_remote_settings(_session, NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS);
+  return _stream_limit > 0 ? std::min<size_t>(_stream_limit, peer_max) : peer_max;
+}
+
+Errata
+H2Session::wait_for_stream_slot()
+{
+  Errata errata;
+  auto last_progress = ClockType::now();
+  while (!this->is_closed() && _open_streams >= get_max_open_streams()) {
+    auto const received = receive_nghttp2_data(_session, nullptr, 0, 0, this, Poll_Timeout);
+    if (received < 0) {
+      if (!this->is_closed()) {
+        errata.error("Failed to receive HTTP/2 responses while waiting for a stream slot.");
+      }
+      break;
+    } else if (received > 0) {
+      last_progress = ClockType::now();
+    } else if (ClockType::now() - last_progress >= Poll_Timeout) {
+      errata.error(
+          "Timed out after {} waiting for one of {} open HTTP/2 streams to close.",
+          Poll_Timeout,
+          _open_streams);
+      break;
+    }
+  }
+  return errata;
 }
 
 bool
@@ -128,10 +263,10 @@ H2Session::set_stream_has_ended(int32_t stream_id)
 }
 
 swoc::Rv<std::shared_ptr<HttpHeader>>
-H2Session::read_and_parse_request(swoc::FixedBufferWriter &buffer)
+H2Session::read_and_parse_request()
 {
   if (!_h2_is_negotiated) {
-    return TLSSession::read_and_parse_request(buffer);
+    return TLSSession::read_and_parse_request();
   }
   swoc::Rv<std::shared_ptr<HttpHeader>> zret{nullptr};
 
@@ -140,31 +275,70 @@ H2Session::read_and_parse_request(swoc::FixedBufferWriter &buffer)
   assert(!_ended_streams.empty());
   auto const stream_id = _ended_streams.front();
   _ended_streams.pop_front();
-  auto stream_map_iter = _stream_map.find(stream_id);
-  if (stream_map_iter == _stream_map.end()) {
+  auto *stream_state = _stream_map.find(stream_id);
+  if (stream_state == nullptr) {
     zret.error("Requested request headers for stream id {}, but none are available.", stream_id);
     return zret;
   }
-  auto &stream_state = stream_map_iter->second;
   zret = stream_state->_request_from_client;
   return zret;
 }
 
 swoc::Rv<size_t>
-H2Session::drain_body(HttpHeader const &hdr, size_t expected_content_size, TextView initial)
+H2Session::drain_body(HttpHeader const &hdr, size_t expected_content_size)
 {
   if (!_h2_is_negotiated) {
-    return TLSSession::drain_body(hdr, expected_content_size, initial);
+    return TLSSession::drain_body(hdr, expected_content_size);
   }
   // For HTTP/2, we process entire streams once they are ended. Therefore there
   // is never body to drain.
   return {0};
 }
 
+bool
+H2Session::has_buffered_header() const
+{
+  if (!_h2_is_negotiated) {
+    return TLSSession::has_buffered_header();
+  }
+  return this->get_a_stream_has_ended();
+}
+
+swoc::Rv<ssize_t>
+H2Session::flush_output()
+{
+  if (!_h2_is_negotiated) {
+    return TLSSession::flush_output();
+  }
+  _hold_output = false;
+  return send_nghttp2_data(_session, nullptr, 0, 0, this);
+}
+
+bool
+H2Session::has_held_output() const
+{
+  if (!_h2_is_negotiated) {
+    return TLSSession::has_held_output();
+  }
+  // The frames of submitted streams stay with nghttp2 while output is held.
+  return _hold_output;
+}
+
 // Complete the TLS handshake (server-side).
 Errata
 H2Session::accept()
 {
+  if (_is_cleartext) {
+    // With prior knowledge there is nothing to negotiate: the client's
+    // connection preface is the first thing read from the connection.
+    Errata errata;
+    _h2_is_negotiated = true;
+    errata.note(this->server_session_init());
+    errata.diag("Accepted an HTTP/2 connection over cleartext TCP.");
+    send_connection_settings();
+    send_nghttp2_data(_session, nullptr, 0, 0, this);
+    return errata;
+  }
   Errata errata = TLSSession::accept();
   if (!errata.is_ok()) {
     errata.error(R"(Failed to accept SSL server object)");
@@ -195,6 +369,12 @@ H2Session::accept()
     return errata;
   }
 
+  if (char const *sni = SSL_get_servername(this->_ssl, TLSEXT_NAMETYPE_host_name); sni != nullptr)
+  {
+    if (auto const spot = _settings_per_sni.find(sni); spot != _settings_per_sni.end()) {
+      _settings = spot->second;
+    }
+  }
   this->server_session_init();
   errata.diag("Finished accept using H2Session");
   // Send initial H2 session frames
@@ -207,23 +387,40 @@ H2Session::accept()
 Errata
 H2Session::connect()
 {
+  if (_is_cleartext) {
+    // The connection preface is sent immediately, along with our SETTINGS.
+    Errata errata;
+    _h2_is_negotiated = true;
+    errata.note(this->client_session_init());
+    send_connection_settings();
+    send_nghttp2_data(_session, nullptr, 0, 0, this);
+    return errata;
+  }
   // Complete the TLS handshake
   Errata errata = super_type::connect(h2_client_context);
   if (!errata.is_ok()) {
     return errata;
   }
   unsigned char const *alpn = nullptr;
-  unsigned int alpnlen = 0;
+  size_t alpnlen = 0;
 
   // Make sure we negotiated a H2 session
+  if (early_data_is_pending()) {
+    // The handshake is deferred, but early data is only accepted if the
+    // protocol is that of the offered session.
+    SSL_SESSION_get0_alpn_selected(SSL_get0_session(this->_ssl), &alpn, &alpnlen);
+  } else {
+    unsigned int negotiated_len = 0;
 #ifndef OPENSSL_NO_NEXTPROTONEG
-  SSL_get0_next_proto_negotiated(this->_ssl, &alpn, &alpnlen);
+    SSL_get0_next_proto_negotiated(this->_ssl, &alpn, &negotiated_len);
 #endif /* !OPENSSL_NO_NEXTPROTONEG */
 #if OPENSSL_VERSION_NUMBER >= 0x10002000L
-  if (alpn == nullptr) {
-    SSL_get0_alpn_selected(this->_ssl, &alpn, &alpnlen);
-  }
+    if (alpn == nullptr) {
+      SSL_get0_alpn_selected(this->_ssl, &alpn, &negotiated_len);
+    }
 #endif /* OPENSSL_VERSION_NUMBER >= 0x10002000L */
+    alpnlen = negotiated_len;
+  }
 
   if (alpn != nullptr && alpnlen == 2 && memcmp("h2", alpn, 2) == 0) {
     errata.diag(R"(h2 is negotiated.)");
@@ -251,18 +448,12 @@ H2Session::run_transactions(
 {
   Errata errata;
 
+  size_t num_queued = 0;
+  ClockType::duration total_queue_delay{0};
   auto const first_time = ClockType::now();
   for (auto const &txn : txn_list) {
     Errata txn_errata;
     auto const key{txn._req.get_key()};
-    if (this->is_closed()) {
-      txn_errata.note(this->do_connect(interface, real_target));
-      if (!txn_errata.is_ok()) {
-        txn_errata.error(R"(Failed to reconnect HTTP/2 key={}.)", key);
-        // If we don't have a valid connection, there's no point in continuing.
-        break;
-      }
-    }
     if (rate_multiplier != 0 || txn._user_specified_delay_duration > 0us) {
       std::chrono::duration<double, std::micro> delay_time = 0ms;
       auto current_time = ClockType::now();
@@ -289,13 +480,154 @@ H2Session::run_transactions(
         sleep_for(delay_time);
       }
     }
+    // The transaction is due. If the connection already has as many streams
+    // open as allowed, it waits for one of them to close.
+    auto const ready_time = ClockType::now();
+    txn_errata.note(this->wait_for_stream_slot());
+    if (!txn_errata.is_ok()) {
+      txn_errata.error(R"(Skipping HTTP/2 transaction with key={}: no stream slot opened.)", key);
+      errata.note(std::move(txn_errata));
+      continue;
+    }
+    if (this->is_closed()) {
+      txn_errata.note(this->do_connect(interface, real_target));
+      if (!txn_errata.is_ok()) {
+        txn_errata.error(R"(Failed to connect HTTP/2 key={}.)", key);
+        // If we don't have a valid connection, there's no point in continuing.
+        errata.note(std::move(txn_errata));
+        break;
+      }
+    }
     txn_errata.note(this->run_transaction(txn));
     if (!txn_errata.is_ok()) {
       txn_errata.error(R"(Failed HTTP/2 transaction with key={}.)", key);
+    } else if (_last_added_stream != nullptr) {
+      // _stream_start marks when the request was submitted.
+      auto const queue_delay = _last_added_stream->_stream_start - ready_time;
+      if (queue_delay > ClockType::duration::zero()) {
+        _last_added_stream->_queue_delay = queue_delay;
+        total_queue_delay += queue_delay;
+        ++num_queued;
+      }
     }
     errata.note(std::move(txn_errata));
   }
   receive_nghttp2_responses(this->get_session(), nullptr, 0, 0, this);
+  if (num_queued > 0) {
+    errata.diag(
+        "{} of {} HTTP/2 transactions waited for a stream slot, for {} in total.",
+        num_queued,
+        txn_list.size(),
+        duration_cast<chrono::microseconds>(total_queue_delay));
+  }
+  return errata;
+}
+
+/// How long a thread sharing a connection reads from it before letting others
+/// use it.
+static constexpr milliseconds SHARED_RECEIVE_INTERVAL = 10ms;
+
+Errata
+H2Session::run_shared_transactions(
+    std::list<Txn> const &txn_list,
+    TemplateContext const &template_context,
+    std::mutex &mutex,
+    swoc::TextView interface,
+    swoc::IPEndpoint const *real_target,
+    double rate_multiplier)
+{
+  Errata errata;
+  // The streams submitted for txn_list, along with the connection of each.
+  std::vector<std::pair<int32_t, size_t>> submitted_streams;
+  // Drop the submitted streams which have closed. If the connection has
+  // closed, the rest never will, so report and drop them too.
+  auto const drop_closed_streams = [&]() {
+    bool const connection_is_closed = this->is_closed();
+    auto const is_done = [&](std::pair<int32_t, size_t> const &stream) {
+      if (stream.second == _connection_count && _stream_map.find(stream.first) != nullptr) {
+        if (!connection_is_closed) {
+          return false;
+        }
+        errata.error(
+            R"(HTTP/2 stream {} closed with its connection before its response was received.)",
+            stream.first);
+        this->record_stream_closed(stream.first);
+      }
+      --_shared_streams;
+      return true;
+    };
+    submitted_streams.erase(
+        std::remove_if(submitted_streams.begin(), submitted_streams.end(), is_done),
+        submitted_streams.end());
+  };
+  auto const first_time = ClockType::now();
+  for (auto const &txn : txn_list) {
+    Errata txn_errata;
+    auto const key{txn._req.get_key()};
+    // Other sessions' threads read any responses while this one waits.
+    if (txn._user_specified_delay_duration > 0us) {
+      sleep_for(txn._user_specified_delay_duration);
+    } else if (rate_multiplier != 0) {
+      auto const next_time = (rate_multiplier * txn._start) + first_time;
+      if (next_time > ClockType::now()) {
+        sleep_until(next_time);
+      }
+    }
+    std::unique_lock<std::mutex> lock{mutex};
+    txn_errata.note(this->wait_for_stream_slot());
+    if (!txn_errata.is_ok()) {
+      txn_errata.error(R"(Skipping HTTP/2 transaction with key={}: no stream slot opened.)", key);
+      errata.note(std::move(txn_errata));
+      continue;
+    }
+    while (this->is_closed()) {
+      drop_closed_streams();
+      if (_shared_streams == 0) {
+        txn_errata.note(this->do_connect(interface, real_target));
+        break;
+      }
+      // The other sessions with streams on the closed connection report
+      // those before it is reopened.
+      lock.unlock();
+      sleep_for(SHARED_RECEIVE_INTERVAL);
+      lock.lock();
+    }
+    if (this->is_closed()) {
+      txn_errata.error(R"(Failed to connect HTTP/2 key={}.)", key);
+      errata.note(std::move(txn_errata));
+      break;
+    }
+    this->set_template_context(template_context);
+    txn_errata.note(this->run_transaction(txn));
+    if (!txn_errata.is_ok()) {
+      txn_errata.error(R"(Failed HTTP/2 transaction with key={}.)", key);
+    } else if (_last_added_stream != nullptr) {
+      submitted_streams.emplace_back(_last_added_stream->get_stream_id(), _connection_count);
+      ++_shared_streams;
+    }
+    errata.note(std::move(txn_errata));
+  }
+
+  // Wait for this session's streams to close, reading for all the streams of
+  // the connection meanwhile.
+  while (!submitted_streams.empty()) {
+    std::lock_guard<std::mutex> lock{mutex};
+    drop_closed_streams();
+    if (submitted_streams.empty()) {
+      break;
+    }
+    if (receive_nghttp2_data(_session, nullptr, 0, 0, this, SHARED_RECEIVE_INTERVAL) < 0 &&
+        !this->is_closed())
+    {
+      // Nothing more can be read for the outstanding streams.
+      for (auto const &[stream_id, connection_count] : submitted_streams) {
+        errata.error(R"(Failed to receive the response for HTTP/2 stream {}.)", stream_id);
+        this->record_stream_closed(stream_id);
+        --_shared_streams;
+      }
+      break;
+    }
+  }
   return errata;
 }
 
@@ -305,7 +637,9 @@ H2Session::run_transaction(Txn const &txn)
   Errata errata;
   auto &&[bytes_written, write_errata] = this->write(txn._req);
   errata.note(std::move(write_errata));
-  _last_added_stream->_specified_response = &txn._rsp;
+  if (errata.is_ok() && _last_added_stream != nullptr) {
+    _last_added_stream->_specified_response = &txn._rsp;
+  }
   return errata;
 }
 
@@ -322,7 +656,7 @@ on_begin_headers_callback(
 
   switch (headers_category) {
   case NGHTTP2_HCAT_REQUEST: {
-    auto stream_state = std::make_shared<H2StreamState>();
+    auto *stream_state = session_data->new_stream_state();
     stream_state->set_stream_id(stream_id);
     session_data->record_stream_state(stream_id, stream_state);
     auto &request_headers = stream_state->_request_from_client;
@@ -331,15 +665,14 @@ on_begin_headers_callback(
     break;
   }
   case NGHTTP2_HCAT_RESPONSE: {
-    auto stream_map_iter = session_data->_stream_map.find(stream_id);
-    if (stream_map_iter == session_data->_stream_map.end()) {
+    auto *stream_state = session_data->_stream_map.find(stream_id);
+    if (stream_state == nullptr) {
       errata.error(
           "Got HTTP/2 headers for an unregistered stream id of {}. Headers category: {}",
           stream_id,
           headers_category);
       return 0;
     }
-    auto &stream_state = stream_map_iter->second;
     auto &response_headers = stream_state->_response_from_server;
     response_headers->_stream_id = stream_id;
     response_headers->_contains_pseudo_headers_in_fields_array = true;
@@ -367,15 +700,14 @@ on_header_callback(
   int const headers_category = frame->headers.cat;
   auto const stream_id = frame->hd.stream_id;
   H2Session *session_data = reinterpret_cast<H2Session *>(user_data);
-  auto stream_map_iter = session_data->_stream_map.find(stream_id);
-  if (stream_map_iter == session_data->_stream_map.end()) {
+  auto *stream_state = session_data->_stream_map.find(stream_id);
+  if (stream_state == nullptr) {
     errata.error(
         "Got HTTP/2 headers for an unregistered stream id of {}. Headers category: {}",
         stream_id,
         headers_category);
     return 0;
   }
-  auto &stream_state = stream_map_iter->second;
 
   TextView name_view = stream_state->register_rcbuf(name);
   TextView value_view = stream_state->register_rcbuf(value);
@@ -420,9 +752,9 @@ on_header_callback(
   return 0;
 }
 
-/* nghttp2_send_callback. Here we transmit the |data|, |length| bytes,
- *    to the network. Because we are using libevent bufferevent, we just
- *       write those bytes into bufferevent buffer. */
+/* Drive nghttp2 to serialize its pending frames and write them. Frames are
+ * buffered in the session so that they go out in as few writes as possible,
+ * with whatever remains written before returning. */
 static ssize_t
 send_nghttp2_data(
     nghttp2_session *session,
@@ -433,7 +765,7 @@ send_nghttp2_data(
 {
   Errata errata;
   H2Session *session_data = reinterpret_cast<H2Session *>(user_data);
-  int total_amount_sent = 0;
+  ssize_t total_amount_sent = 0;
   while (true) {
     uint8_t const *data = nullptr;
     ssize_t datalen = nghttp2_session_mem_send(session, &data);
@@ -444,18 +776,20 @@ send_nghttp2_data(
       errata.error("Failure calling nghttp2_session_mem_send: {}", datalen);
       break;
     }
-    int amount_sent = 0;
-    while (amount_sent < datalen) {
-      auto const n = session_data->write(TextView{(char *)data, (size_t)datalen});
-      if (n <= 0) {
-        break;
-      }
-      amount_sent += n;
+    auto &&[n, buffer_errata] =
+        session_data->buffer_frames(TextView{(char *)data, (size_t)datalen});
+    errata.note(std::move(buffer_errata));
+    if (n < 0) {
+      break;
     }
-    total_amount_sent += amount_sent;
+    total_amount_sent += n;
   }
-
-  return (ssize_t)total_amount_sent;
+  auto &&[n, write_errata] = session_data->write_frames();
+  errata.note(std::move(write_errata));
+  if (n > 0) {
+    total_amount_sent += n;
+  }
+  return total_amount_sent;
 }
 
 /**
@@ -475,46 +809,24 @@ receive_nghttp2_data(
 {
   H2Session *session_data = reinterpret_cast<H2Session *>(user_data);
   Errata errata;
-  unsigned char buffer[10 * 1024];
+  char buffer[10 * 1024];
 
   if (session_data->is_closed()) {
     errata.error("Socket closed while waiting for an HTTP/2 response.");
     return -1;
   }
-  int n = SSL_read(session_data->get_ssl(), buffer, sizeof(buffer));
-  if (n <= 0) {
-    auto const ssl_error = SSL_get_error(session_data->get_ssl(), n);
-    auto &&[poll_return, poll_errata] =
-        session_data->poll_for_data_on_ssl_socket(timeout, ssl_error);
-    errata.note(std::move(poll_errata));
-    if (!errata.is_ok()) {
-      errata.error(R"(Failed SSL_read for HTTP/2 responses during poll: {}.)", swoc::bwf::Errno{});
-      return -1;
-    } else if (poll_return < 0) {
-      session_data->close();
-      errata.error("Socket closed while polling for an HTTP/2 response.");
-      return -1;
-    } else if (poll_return == 0) {
-      // Timeout in this context is OK.
-      return 0;
-    }
-    // Poll succeeded. Repeat the attempt to read.
-    n = SSL_read(session_data->get_ssl(), buffer, sizeof(buffer));
-  }
-  if (n <= 0) {
-    auto const ssl_error = SSL_get_error(session_data->get_ssl(), n);
-    if (ssl_error == SSL_ERROR_WANT_READ || ssl_error == SSL_ERROR_WANT_WRITE) {
-      // SSL just wants more data. Not a problem.
-      return 0;
-    } else {
-      // Assume there was an issue.
-      errata.error("SSL_read error in receive_nghttp2_data: {}", swoc::bwf::SSLError{ssl_error});
-      return -1;
-    }
+  auto &&[n, receive_errata] = session_data->receive_frames({buffer, sizeof(buffer)}, timeout);
+  errata.note(std::move(receive_errata));
+  if (n < 0) {
+    errata.error("Failed to receive HTTP/2 responses.");
+    return -1;
+  } else if (n == 0) {
+    // Timeout in this context is OK.
+    return 0;
   }
 
   // n > 0: Some bytes have been read. Pass that into the nghttp2 system.
-  int rv = nghttp2_session_mem_recv(session_data->get_session(), buffer, (size_t)n);
+  int rv = nghttp2_session_mem_recv(session_data->get_session(), (uint8_t *)buffer, (size_t)n);
   if (rv < 0) {
     errata.error(
         "nghttp2_session_mem_recv failed for HTTP/2 responses: {}",
@@ -561,36 +873,24 @@ receive_nghttp2_request(
 {
   H2Session *session_data = reinterpret_cast<H2Session *>(user_data);
   Errata errata;
-  unsigned char buffer[10 * 1024];
+  char buffer[10 * 1024];
   int total_recv = 0;
 
   auto const start_time = ClockType::now();
   while (session_data->get_is_server() && !session_data->get_a_stream_has_ended()) {
-    if (start_time - ClockType::now() > timeout) {
+    if (ClockType::now() - start_time > timeout) {
       return 0;
     }
-    int n = SSL_read(session_data->get_ssl(), buffer, sizeof(buffer));
-    while (n <= 0) {
-      auto const ssl_error = SSL_get_error(session_data->get_ssl(), n);
-      auto &&[poll_return, poll_errata] =
-          session_data->poll_for_data_on_ssl_socket(timeout, ssl_error);
-      errata.note(std::move(poll_errata));
-      if (!errata.is_ok()) {
-        errata.error(
-            R"(Failed SSL_read for HTTP/2 request headers during poll: {}.)",
-            swoc::bwf::Errno{});
-        return (ssize_t)total_recv;
-      } else if (poll_return < 0) {
-        session_data->close();
-        return (ssize_t)total_recv;
-      } else if (poll_return == 0) {
-        errata.error("Timed out waiting to SSL_read for HTTP/2 request headers after {}.", timeout);
-        return (ssize_t)total_recv;
-      }
-      // Poll succeeded. Repeat the attempt to read.
-      n = SSL_read(session_data->get_ssl(), buffer, sizeof(buffer));
+    auto &&[n, receive_errata] = session_data->receive_frames({buffer, sizeof(buffer)}, timeout);
+    errata.note(std::move(receive_errata));
+    if (n < 0) {
+      errata.error("Failed to receive HTTP/2 request headers.");
+      return (ssize_t)total_recv;
+    } else if (n == 0) {
+      errata.error("Timed out waiting for HTTP/2 request headers after {}.", timeout);
+      return (ssize_t)total_recv;
     }
-    int rv = nghttp2_session_mem_recv(session, buffer, (size_t)n);
+    int rv = nghttp2_session_mem_recv(session, (uint8_t *)buffer, (size_t)n);
     if (rv < 0) {
       errata.error(
           "nghttp2_session_mem_recv failed for response headers: {}",
@@ -603,15 +903,33 @@ receive_nghttp2_request(
     // opportunity to send any frames like the window_update frame
     send_nghttp2_data(session, nullptr, 0, 0, user_data);
   }
+  // Take in whatever else has already arrived, without waiting for more, so
+  // that any other streams it ends are ready to be served together with this
+  // one.
+  while (session_data->get_is_server() && total_recv > 0) {
+    auto &&[n, receive_errata] = session_data->receive_frames({buffer, sizeof(buffer)}, 0ms);
+    errata.note(std::move(receive_errata));
+    if (n <= 0) {
+      break;
+    }
+    int const rv = nghttp2_session_mem_recv(session, (uint8_t *)buffer, (size_t)n);
+    if (rv < 0) {
+      errata.error(
+          "nghttp2_session_mem_recv failed for request headers: {}",
+          nghttp2_strerror((int)rv));
+      return -1;
+    }
+    total_recv += rv;
+    send_nghttp2_data(session, nullptr, 0, 0, user_data);
+  }
   return (ssize_t)total_recv;
 }
 
 static int
-on_frame_send_cb(
-    nghttp2_session * /* session */,
-    nghttp2_frame const * /* frame */,
-    void * /* user_data */)
+on_frame_send_cb(nghttp2_session * /* session */, nghttp2_frame const *frame, void *user_data)
 {
+  auto *session_data = reinterpret_cast<H2Session *>(user_data);
+  session_data->count_frame_sent(*frame);
   return 0;
 }
 
@@ -648,13 +966,13 @@ on_frame_recv_cb(nghttp2_session * /* session */, nghttp2_frame const *frame, vo
   if (flags & NGHTTP2_FLAG_END_HEADERS || flags & NGHTTP2_FLAG_END_STREAM) {
     auto *session_data = reinterpret_cast<H2Session *>(user_data);
     auto const stream_id = frame->hd.stream_id;
-    auto stream_map_iter = session_data->_stream_map.find(stream_id);
-    if (stream_map_iter == session_data->_stream_map.end()) {
+    auto *stream_state_ptr = session_data->_stream_map.find(stream_id);
+    if (stream_state_ptr == nullptr) {
       // Nothing to do if this is not in our stream map.
       return 0;
     }
     if (flags & NGHTTP2_FLAG_END_HEADERS) {
-      H2StreamState &stream_state = *stream_map_iter->second;
+      H2StreamState &stream_state = *stream_state_ptr;
       int const headers_category = frame->headers.cat;
       if (headers_category == NGHTTP2_HCAT_REQUEST) {
         auto &request_from_client = *stream_state._request_from_client;
@@ -735,14 +1053,14 @@ on_stream_close_cb(
   Errata errata;
   errata.diag("HTTP/2 stream is closed with id: {}", stream_id);
   H2Session *session_data = reinterpret_cast<H2Session *>(user_data);
-  auto iter = session_data->_stream_map.find(stream_id);
-  if (iter == session_data->_stream_map.end()) {
+  auto *stream_state_ptr = session_data->_stream_map.find(stream_id);
+  if (stream_state_ptr == nullptr) {
     errata.error(
         "HTTP/2 stream is closed with id {} but could not find it tracked internally",
         stream_id);
     return 0;
   }
-  H2StreamState &stream_state = *iter->second;
+  H2StreamState &stream_state = *stream_state_ptr;
   auto const &message_start = stream_state._stream_start;
   auto const message_end = ClockType::now();
   auto const elapsed_ms = duration_cast<chrono::milliseconds>(message_end - message_start);
@@ -753,7 +1071,16 @@ on_stream_close_cb(
         stream_state._key,
         elapsed_ms);
   }
-  session_data->_stream_map.erase(iter);
+  if (stream_state._queue_delay > ClockType::duration::zero()) {
+    errata.diag(
+        R"(HTTP/2 transaction in stream id {} with key {} waited {} for a stream slot.)",
+        stream_id,
+        stream_state._key,
+        duration_cast<chrono::microseconds>(stream_state._queue_delay));
+  }
+  session_data->record_transaction_latency(
+      duration_cast<chrono::microseconds>(message_end - message_start));
+  session_data->record_stream_closed(stream_id);
   return 0;
 }
 
@@ -768,12 +1095,12 @@ on_data_chunk_recv_cb(
 {
   Errata errata;
   auto *session_data = reinterpret_cast<H2Session *>(user_data);
-  auto iter = session_data->_stream_map.find(stream_id);
-  if (iter == session_data->_stream_map.end()) {
+  auto *stream_state_ptr = session_data->_stream_map.find(stream_id);
+  if (stream_state_ptr == nullptr) {
     errata.error("Could not find a stream with stream id: {}", stream_id);
     return 0;
   }
-  H2StreamState &stream_state = *iter->second;
+  H2StreamState &stream_state = *stream_state_ptr;
   errata.diag(
       "Drained HTTP/2 body for transaction with key: {}, stream id: {} "
       "of {} bytes with content: {}",
@@ -798,14 +1125,45 @@ H2StreamState::~H2StreamState()
   for (auto rcbuf : _rcbufs_to_free) {
     nghttp2_rcbuf_decref(rcbuf);
   }
-  if (_request_nv_headers) {
-    free(_request_nv_headers);
-    _request_nv_headers = nullptr;
+}
+
+void
+H2StreamState::reset()
+{
+  _stream_start = ClockType::now();
+  _stream_id = -1;
+}
+
+void
+H2StreamState::clear()
+{
+  for (auto rcbuf : _rcbufs_to_free) {
+    nghttp2_rcbuf_decref(rcbuf);
+  }
+  _rcbufs_to_free.clear();
+  _body_to_send = nullptr;
+  _send_body_length = 0;
+  _send_body_offset = 0;
+  _wait_for_continue = false;
+  _key.clear();
+  _composed_url.clear();
+  _queue_delay = std::chrono::system_clock::duration{0};
+  _specified_response = nullptr;
+  _rendered_values.clear();
+  // A server hands the request headers to its caller, which may still refer
+  // to them. Such headers are left to the caller rather than reused.
+  if (_request_from_client.use_count() == 1) {
+    _request_from_client->clear();
+  } else {
+    _request_from_client = std::make_shared<HttpHeader>();
   }
-  if (_response_nv_headers) {
-    free(_response_nv_headers);
-    _response_nv_headers = nullptr;
+  _request_from_client->set_is_request(HTTP_PROTOCOL_TYPE::HTTP_2);
+  if (_response_from_server.use_count() == 1) {
+    _response_from_server->clear();
+  } else {
+    _response_from_server = std::make_shared<HttpHeader>();
   }
+  _response_from_server->set_is_response(HTTP_PROTOCOL_TYPE::HTTP_2);
 }
 
 void
@@ -826,18 +1184,6 @@ H2StreamState::get_stream_id() const
   return _stream_id;
 }
 
-void
-H2StreamState::store_nv_response_headers_to_free(nghttp2_nv *hdrs)
-{
-  _response_nv_headers = hdrs;
-}
-
-void
-H2StreamState::store_nv_request_headers_to_free(nghttp2_nv *hdrs)
-{
-  _request_nv_headers = hdrs;
-}
-
 TextView
 H2StreamState::register_rcbuf(nghttp2_rcbuf *rcbuf)
 {
@@ -859,6 +1205,14 @@ H2Session::H2Session(TextView const &client_sni, int client_verify_mode)
 
 H2Session::~H2Session()
 {
+  if (_frames_sent > 0) {
+    Errata errata;
+    errata.diag(
+        "HTTP/2 session sent {} frames in {} writes for {} streams.",
+        _frames_sent,
+        _frame_writes,
+        _streams_sent);
+  }
   // This is safe to call upon a nullptr. Thus this is appropriate to be called
   // even if client_session_init or server_session_init has not been called.
   nghttp2_session_callbacks_del(_callbacks);
@@ -878,51 +1232,237 @@ H2Session::read(swoc::MemSpan<char> span)
 swoc::Rv<ssize_t>
 H2Session::write(TextView data)
 {
+  if (_is_cleartext) {
+    return Session::write(data);
+  }
   return TLSSession::write(data);
 }
 
+swoc::Rv<ssize_t>
+H2Session::writev(swoc::MemSpan<iovec> iov)
+{
+  if (_is_cleartext) {
+    return Session::writev(iov);
+  }
+  return TLSSession::writev(iov);
+}
+
+ssize_t
+H2Session::read_some(swoc::MemSpan<char> span)
+{
+  if (_is_cleartext) {
+    ssize_t n = 0;
+    do {
+      // A signal interrupting the read is not a connection error: retry.
+      n = ::read(get_fd(), span.data(), span.size());
+    } while (n < 0 && errno == EINTR);
+    return n;
+  }
+  if (!_early_data_received.empty()) {
+    return static_cast<ssize_t>(take_early_data(span));
+  }
+  return SSL_read(_ssl, span.data(), span.size());
+}
+
+swoc::Rv<short>
+H2Session::get_events_to_await(ssize_t read_result)
+{
+  swoc::Rv<short> zret{0};
+  if (_is_cleartext) {
+    if (read_result == 0 || errno == ECONNRESET) {
+      zret.diag("The peer closed the HTTP/2 connection.");
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      zret = POLLIN;
+    } else {
+      zret.error("Error reading HTTP/2 frames: {}", swoc::bwf::Errno{});
+    }
+    return zret;
+  }
+  auto const ssl_error = SSL_get_error(_ssl, read_result);
+  if (ssl_error == SSL_ERROR_WANT_READ) {
+    zret = POLLIN;
+  } else if (ssl_error == SSL_ERROR_WANT_WRITE) {
+    zret = POLLOUT;
+  } else if (ssl_error == SSL_ERROR_ZERO_RETURN || ssl_error == SSL_ERROR_SYSCALL) {
+    zret.diag("The peer closed the HTTP/2 TLS connection.");
+  } else {
+    zret.error("SSL_read error reading HTTP/2 frames: {}", swoc::bwf::SSLError{ssl_error});
+  }
+  return zret;
+}
+
+swoc::Rv<ssize_t>
+H2Session::receive_frames(swoc::MemSpan<char> span, milliseconds timeout)
+{
+  swoc::Rv<ssize_t> zret{-1};
+  if (is_closed()) {
+    zret.diag("Receive called on a closed HTTP/2 connection.");
+    return zret;
+  }
+  if (early_data_is_pending()) {
+    zret.note(complete_early_data());
+    if (!zret.is_ok() || is_closed()) {
+      return zret;
+    }
+  }
+  auto n = read_some(span);
+  if (n > 0) {
+    zret = n;
+    return zret;
+  }
+  auto &&[events, events_errata] = get_events_to_await(n);
+  zret.note(std::move(events_errata));
+  if (events == 0) {
+    close();
+    return zret;
+  }
+  auto &&[poll_return, poll_errata] = poll_for_data_on_socket(timeout, events);
+  zret.note(std::move(poll_errata));
+  if (!zret.is_ok()) {
+    zret.error(R"(Failed to poll for HTTP/2 frames: {}.)", swoc::bwf::Errno{});
+    return zret;
+  } else if (poll_return < 0) {
+    close();
+    return zret;
+  } else if (poll_return == 0) {
+    zret = 0;
+    return zret;
+  }
+  // Poll succeeded. Repeat the attempt to read.
+  n = read_some(span);
+  if (n > 0) {
+    zret = n;
+    return zret;
+  }
+  auto &&[retry_events, retry_errata] = get_events_to_await(n);
+  zret.note(std::move(retry_errata));
+  if (retry_events != 0) {
+    // The TLS layer just wants more data. Not a problem.
+    zret = 0;
+  } else {
+    close();
+  }
+  return zret;
+}
+
+/** Find the state of the stream for which nghttp2 is sending DATA.
+ *
+ * @return The stream state, or nullptr if there is no such stream.
+ */
+static H2StreamState *
+find_sending_stream_state(nghttp2_session *session, int32_t stream_id, void *user_data)
+{
+  auto *stream_state =
+      reinterpret_cast<H2StreamState *>(nghttp2_session_get_stream_user_data(session, stream_id));
+  if (stream_state == nullptr) {
+    auto *session_data = reinterpret_cast<H2Session *>(user_data);
+    stream_state = session_data->_stream_map.find(stream_id);
+  }
+  return stream_state;
+}
+
+/* nghttp2_data_source_read_callback. The body is not copied into nghttp2's
+ * frame buffer here: this only reports how much of it goes into the next DATA
+ * frame, which send_data_callback then writes from the body itself. */
 ssize_t
 data_read_callback(
     nghttp2_session *session,
     int32_t stream_id,
-    uint8_t *buf,
+    uint8_t * /* buf */,
     size_t length,
     uint32_t *data_flags,
     nghttp2_data_source * /* source */,
     void *user_data)
 {
   Errata errata;
-  size_t num_to_copy = 0;
-  H2StreamState *stream_state =
-      reinterpret_cast<H2StreamState *>(nghttp2_session_get_stream_user_data(session, stream_id));
+  size_t num_to_send = 0;
+  H2StreamState *stream_state = find_sending_stream_state(session, stream_id, user_data);
   if (stream_state == nullptr) {
-    auto *session_data = reinterpret_cast<H2Session *>(user_data);
-    auto iter = session_data->_stream_map.find(stream_id);
-    if (iter == session_data->_stream_map.end()) {
-      errata.error("Could not find a stream with stream id: {}", stream_id);
-      return 0;
-    }
-    stream_state = iter->second.get();
+    errata.error("Could not find a stream with stream id: {}", stream_id);
+    return 0;
   }
   if (!stream_state->_wait_for_continue) {
-    num_to_copy =
+    num_to_send =
         std::min(length, stream_state->_send_body_length - stream_state->_send_body_offset);
-    if (num_to_copy > 0) {
-      memcpy(buf, stream_state->_body_to_send + stream_state->_send_body_offset, num_to_copy);
-      stream_state->_send_body_offset += num_to_copy;
-    } else {
-      num_to_copy = 0;
-    }
-    if (stream_state->_send_body_offset >= stream_state->_send_body_length) {
+    *data_flags |= NGHTTP2_DATA_FLAG_NO_COPY;
+    if (stream_state->_send_body_offset + num_to_send >= stream_state->_send_body_length) {
       *data_flags |= NGHTTP2_DATA_FLAG_EOF;
     }
   }
-  errata.diag("Writing a {} byte body for stream id: {}", num_to_copy, stream_id);
-  return num_to_copy;
+  errata.diag("Writing a {} byte body for stream id: {}", num_to_send, stream_id);
+  return num_to_send;
+}
+
+/// The size of an HTTP/2 frame header, as passed to send_data_callback.
+static constexpr size_t H2_FRAME_HEADER_SIZE = 9;
+
+/* nghttp2_send_data_callback. Write a DATA frame whose payload is the next
+ * length bytes of the stream's body. The frame header and the body are handed
+ * to writev in place, so the body reaches the TLS layer without being copied
+ * by nghttp2 first. */
+static int
+send_data_callback(
+    nghttp2_session *session,
+    nghttp2_frame *frame,
+    uint8_t const *framehd,
+    size_t length,
+    nghttp2_data_source * /* source */,
+    void *user_data)
+{
+  Errata errata;
+  auto const stream_id = frame->hd.stream_id;
+  H2StreamState *stream_state = find_sending_stream_state(session, stream_id, user_data);
+  if (stream_state == nullptr) {
+    errata.error("Could not find a stream with stream id: {}", stream_id);
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+  // We do not select padding, but if the frame is padded then its pad length
+  // field precedes the payload and the (zero) padding follows it.
+  static uint8_t const PADDING[256] = {0};
+  uint8_t const pad_length = frame->data.padlen > 0 ? frame->data.padlen - 1 : 0;
+  auto const *body = stream_state->_body_to_send + stream_state->_send_body_offset;
+  iovec iov[4];
+  size_t iov_count = 0;
+  iov[iov_count++] = {const_cast<uint8_t *>(framehd), H2_FRAME_HEADER_SIZE};
+  if (frame->data.padlen > 0) {
+    iov[iov_count++] = {const_cast<uint8_t *>(&pad_length), 1};
+  }
+  iov[iov_count++] = {const_cast<char *>(body), length};
+  if (pad_length > 0) {
+    iov[iov_count++] = {const_cast<uint8_t *>(PADDING), pad_length};
+  }
+  size_t const frame_size = H2_FRAME_HEADER_SIZE + frame->data.padlen + length;
+
+  // Any frames buffered ahead of this one go out in the same write.
+  auto *session_data = reinterpret_cast<H2Session *>(user_data);
+  auto &&[bytes_written, write_errata] = session_data->write_frames({iov, iov_count});
+  errata.note(std::move(write_errata));
+  if (bytes_written < static_cast<ssize_t>(frame_size)) {
+    errata.error(
+        "Failed to write an HTTP/2 DATA frame for stream id {}: {} of {} bytes written.",
+        stream_id,
+        bytes_written,
+        frame_size);
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+  stream_state->_send_body_offset += length;
+  return 0;
 }
 
 swoc::Rv<ssize_t>
 H2Session::write(HttpHeader const &hdr)
+{
+  return submit_message(hdr, hdr._stream_id);
+}
+
+swoc::Rv<ssize_t>
+H2Session::write_response(HttpHeader const &hdr, int64_t stream_id)
+{
+  return submit_message(hdr, static_cast<int32_t>(stream_id));
+}
+
+swoc::Rv<ssize_t>
+H2Session::submit_message(HttpHeader const &hdr, int32_t response_stream_id)
 {
   if (!_h2_is_negotiated) {
     return Session::write(hdr);
@@ -931,18 +1471,15 @@ H2Session::write(HttpHeader const &hdr)
   int32_t stream_id = 0;
   int32_t submit_result = 0;
   H2StreamState *stream_state = nullptr;
-  std::shared_ptr<H2StreamState> new_stream_state{nullptr};
   if (hdr.is_response()) {
-    stream_id = hdr._stream_id;
-    auto stream_map_iter = _stream_map.find(stream_id);
-    if (stream_map_iter == _stream_map.end()) {
+    stream_id = response_stream_id;
+    stream_state = _stream_map.find(stream_id);
+    if (stream_state == nullptr) {
       zret.error("Could not find registered stream for stream id: {}", stream_id);
       return zret;
     }
-    stream_state = stream_map_iter->second.get();
   } else {
-    new_stream_state = std::make_shared<H2StreamState>();
-    stream_state = new_stream_state.get();
+    stream_state = new_stream_state();
   }
 
   // grab header, send to session
@@ -950,11 +1487,7 @@ H2Session::write(HttpHeader const &hdr)
   int hdr_count = 0;
   nghttp2_nv *hdrs = nullptr;
   pack_headers(hdr, hdrs, hdr_count);
-  if (hdr.is_response()) {
-    stream_state->store_nv_response_headers_to_free(hdrs);
-  } else {
-    stream_state->store_nv_request_headers_to_free(hdrs);
-  }
+  hdr.render_templates(hdrs, hdr_count, stream_state->_rendered_values, _template_context);
 
   stream_state->_key = hdr.get_key();
   if (hdr._content_size > 0 && (hdr.is_request() || !HttpHeader::STATUS_NO_CONTENT[hdr._status])) {
@@ -1010,17 +1543,22 @@ H2Session::write(HttpHeader const &hdr)
   } else { // request
     if (submit_result < 0) {
       zret.error("Submitting an HTTP/2 request failed: {}", submit_result);
+      _stream_states.release(stream_state);
     } else {
       stream_id = submit_result;
       stream_state->set_stream_id(stream_id);
-      record_stream_state(stream_id, new_stream_state);
+      record_stream_state(stream_id, stream_state);
     }
     // TODO: Move this up to when submit succeeded?
     zret.diag("Sent the following HTTP/2 headers for stream id {}:\n{}", stream_id, hdr);
   }
 
-  // Kick off the send logic to put the data on the wire
-  zret.result() = send_nghttp2_data(_session, nullptr, 0, 0, this);
+  // Kick off the send logic to put the data on the wire. While output is
+  // held, the frames are left with nghttp2 so that those of the other
+  // submitted streams are interleaved with them by flush_output.
+  if (!_hold_output) {
+    zret.result() = send_nghttp2_data(_session, nullptr, 0, 0, this);
+  }
 
   return zret;
 }
@@ -1047,7 +1585,8 @@ H2Session::pack_headers(HttpHeader const &hdr, nghttp2_nv *&nv_hdr, int &hdr_cou
     }
   }
 
-  nv_hdr = reinterpret_cast<nghttp2_nv *>(malloc(sizeof(nghttp2_nv) * hdr_count));
+  _nv_buffer.resize(hdr_count);
+  nv_hdr = _nv_buffer.data();
   int offset = 0;
 
   // nghttp2 requires pseudo header fields to be at the start of the
@@ -1086,23 +1625,171 @@ H2Session::tv_to_nv(char const *name, TextView v)
   return res;
 }
 
+/// The bounds RFC 7540 places on SETTINGS_MAX_FRAME_SIZE.
+static constexpr uint32_t SMALLEST_MAX_FRAME_SIZE = 1 << 14;
+static constexpr uint32_t LARGEST_MAX_FRAME_SIZE = (1 << 24) - 1;
+
+swoc::Errata
+H2Settings::set(TextView name, TextView value)
+{
+  swoc::Errata errata;
+  TextView parsed;
+  auto const n = swoc::svtou(value, &parsed);
+  if (value.empty() || parsed.size() != value.size() || n > std::numeric_limits<uint32_t>::max())
+  {
+    errata.error(R"(HTTP/2 setting "{}" has an invalid value "{}".)", name, value);
+    return errata;
+  }
+  auto const setting = static_cast<uint32_t>(n);
+  if (name == MAX_CONCURRENT_STREAMS) {
+    _max_concurrent_streams = setting;
+  } else if (name == HEADER_TABLE_SIZE) {
+    _header_table_size = setting;
+  } else if (name == INITIAL_WINDOW_SIZE || name == CONNECTION_WINDOW_SIZE) {
+    if (setting > static_cast<uint32_t>(NGHTTP2_MAX_WINDOW_SIZE)) {
+      errata.error(
+          R"(HTTP/2 setting "{}" value {} exceeds the maximum window size of {}.)",
+          name,
+          setting,
+          NGHTTP2_MAX_WINDOW_SIZE);
+    } else if (name == INITIAL_WINDOW_SIZE) {
+      _initial_window_size = setting;
+    } else {
+      _connection_window_size = setting;
+    }
+  } else if (name == MAX_FRAME_SIZE) {
+    if (setting < SMALLEST_MAX_FRAME_SIZE || setting > LARGEST_MAX_FRAME_SIZE) {
+      errata.error(
+          R"(HTTP/2 setting "{}" value {} is not between {} and {}.)",
+          name,
+          setting,
+          SMALLEST_MAX_FRAME_SIZE,
+          LARGEST_MAX_FRAME_SIZE);
+    } else {
+      _max_frame_size = setting;
+    }
+  } else {
+    errata.error(R"(Unknown HTTP/2 setting "{}".)", name);
+  }
+  return errata;
+}
+
+swoc::Errata
+H2Settings::parse(TextView description)
+{
+  swoc::Errata errata;
+  while (description) {
+    auto value = description.take_prefix_at(',').trim_if(&isspace);
+    if (value.empty()) {
+      continue;
+    }
+    auto const name = value.take_prefix_at('=').trim_if(&isspace);
+    errata.note(this->set(name, value.trim_if(&isspace)));
+  }
+  return errata;
+}
+
+void
+H2Settings::merge(H2Settings const &defaults)
+{
+  if (!_max_concurrent_streams) {
+    _max_concurrent_streams = defaults._max_concurrent_streams;
+  }
+  if (!_initial_window_size) {
+    _initial_window_size = defaults._initial_window_size;
+  }
+  if (!_max_frame_size) {
+    _max_frame_size = defaults._max_frame_size;
+  }
+  if (!_header_table_size) {
+    _header_table_size = defaults._header_table_size;
+  }
+  if (!_connection_window_size) {
+    _connection_window_size = defaults._connection_window_size;
+  }
+}
+
 SSL_CTX *H2Session::h2_client_context = nullptr;
 
+H2Settings H2Session::_default_settings;
+std::unordered_map<std::string, H2Settings> H2Session::_settings_per_sni;
+
+/// The SETTINGS_MAX_CONCURRENT_STREAMS value if none is configured.
+static constexpr uint32_t DEFAULT_MAX_CONCURRENT_STREAMS = 100;
+
 Errata
 H2Session::send_connection_settings()
 {
   Errata errata;
-  nghttp2_settings_entry iv[1] = {{NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100}};
+  auto settings = _settings;
+  settings.merge(_default_settings);
+
+  nghttp2_settings_entry iv[4];
+  size_t num_settings = 0;
+  iv[num_settings++] = {
+      NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS,
+      settings._max_concurrent_streams.value_or(DEFAULT_MAX_CONCURRENT_STREAMS)};
+  if (settings._initial_window_size) {
+    iv[num_settings++] = {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, *settings._initial_window_size};
+  }
+  if (settings._max_frame_size) {
+    iv[num_settings++] = {NGHTTP2_SETTINGS_MAX_FRAME_SIZE, *settings._max_frame_size};
+  }
+  if (settings._header_table_size) {
+    iv[num_settings++] = {NGHTTP2_SETTINGS_HEADER_TABLE_SIZE, *settings._header_table_size};
+  }
   int rv = 0;
 
   /* client 24 bytes magic string will be sent by nghttp2 library */
-  rv = nghttp2_submit_settings(this->_session, NGHTTP2_FLAG_NONE, iv, 1);
+  rv = nghttp2_submit_settings(this->_session, NGHTTP2_FLAG_NONE, iv, num_settings);
   if (rv != 0) {
     errata.error(R"(Could not submit SETTINGS)");
   }
+  if (settings._connection_window_size) {
+    // This queues the WINDOW_UPDATE which enlarges the connection window.
+    rv = nghttp2_session_set_local_window_size(
+        this->_session,
+        NGHTTP2_FLAG_NONE,
+        0,
+        static_cast<int32_t>(*settings._connection_window_size));
+    if (rv != 0) {
+      errata.error(
+          R"(Could not set the HTTP/2 connection window size to {}: {})",
+          *settings._connection_window_size,
+          nghttp2_strerror(rv));
+    }
+  }
   return errata;
 }
 
+void
+H2Session::set_settings(H2Settings const &settings)
+{
+  _settings = settings;
+}
+
+// static
+void
+H2Session::set_default_settings(H2Settings const &settings)
+{
+  _default_settings = settings;
+}
+
+// static
+void
+H2Session::register_settings_for_sni(std::string_view sni, H2Settings const &settings)
+{
+  _settings_per_sni[std::string{sni}] = settings;
+}
+
+// static
+Errata
+H2Session::init_cleartext(int *process_exit_code)
+{
+  H2Session::process_exit_code = process_exit_code;
+  return {};
+}
+
 // static
 Errata
 H2Session::init(int *process_exit_code)
@@ -1148,6 +1835,7 @@ H2Session::client_init(SSL_CTX *&client_context)
   if (TLSSession::tls_secrets_are_being_logged()) {
     SSL_CTX_set_keylog_callback(client_context, TLSSession::keylog_callback);
   }
+  TLSSessionCache::configure_context(client_context);
 
   return errata;
 }
@@ -1186,6 +1874,9 @@ Errata
 H2Session::client_session_init()
 {
   Errata errata;
+  // The streams of any previous connection are gone with it.
+  _open_streams = 0;
+  ++_connection_count;
 
   // Set up the H2 callback methods
   int ret = nghttp2_session_callbacks_new(&this->_callbacks);
@@ -1216,6 +1907,7 @@ H2Session::client_session_init()
   nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
       this->_callbacks,
       on_data_chunk_recv_cb);
+  nghttp2_session_callbacks_set_send_data_callback(this->_callbacks, send_data_callback);
 
   nghttp2_session_client_new(&this->_session, this->_callbacks, this);
 
@@ -1262,6 +1954,7 @@ H2Session::server_session_init()
   nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
       this->_callbacks,
       on_data_chunk_recv_cb);
+  nghttp2_session_callbacks_set_send_data_callback(this->_callbacks, send_data_callback);
 
   ret = nghttp2_session_server_new(&this->_session, this->_callbacks, this);
   if (0 != ret) {
@@ -1271,3 +1964,103 @@ H2Session::server_session_init()
 
   return errata;
 }
+
+// static
+void
+H2ConnectionPool::set_stream_limit(unsigned stream_limit)
+{
+  _stream_limit = stream_limit;
+}
+
+// static
+bool
+H2ConnectionPool::is_enabled()
+{
+  return _stream_limit > 0;
+}
+
+// static
+std::pair<H2ConnectionPool::Connection *, bool>
+H2ConnectionPool::lease(
+    std::string const &key,
+    std::string_view client_sni,
+    int client_verify_mode,
+    bool is_cleartext,
+    H2Settings const &settings)
+{
+  std::lock_guard<std::mutex> lock{_pool_mutex};
+  auto &connections = _connections[key];
+  Connection *least_leased = nullptr;
+  for (auto &connection : connections) {
+    if (least_leased == nullptr || connection._leases < least_leased->_leases) {
+      least_leased = &connection;
+    }
+  }
+  bool const is_new = least_leased == nullptr || least_leased->_leases >= _stream_limit;
+  if (is_new) {
+    // Make the session before releasing _pool_mutex, so other leases never
+    // see the connection without one.
+    auto session = std::make_unique<H2Session>(client_sni, client_verify_mode);
+    session->set_is_cleartext(is_cleartext);
+    session->set_settings(settings);
+    session->set_stream_limit(_stream_limit);
+    least_leased = &connections.emplace_back();
+    least_leased->_session = std::move(session);
+  }
+  ++least_leased->_leases;
+  return {least_leased, is_new};
+}
+
+// static
+void
+H2ConnectionPool::release(Connection *connection)
+{
+  std::lock_guard<std::mutex> lock{_pool_mutex};
+  --connection->_leases;
+}
+
+// static
+Errata
+H2ConnectionPool::run_transactions(
+    std::string_view client_sni,
+    int client_verify_mode,
+    bool is_cleartext,
+    H2Settings const &settings,
+    std::list<Txn> const &txn_list,
+    TemplateContext const &template_context,
+    swoc::TextView interface,
+    swoc::IPEndpoint const *real_target,
+    double rate_multiplier)
+{
+  Errata errata;
+  std::string key;
+  swoc::bwprint(key, "{}/{}/{}", *real_target, client_sni, is_cleartext ? "h2c" : "h2");
+  auto [connection, is_new] = lease(key, client_sni, client_verify_mode, is_cleartext, settings);
+  if (is_new) {
+    errata.diag("Opening a pooled HTTP/2 connection for {}.", key);
+  }
+  // The session connects, once no other session has streams in flight on a
+  // closed connection, when it submits its first transaction.
+  errata.note(connection->_session->run_shared_transactions(
+      txn_list,
+      template_context,
+      connection->_mutex,
+      interface,
+      real_target,
+      rate_multiplier));
+  release(connection);
+  return errata;
+}
+
+// static
+void
+H2ConnectionPool::terminate()
+{
+  std::lock_guard<std::mutex> lock{_pool_mutex};
+  _connections.clear();
+}
+
+std::mutex H2ConnectionPool::_pool_mutex;
+std::unordered_map<std::string, std::list<H2ConnectionPool::Connection>>
+    H2ConnectionPool::_connections;
+unsigned H2ConnectionPool::_stream_limit = 0;
@@ -9,12 +9,14 @@
 #include "core/https.h"
 #include "core/ProxyVerifier.h"
 
+#include <algorithm>
 #include <cassert>
 #include <filesystem>
 #include <fcntl.h>
 #include <ngtcp2/ngtcp2_crypto.h>
 #include <ngtcp2/ngtcp2_crypto_openssl.h>
 #include <netdb.h>
+#include <sys/socket.h>
 
 #include "swoc/bwf_ex.h"
 #include "swoc/bwf_ip.h"
@@ -53,9 +55,24 @@ using chrono::nanoseconds;
 constexpr auto QUIC_MAX_STREAMS = 256 * 1024;
 constexpr auto QUIC_MAX_DATA = 1 * 1024 * 1024;
 constexpr auto QUIC_IDLE_TIMEOUT = 60s;
+/// The most datagrams moved by a single recvmmsg or sendmmsg call.
+constexpr size_t QUIC_DATAGRAM_BATCH_SIZE = 16;
+/// The largest UDP payload we receive, advertised as max_udp_payload_size.
+constexpr size_t QUIC_MAX_RECV_UDP_PAYLOAD_SIZE = QuicDatagram::max_payload_size;
+/** The number of request streams a client may open at once to the server.
+ * Each closed stream is replaced with another. */
+constexpr auto QUIC_SERVER_MAX_STREAMS_BIDI = 100;
+/// The smallest max_udp_payload_size QUIC allows.
+constexpr uint64_t QUIC_MIN_UDP_PAYLOAD_SIZE = 1200;
+/// How often a shared client socket's thread checks for shutdown.
+constexpr auto QUIC_CLIENT_SOCKET_POLL_INTERVAL = 100ms;
+/// How much QUIC log data a connection collects before handing it off.
+constexpr size_t QLOG_BUFFER_SIZE = 64 * 1024;
 
 // TextView H3_ALPN_H3_29_H3 = "\x5h3-29\x2h3";
 TextView H3_ALPN_H3_29_H3 = "\x5h3-29";
+/// The protocols the server accepts, in order of preference.
+TextView H3_SERVER_ALPN = "\x2h3\x5h3-29";
 constexpr char const *QUIC_CIPHERS = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_"
                                      "POLY1305_SHA256:TLS_AES_128_CCM_SHA256";
 
@@ -67,7 +84,7 @@ std::random_device QuicSocket::_rd;
 std::mt19937 QuicSocket::_rng(_rd());
 std::uniform_int_distribution<int> QuicSocket::_uni_id(0, std::numeric_limits<uint8_t>::max());
 swoc::file::path QuicSocket::_qlog_dir;
-std::mutex QuicSocket::_qlog_mutex;
+std::mutex QuicSocket::_rng_mutex;
 
 namespace swoc
 {
@@ -242,6 +259,9 @@ timestamp()
   return duration_cast<nanoseconds>(duration_since_epoch).count();
 }
 
+/// @return 0 on success, 1 on failure.
+static int initialize_nghttp3_connection(H3Session *session);
+
 // --------------------------------------------
 // Begin ngtcp2 callbacks.
 // --------------------------------------------
@@ -250,6 +270,7 @@ cb_handshake_completed(ngtcp2_conn * /* tconn */, void * /* user_data */)
 {
   Errata errata;
   errata.diag(R"(h3 is negotiated.)");
+  TLSSession::flush_keylog();
   return 0;
 }
 
@@ -267,6 +288,14 @@ cb_recv_stream_data(
   H3Session *h3_session = reinterpret_cast<H3Session *>(conn_data);
   int fin = (flags & NGTCP2_STREAM_DATA_FLAG_FIN) ? 1 : 0;
 
+  // A server sets up HTTP/3 once the client starts sending on its streams,
+  // by which point the client's stream limits are known.
+  if (h3_session->quic_socket.h3conn == nullptr &&
+      initialize_nghttp3_connection(h3_session) != 0)
+  {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
   ssize_t nconsumed =
       nghttp3_conn_read_stream(h3_session->quic_socket.h3conn, stream_id, buf, buflen, fin);
   if (nconsumed < 0) {
@@ -325,6 +354,24 @@ cb_stream_close(
   return 0;
 }
 
+static int
+cb_server_stream_close(
+    ngtcp2_conn *tconn,
+    uint32_t flags,
+    int64_t stream_id,
+    uint64_t app_error_code,
+    void *conn_data,
+    void *stream_user_data)
+{
+  int const rv =
+      cb_stream_close(tconn, flags, stream_id, app_error_code, conn_data, stream_user_data);
+  if (rv == 0 && ngtcp2_is_bidi_stream(stream_id)) {
+    // Let the client open another request stream in place of this one.
+    ngtcp2_conn_extend_max_streams_bidi(tconn, 1);
+  }
+  return rv;
+}
+
 static void
 cb_rand(uint8_t *dest, size_t destlen, const ngtcp2_rand_ctx * /* rand_ctx */)
 {
@@ -337,11 +384,26 @@ cb_get_new_connection_id(
     ngtcp2_cid *cid,
     uint8_t *token,
     size_t cidlen,
-    void * /* user_data */)
+    void *user_data)
 {
   QuicSocket::randomly_populate_array(cid->data, cidlen);
   cid->datalen = cidlen;
   QuicSocket::randomly_populate_array(token, NGTCP2_STATELESS_RESET_TOKENLEN);
+  // The peer may address its packets to the new ID from now on.
+  auto *h3_session = reinterpret_cast<H3Session *>(user_data);
+  if (auto *connection = h3_session->shared_connection(); connection != nullptr) {
+    connection->add_connection_id(*cid);
+  }
+  return 0;
+}
+
+static int
+cb_remove_connection_id(ngtcp2_conn * /* tconn */, ngtcp2_cid const *cid, void *user_data)
+{
+  auto *h3_session = reinterpret_cast<H3Session *>(user_data);
+  if (auto *connection = h3_session->shared_connection(); connection != nullptr) {
+    connection->remove_connection_id(*cid);
+  }
   return 0;
 }
 
@@ -406,9 +468,6 @@ cb_extend_max_stream_data(
   return 0;
 }
 
-/// @return 0 on success, 1 on failure.
-static int initialize_nghttp3_connection(H3Session *session);
-
 static int
 quic_set_encryption_secrets(
     SSL *ssl,
@@ -441,7 +500,8 @@ quic_set_encryption_secrets(
           secretlen) != 0)
     return 0;
 
-  if (level == NGTCP2_CRYPTO_LEVEL_APPLICATION) {
+  // Servers wait for the client's streams. See cb_recv_stream_data.
+  if (level == NGTCP2_CRYPTO_LEVEL_APPLICATION && !h3_session->is_server()) {
     if (initialize_nghttp3_connection(h3_session) != 0) {
       return 0;
     }
@@ -531,7 +591,7 @@ static ngtcp2_callbacks client_ngtcp2_callbacks = {
     nullptr, /* extend_max_local_streams_uni */
     cb_rand,
     cb_get_new_connection_id,
-    nullptr,                     /* remove_connection_id */
+    cb_remove_connection_id,
     ngtcp2_crypto_update_key_cb, /* update_key */
     nullptr,                     /* path_validation */
     nullptr,                     /* select_preferred_addr */
@@ -551,124 +611,306 @@ static ngtcp2_callbacks client_ngtcp2_callbacks = {
     cb_stream_stop_sending,
 };
 
-// TODO: fill this out when we add server-side code.
-#if 0
 static ngtcp2_callbacks server_ngtcp2_callbacks = {
-  nullptr, /* client_initial */
-  ngtcp2_crypto_recv_client_initial_cb, /* recv_client_initial */
-  ngtcp2_crypto_recv_crypto_data_cb,
-  cb_handshake_completed,
-  nullptr, /* recv_version_negotiation */
-  ngtcp2_crypto_encrypt_cb,
-  ngtcp2_crypto_decrypt_cb,
-  ngtcp2_crypto_hp_mask_cb,
-  cb_recv_stream_data,
-  cb_acked_stream_data_offset,
-  nullptr, /* stream_open */
-  cb_stream_close,
-  nullptr, /* recv_stateless_reset */
-  ngtcp2_crypto_recv_retry_cb,
-  cb_extend_max_local_streams_bidi,
-  nullptr, /* extend_max_local_streams_uni */
-  cb_rand,
-  cb_get_new_connection_id,
-  nullptr, /* remove_connection_id */
-  ngtcp2_crypto_update_key_cb, /* update_key */
-  nullptr, /* path_validation */
-  nullptr, /* select_preferred_addr */
-  cb_stream_reset,
-  nullptr, /* extend_max_remote_streams_bidi */
-  nullptr, /* extend_max_remote_streams_uni */
-  cb_extend_max_stream_data,
-  nullptr, /* dcid_status */
-  nullptr, /* handshake_confirmed */
-  nullptr, /* recv_new_token */
-  ngtcp2_crypto_delete_crypto_aead_ctx_cb,
-  ngtcp2_crypto_delete_crypto_cipher_ctx_cb,
-  nullptr /* recv_datagram */
+    nullptr, /* client_initial */
+    ngtcp2_crypto_recv_client_initial_cb,
+    ngtcp2_crypto_recv_crypto_data_cb,
+    cb_handshake_completed,
+    nullptr, /* recv_version_negotiation */
+    ngtcp2_crypto_encrypt_cb,
+    ngtcp2_crypto_decrypt_cb,
+    ngtcp2_crypto_hp_mask_cb,
+    cb_recv_stream_data,
+    cb_acked_stream_data_offset,
+    nullptr, /* stream_open */
+    cb_server_stream_close,
+    nullptr, /* recv_stateless_reset */
+    nullptr, /* recv_retry */
+    nullptr, /* extend_max_local_streams_bidi */
+    nullptr, /* extend_max_local_streams_uni */
+    cb_rand,
+    cb_get_new_connection_id,
+    cb_remove_connection_id,
+    ngtcp2_crypto_update_key_cb, /* update_key */
+    nullptr,                     /* path_validation */
+    nullptr,                     /* select_preferred_addr */
+    cb_stream_reset,
+    nullptr, /* extend_max_remote_streams_bidi */
+    nullptr, /* extend_max_remote_streams_uni */
+    cb_extend_max_stream_data,
+    nullptr, /* dcid_status */
+    nullptr, /* handshake_confirmed */
+    nullptr, /* recv_new_token */
+    ngtcp2_crypto_delete_crypto_aead_ctx_cb,
+    ngtcp2_crypto_delete_crypto_cipher_ctx_cb,
+    nullptr, /* recv_datagram */
+    nullptr, /* ack_datagram */
+    nullptr, /* lost_datagram */
+    ngtcp2_crypto_get_path_challenge_data_cb,
+    cb_stream_stop_sending,
 };
-#endif
 
 // --------------------------------------------
 // End ngtcp2 callbacks.
 // --------------------------------------------
 
+/** Poll the session's socket after a batched UDP call reported EAGAIN.
+ *
+ * @param[in] session The session whose socket would block.
+ * @param[in] events POLLIN to wait for datagrams, POLLOUT to wait for send
+ * buffer space.
+ * @param[in] timeout How long to wait for the socket.
+ * @param[out] zret Collects the poll errata. On failure its result is set to
+ * the value the caller should return.
+ *
+ * @return True if the socket is ready and the call should be retried, false
+ * otherwise.
+ */
+static bool
+poll_udp_socket(H3Session &session, short events, milliseconds timeout, swoc::Rv<int> &zret)
+{
+  auto &&[poll_return, poll_errata] = session.poll_for_data_on_socket(timeout, events);
+  zret.note(std::move(poll_errata));
+  if (!zret.is_ok()) {
+    zret.error("Failed to poll on the HTTP/3 socket: {}", Errno{});
+    zret = -1;
+    return false;
+  } else if (poll_return > 0) {
+    return true;
+  } else if (poll_return == 0) {
+    zret.error("Poll timed out waiting on the HTTP/3 socket.");
+    zret = -1;
+    return false;
+  }
+  // Connection was closed. Nothing to do.
+  zret.diag("The peer closed the HTTP/3 connection during poll.");
+  zret = 0;
+  return false;
+}
+
+/** Pass a received datagram to ngtcp2.
+ *
+ * @return The number of bytes processed, 0 if the peer closed the connection,
+ * or -1 on error.
+ */
+static swoc::Rv<int>
+ngtcp2_read_packet(
+    H3Session &session,
+    sockaddr const *remote,
+    socklen_t remote_len,
+    uint8_t const *data,
+    size_t size,
+    ngtcp2_tstamp ts)
+{
+  swoc::Rv<int> zret{0};
+  auto &qs = session.quic_socket;
+  ngtcp2_path path;
+  ngtcp2_pkt_info pi = {0};
+
+  assert(qs.local_addr.is_valid());
+  ngtcp2_addr_init(&path.local, qs.local_addr, qs.local_addr.size());
+  ngtcp2_addr_init(&path.remote, remote, remote_len);
+
+  int rv = ngtcp2_conn_read_pkt(qs.qconn, &path, &pi, data, size, ts);
+  if (rv == NGTCP2_ERR_DRAINING) {
+    zret.diag("The peer closed the HTTP/3 connection.");
+    session.close();
+    return zret;
+  } else if (rv != 0) {
+    zret.error(
+        "ngtcp2_process_ingress: ngtcp2_conn_read_pkt() had an error return: {}",
+        Ngtcp2Error{rv});
+    zret = -1;
+    return zret;
+  }
+  ++qs.stats.datagrams_received;
+  qs.stats.bytes_received += size;
+  zret = size;
+  return zret;
+}
+
+/** Process the datagrams queued for a session by its QuicSharedSocket.
+ *
+ * This waits up to @a timeout for datagrams if none are queued.
+ */
+static swoc::Rv<int>
+ngtcp2_process_shared_ingress(
+    H3Session &session,
+    QuicSharedConnection &connection,
+    milliseconds timeout)
+{
+  swoc::Rv<int> zret{0};
+  auto &qs = session.quic_socket;
+  for (;;) {
+    auto const &datagrams = connection.take();
+    if (datagrams.empty()) {
+      if (poll_udp_socket(session, POLLIN, timeout, zret)) {
+        continue;
+      }
+      if (zret.result() < 0) {
+        session.close();
+      }
+      return zret;
+    }
+    ++qs.stats.receive_calls;
+
+    ngtcp2_tstamp ts = timestamp();
+    for (auto const &datagram : datagrams) {
+      auto &&[num_read, read_errata] = ngtcp2_read_packet(
+          session,
+          &datagram.remote.sa,
+          datagram.remote.size(),
+          datagram.data.data(),
+          datagram.size,
+          ts);
+      zret.note(std::move(read_errata));
+      if (num_read <= 0) {
+        zret = num_read;
+        return zret;
+      }
+      zret.result() += num_read;
+    }
+    return zret;
+  }
+}
+
 static swoc::Rv<int>
 ngtcp2_process_ingress(H3Session &session, milliseconds timeout)
 {
-  uint8_t buf[65536];
-  size_t bufsize = sizeof(buf);
-  struct sockaddr_storage remote_addr;
-  socklen_t remote_addrlen = sizeof(remote_addr);
-  ssize_t num_bytes_received = 0;
-  swoc::Rv<int> zret{-1};
+  if (auto *connection = session.shared_connection(); connection != nullptr) {
+    return ngtcp2_process_shared_ingress(session, *connection, timeout);
+  }
+  uint8_t bufs[QUIC_DATAGRAM_BATCH_SIZE][QUIC_MAX_RECV_UDP_PAYLOAD_SIZE];
+  iovec iovs[QUIC_DATAGRAM_BATCH_SIZE];
+  sockaddr_storage remote_addrs[QUIC_DATAGRAM_BATCH_SIZE];
+  mmsghdr msgs[QUIC_DATAGRAM_BATCH_SIZE];
+  int num_datagrams = 0;
+  swoc::Rv<int> zret{0};
+  auto &qs = session.quic_socket;
 
   for (;;) {
-    num_bytes_received = recvfrom(
-        session.get_fd(),
-        (char *)buf,
-        bufsize,
-        0,
-        (struct sockaddr *)&remote_addr,
-        &remote_addrlen);
-    if (num_bytes_received > 0) {
+    // recvmmsg overwrites the name lengths, so set the headers up for each
+    // attempt.
+    memset(msgs, 0, sizeof(msgs));
+    for (auto i = 0u; i < QUIC_DATAGRAM_BATCH_SIZE; ++i) {
+      iovs[i].iov_base = bufs[i];
+      iovs[i].iov_len = sizeof(bufs[i]);
+      msgs[i].msg_hdr.msg_name = &remote_addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(remote_addrs[i]);
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    // The socket is non-blocking, so this returns whatever datagrams are
+    // queued, up to a full batch, without waiting for the batch to fill.
+    num_datagrams = recvmmsg(session.get_fd(), msgs, QUIC_DATAGRAM_BATCH_SIZE, 0, nullptr);
+    if (num_datagrams > 0) {
       // Success. We read data off the socket.
       break;
     }
-    if (num_bytes_received == -1) {
+    if (num_datagrams == -1) {
       if (errno == EINTR) {
         continue;
       } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        auto &&[poll_return, poll_errata] = session.poll_for_data_on_socket(timeout);
-        zret.note(std::move(poll_errata));
-        if (!zret.is_ok()) {
-          zret.note(std::move(poll_errata));
-          zret.error("Failed to poll for HTTP/3 data.");
-          session.close();
-          zret = -1;
-          return zret;
-        } else if (poll_return > 0) {
+        if (poll_udp_socket(session, POLLIN, timeout, zret)) {
           // Simply repeat the read now that poll says something is ready.
-        } else if (poll_return == 0) {
-          zret.error("Poll timed out waiting to read HTTP/3 content.");
+          continue;
+        }
+        if (zret.result() < 0) {
           session.close();
-          zret = -1;
-          return zret;
-        } else if (poll_return < 0) {
-          // Connection was closed. Nothing to do.
-          zret.diag("The peer closed the HTTP/3 connection while reading during poll.");
-          zret = 0;
-          return zret;
         }
-        continue;
+        return zret;
       } else {
-        zret.error("ngtcp2_process_ingress: unexpected recvfrom() errno: {}", Errno{});
+        zret.error("ngtcp2_process_ingress: unexpected recvmmsg() errno: {}", Errno{});
         session.close();
         zret = -1;
         return zret;
       }
     }
   }
+  ++qs.stats.receive_calls;
 
-  ngtcp2_path path;
   ngtcp2_tstamp ts = timestamp();
-  ngtcp2_pkt_info pi = {0};
+  for (auto i = 0; i < num_datagrams; ++i) {
+    auto const &hdr = msgs[i].msg_hdr;
+    if (hdr.msg_flags & MSG_TRUNC) {
+      zret.diag(
+          "Dropping an HTTP/3 datagram larger than our {} byte receive limit.",
+          QUIC_MAX_RECV_UDP_PAYLOAD_SIZE);
+      continue;
+    }
+    auto &&[num_read, read_errata] = ngtcp2_read_packet(
+        session,
+        reinterpret_cast<sockaddr const *>(hdr.msg_name),
+        hdr.msg_namelen,
+        bufs[i],
+        msgs[i].msg_len,
+        ts);
+    zret.note(std::move(read_errata));
+    if (num_read <= 0) {
+      zret = num_read;
+      return zret;
+    }
+    zret.result() += num_read;
+  }
+  return zret;
+}
 
+/** Send a batch of QUIC packets to the session's peer.
+ *
+ * The packets are handed to the kernel with as few sendmmsg calls as the
+ * socket's send buffer allows. A socket of the session's own is connected to
+ * its peer, while a QuicSharedSocket is given the peer's address.
+ *
+ * @param[in] session The session whose socket the packets are sent on.
+ * @param[in] packets One entry per packet, at most QUIC_DATAGRAM_BATCH_SIZE.
+ *
+ * @return The number of bytes sent, 0 if the session closed, or -1 on error.
+ */
+static swoc::Rv<int>
+ngtcp2_send_packets(H3Session &session, swoc::MemSpan<iovec> packets)
+{
+  swoc::Rv<int> zret{0};
   auto &qs = session.quic_socket;
-  assert(local_addr.is_valid());
-  ngtcp2_addr_init(&path.local, qs.local_addr, qs.local_addr.size());
-  ngtcp2_addr_init(&path.remote, (struct sockaddr *)&remote_addr, remote_addrlen);
+  mmsghdr msgs[QUIC_DATAGRAM_BATCH_SIZE];
+
+  assert(packets.count() <= QUIC_DATAGRAM_BATCH_SIZE);
+  memset(msgs, 0, sizeof(msgs));
+  auto const *connection = session.shared_connection();
+  for (auto i = 0u; i < packets.count(); ++i) {
+    msgs[i].msg_hdr.msg_iov = &packets[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    if (connection != nullptr) {
+      msgs[i].msg_hdr.msg_name = const_cast<sockaddr *>(&connection->remote.sa);
+      msgs[i].msg_hdr.msg_namelen = connection->remote.size();
+    }
+  }
 
-  // Process the packet.
-  int rv = ngtcp2_conn_read_pkt(qs.qconn, &path, &pi, buf, num_bytes_received, ts);
-  if (rv != 0) {
-    zret.error(
-        "ngtcp2_process_ingress: ngtcp2_conn_read_pkt() had an error return: {}",
-        Ngtcp2Error{rv});
-    zret = -1;
-    return zret;
+  size_t num_sent = 0;
+  while (num_sent < packets.count()) {
+    int const n = sendmmsg(session.get_fd(), msgs + num_sent, packets.count() - num_sent, 0);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (poll_udp_socket(session, POLLOUT, Poll_Timeout, zret)) {
+          // The socket is available again for writing. Simply repeat the write.
+          continue;
+        }
+        return zret;
+      } else {
+        zret.error("sendmmsg() failed: {}", Errno{});
+        zret = -1;
+        return zret;
+      }
+    }
+    ++qs.stats.send_calls;
+    for (auto i = num_sent; i < num_sent + n; ++i) {
+      zret.result() += msgs[i].msg_len;
+      qs.stats.bytes_sent += msgs[i].msg_len;
+    }
+    qs.stats.datagrams_sent += n;
+    num_sent += n;
   }
-  zret.result() += num_bytes_received;
   return zret;
 }
 
@@ -691,6 +933,31 @@ ngtcp2_flush_egress(H3Session &session)
   ngtcp2_path_storage ps;
   ngtcp2_path_storage_zero(&ps);
 
+  // Packets are collected here and sent together once the batch is full or
+  // ngtcp2 has nothing more to write.
+  uint8_t out[QUIC_DATAGRAM_BATCH_SIZE][QuicDatagram::max_payload_size];
+  iovec packets[QUIC_DATAGRAM_BATCH_SIZE];
+  size_t num_packets = 0;
+
+  // When pacing, write only the burst ngtcp2 allows now. ngtcp2 then holds
+  // back further packets until its expiry, at which the caller flushes again.
+  size_t packets_left = std::numeric_limits<size_t>::max();
+  if (qs.pacing) {
+    auto const payload_size = std::max<size_t>(qs.settings.max_udp_payload_size, 1);
+    packets_left = std::max<size_t>(1, ngtcp2_conn_get_send_quantum(qs.qconn) / payload_size);
+  }
+  auto send_batch = [&]() -> bool {
+    auto &&[num_sent, send_errata] = ngtcp2_send_packets(session, {packets, num_packets});
+    num_packets = 0;
+    zret.note(std::move(send_errata));
+    if (num_sent <= 0) {
+      zret = num_sent;
+      return false;
+    }
+    zret.result() += num_sent;
+    return true;
+  };
+
   for (;;) {
     ssize_t veccnt = 0;
     int64_t stream_id = -1;
@@ -712,14 +979,16 @@ ngtcp2_flush_egress(H3Session &session)
     }
 
     uint32_t flags = NGTCP2_WRITE_STREAM_FLAG_MORE | (fin ? NGTCP2_WRITE_STREAM_FLAG_FIN : 0);
-    uint8_t out[NGTCP2_MAX_UDP_PAYLOAD_SIZE];
+    // A packet left incomplete by NGTCP2_ERR_WRITE_MORE is continued in the
+    // same slot, since num_packets only advances once a packet is finished.
+    uint8_t *const dest = out[num_packets];
     ssize_t ndatalen = 0;
     ssize_t outlen = ngtcp2_conn_writev_stream(
         qs.qconn,
         &ps.path,
         nullptr,
-        out,
-        sizeof(out),
+        dest,
+        sizeof(out[0]),
         &ndatalen,
         flags,
         stream_id,
@@ -778,55 +1047,79 @@ ngtcp2_flush_egress(H3Session &session)
       }
     }
 
-    ssize_t sent = 0;
-    while ((sent = send(session.get_fd(), (const char *)out, outlen, 0)) == -1) {
-      if (errno == EINTR) {
-        continue;
-      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        auto &&[poll_return, poll_errata] = session.poll_for_data_on_socket(Poll_Timeout, POLLOUT);
-        zret.note(std::move(poll_errata));
-        if (poll_return > 0) {
-          // The socket is available again for writing. Simply repeat the write.
-          continue;
-        } else if (!zret.is_ok()) {
-          zret.error("Error polling on a socket to write: {}", swoc::bwf::Errno{});
-          zret = -1;
-          return zret;
-        } else if (poll_return == 0) {
-          zret.error("Timed out waiting to write to a socket.");
-          zret = -1;
-          return zret;
-        } else if (poll_return < 0) {
-          zret.diag("write failed during poll: session is closed");
-          zret = 0;
-          return zret;
-        }
-      } else {
-        zret.error("send() failed: {}", swoc::bwf::Errno{});
-        zret = -1;
-        return zret;
-      }
+    packets[num_packets].iov_base = dest;
+    packets[num_packets].iov_len = outlen;
+    if (++num_packets == QUIC_DATAGRAM_BATCH_SIZE && !send_batch()) {
+      return zret;
+    }
+    if (--packets_left == 0) {
+      break;
     }
-    zret.result() += sent;
   }
 
+  if (num_packets > 0) {
+    send_batch();
+  }
+  if (qs.pacing) {
+    ngtcp2_conn_update_pkt_tx_time(qs.qconn, ts);
+  }
   return zret;
 }
 
+/** Shorten @a timeout so that a poll wakes in time for ngtcp2's next timer,
+ * such as those for retransmission and pacing.
+ */
+static milliseconds
+bound_by_expiry(H3Session &session, milliseconds timeout)
+{
+  auto const now = static_cast<ngtcp2_tstamp>(timestamp());
+  auto const expiry = ngtcp2_conn_get_expiry(session.quic_socket.qconn);
+  if (expiry <= now) {
+    return 0ms;
+  } else if (expiry - now < static_cast<ngtcp2_tstamp>(nanoseconds{timeout}.count())) {
+    return std::chrono::ceil<milliseconds>(nanoseconds{expiry - now});
+  }
+  return timeout;
+}
+
 /** Listen on the Session's socket for incoming data and then respond with any
  * resulting packets.
  *
  * Listening on the socket will poll() until data comes in or a timeout is
- * experienced. Writing any packets will not delay if there is nothing to write.
+ * experienced. Whenever one of ngtcp2's timers expires meanwhile, the packets
+ * then due, such as those held back by pacing, are written. Writing any
+ * packets will not delay if there is nothing to write.
  */
 static Errata
 nghttp3_receive_and_send_data(H3Session &session, milliseconds timeout)
 {
   Errata errata;
+  auto const deadline = ClockType::now() + timeout;
+  for (;;) {
+    timeout = std::max(0ms, duration_cast<milliseconds>(deadline - ClockType::now()));
+    auto const timer_wait = bound_by_expiry(session, timeout);
+    if (timer_wait >= timeout) {
+      break;
+    }
+    auto &&[poll_result, poll_errata] = session.poll_for_data_on_socket(timer_wait);
+    errata.note(std::move(poll_errata));
+    if (!errata.is_ok()) {
+      return errata;
+    } else if (poll_result != 0) {
+      // Data came in or the connection closed, either of which the ingress
+      // processing below handles.
+      break;
+    }
+    auto &&[num_bytes_written, egress_errata] = ngtcp2_flush_egress(session);
+    errata.note(std::move(egress_errata));
+    if (!errata.is_ok() || num_bytes_written < 0) {
+      return errata;
+    }
+  }
   // This may poll until packets come in to read.
   auto &&[num_bytes_received, ingress_errata] = ngtcp2_process_ingress(session, timeout);
   errata.note(std::move(ingress_errata));
-  if (!errata.is_ok() || num_bytes_received < 0) {
+  if (!errata.is_ok() || num_bytes_received < 0 || session.is_closed()) {
     return errata;
   }
 
@@ -916,8 +1209,7 @@ cb_h3_stream_close(
   errata.diag("HTTP/3 stream is closed with id: {}", stream_id);
 
   auto *session = reinterpret_cast<H3Session *>(conn_user_data);
-  auto iter = session->stream_map.find(stream_id);
-  if (iter == session->stream_map.end()) {
+  if (session->stream_map.find(stream_id) == nullptr) {
     errata.error(
         "HTTP/3 stream is closed with id {} but could not find it tracked internally",
         stream_id);
@@ -935,11 +1227,13 @@ cb_h3_stream_close(
         elapsed_ms);
   }
 
-  session->stream_map.erase(stream_id);
+  session->record_stream_closed(stream_id);
 
-  /* make sure that ngh3_stream_recv is called again to complete the transfer
-   * even if there are no more packets to be received from the server. */
-  errata.note(nghttp3_receive_and_send_data(*session, Poll_Timeout));
+  if (!session->is_server()) {
+    /* make sure that ngh3_stream_recv is called again to complete the transfer
+     * even if there are no more packets to be received from the server. */
+    errata.note(nghttp3_receive_and_send_data(*session, Poll_Timeout));
+  }
   return 0;
 }
 
@@ -980,6 +1274,27 @@ cb_h3_deferred_consume(
   return 0;
 }
 
+/** Called on the server when a request's headers start, creating the state
+ * of the request's stream.
+ */
+static int
+cb_h3_begin_headers(
+    nghttp3_conn *conn,
+    int64_t stream_id,
+    void *conn_user_data,
+    void * /* stream_user_data */)
+{
+  auto *session = reinterpret_cast<H3Session *>(conn_user_data);
+  auto *stream_state = session->new_stream_state(false /* is_client */);
+  stream_state->set_stream_id(stream_id);
+  stream_state->request_from_client->_contains_pseudo_headers_in_fields_array = true;
+  session->record_stream_state(stream_id, stream_state);
+  if (nghttp3_conn_set_stream_user_data(conn, stream_id, stream_state) != 0) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+  return 0;
+}
+
 static int
 cb_h3_recv_header(
     nghttp3_conn * /* conn */,
@@ -1106,6 +1421,19 @@ cb_h3_end_headers(
   return 0;
 }
 
+/** Called on the server once a request has been entirely received. */
+static int
+cb_h3_end_stream(
+    nghttp3_conn * /* conn */,
+    int64_t stream_id,
+    void *conn_user_data,
+    void * /* stream_user_data */)
+{
+  auto *session = reinterpret_cast<H3Session *>(conn_user_data);
+  session->set_stream_has_ended(stream_id);
+  return 0;
+}
+
 static int
 cb_h3_send_stop_sending(
     nghttp3_conn * /* conn */,
@@ -1137,6 +1465,23 @@ static nghttp3_callbacks nghttp3_client_callbacks = {
     nullptr, /* reset_stream */
     nullptr, /* shutdown */
 };
+
+static nghttp3_callbacks nghttp3_server_callbacks = {
+    cb_h3_acked_stream_data,
+    cb_h3_stream_close,
+    cb_h3_recv_data,
+    cb_h3_deferred_consume,
+    cb_h3_begin_headers,
+    cb_h3_recv_header,
+    cb_h3_end_headers,
+    nullptr, /* begin_trailers */
+    cb_h3_recv_header,
+    nullptr, /* end_trailers */
+    cb_h3_send_stop_sending,
+    cb_h3_end_stream,
+    nullptr, /* reset_stream */
+    nullptr, /* shutdown */
+};
 // --------------------------------------------
 // End nghttp3 callbacks.
 // --------------------------------------------
@@ -1161,15 +1506,29 @@ initialize_nghttp3_connection(H3Session *session)
 
   nghttp3_settings_default(&qs.h3settings);
 
-  int rc = nghttp3_conn_client_new(
-      &qs.h3conn,
-      &nghttp3_client_callbacks,
-      &qs.h3settings,
-      nghttp3_mem_default(),
-      session);
-  if (rc != 0) {
-    errata.error("nghttp3_conn_client_new failed: {}", Ngtcp2Error{rc});
-    return FAILED;
+  int rc = 0;
+  if (session->is_server()) {
+    rc = nghttp3_conn_server_new(
+        &qs.h3conn,
+        &nghttp3_server_callbacks,
+        &qs.h3settings,
+        nghttp3_mem_default(),
+        session);
+    if (rc != 0) {
+      errata.error("nghttp3_conn_server_new failed: {}", Nghttp3Error{rc});
+      return FAILED;
+    }
+  } else {
+    rc = nghttp3_conn_client_new(
+        &qs.h3conn,
+        &nghttp3_client_callbacks,
+        &qs.h3settings,
+        nghttp3_mem_default(),
+        session);
+    if (rc != 0) {
+      errata.error("nghttp3_conn_client_new failed: {}", Ngtcp2Error{rc});
+      return FAILED;
+    }
   }
 
   rc = ngtcp2_conn_open_uni_stream(qs.qconn, &ctrl_stream_id, nullptr);
@@ -1205,26 +1564,173 @@ initialize_nghttp3_connection(H3Session *session)
   return SUCCEEDED;
 }
 
-static void
-configure_quic_socket_settings(QuicSocket &qs, uint64_t stream_buffer_size)
+swoc::Errata
+QuicSettings::set(TextView name, TextView value)
 {
-  ngtcp2_settings *s = &qs.settings;
-  ngtcp2_transport_params *t = &qs.transport_params;
-  ngtcp2_settings_default(s);
-  ngtcp2_transport_params_default(t);
-#ifdef DEBUG_NGTCP2
-  s->log_printf = quic_printf;
-#else
-  s->log_printf = nullptr;
-#endif
+  swoc::Errata errata;
+  if (name == CONGESTION_CONTROL) {
+    if (strcasecmp(value, "reno") == 0) {
+      _congestion_control = CongestionControl::RENO;
+    } else if (strcasecmp(value, "cubic") == 0) {
+      _congestion_control = CongestionControl::CUBIC;
+    } else if (strcasecmp(value, "bbr") == 0) {
+      _congestion_control = CongestionControl::BBR;
+    } else {
+      errata.error(
+          R"(QUIC setting "{}" has an invalid value "{}": expected reno, cubic, or bbr.)",
+          name,
+          value);
+    }
+    return errata;
+  } else if (name == PACING) {
+    if (strcasecmp(value, "on") == 0) {
+      _pacing = true;
+    } else if (strcasecmp(value, "off") == 0) {
+      _pacing = false;
+    } else {
+      errata.error(
+          R"(QUIC setting "{}" has an invalid value "{}": expected on or off.)",
+          name,
+          value);
+    }
+    return errata;
+  }
+
+  TextView parsed;
+  auto const setting = swoc::svtou(value, &parsed);
+  if (value.empty() || parsed.size() != value.size()) {
+    errata.error(R"(QUIC setting "{}" has an invalid value "{}".)", name, value);
+    return errata;
+  }
+  if (name == INITIAL_MAX_DATA) {
+    _initial_max_data = setting;
+  } else if (name == INITIAL_MAX_STREAM_DATA) {
+    _initial_max_stream_data = setting;
+  } else if (name == INITIAL_MAX_STREAMS_BIDI) {
+    _initial_max_streams_bidi = setting;
+  } else if (name == INITIAL_MAX_STREAMS_UNI) {
+    // nghttp3 needs three unidirectional streams of the peer: control and
+    // the two QPACK streams.
+    if (setting < 3) {
+      errata.error(R"(QUIC setting "{}" value {} is less than 3.)", name, setting);
+    } else {
+      _initial_max_streams_uni = setting;
+    }
+  } else if (name == MAX_UDP_PAYLOAD_SIZE) {
+    if (setting < QUIC_MIN_UDP_PAYLOAD_SIZE || setting > QUIC_MAX_RECV_UDP_PAYLOAD_SIZE) {
+      errata.error(
+          R"(QUIC setting "{}" value {} is not between {} and {}.)",
+          name,
+          setting,
+          QUIC_MIN_UDP_PAYLOAD_SIZE,
+          QUIC_MAX_RECV_UDP_PAYLOAD_SIZE);
+    } else {
+      _max_udp_payload_size = setting;
+    }
+  } else {
+    errata.error(R"(Unknown QUIC setting "{}".)", name);
+  }
+  return errata;
+}
+
+swoc::Errata
+QuicSettings::parse(TextView description)
+{
+  swoc::Errata errata;
+  while (description) {
+    auto value = description.take_prefix_at(',').trim_if(&isspace);
+    if (value.empty()) {
+      continue;
+    }
+    auto const name = value.take_prefix_at('=').trim_if(&isspace);
+    errata.note(this->set(name, value.trim_if(&isspace)));
+  }
+  return errata;
+}
+
+void
+QuicSettings::merge(QuicSettings const &defaults)
+{
+  if (!_initial_max_data) {
+    _initial_max_data = defaults._initial_max_data;
+  }
+  if (!_initial_max_stream_data) {
+    _initial_max_stream_data = defaults._initial_max_stream_data;
+  }
+  if (!_initial_max_streams_bidi) {
+    _initial_max_streams_bidi = defaults._initial_max_streams_bidi;
+  }
+  if (!_initial_max_streams_uni) {
+    _initial_max_streams_uni = defaults._initial_max_streams_uni;
+  }
+  if (!_max_udp_payload_size) {
+    _max_udp_payload_size = defaults._max_udp_payload_size;
+  }
+  if (!_congestion_control) {
+    _congestion_control = defaults._congestion_control;
+  }
+  if (!_pacing) {
+    _pacing = defaults._pacing;
+  }
+}
+
+/** Configure the ngtcp2 settings and our transport parameters.
+ *
+ * @param[in] qs The socket to configure.
+ * @param[in] settings The values given for this connection. Those not given
+ * take our built in values.
+ * @param[in] max_streams_bidi The number of request streams the peer may
+ * have open at once if @a settings does not say.
+ */
+static void
+configure_quic_socket_settings(
+    QuicSocket &qs,
+    QuicSettings const &settings,
+    uint64_t max_streams_bidi)
+{
+  ngtcp2_settings *s = &qs.settings;
+  ngtcp2_transport_params *t = &qs.transport_params;
+  ngtcp2_settings_default(s);
+  ngtcp2_transport_params_default(t);
+#ifdef DEBUG_NGTCP2
+  s->log_printf = quic_printf;
+#else
+  s->log_printf = nullptr;
+#endif
   s->initial_ts = timestamp();
-  t->initial_max_stream_data_bidi_local = stream_buffer_size;
-  t->initial_max_stream_data_bidi_remote = QUIC_MAX_STREAMS;
-  t->initial_max_stream_data_uni = QUIC_MAX_STREAMS;
-  t->initial_max_data = QUIC_MAX_DATA;
-  t->initial_max_streams_bidi = 1;
-  t->initial_max_streams_uni = 3;
+  if (settings._initial_max_stream_data) {
+    t->initial_max_stream_data_bidi_local = *settings._initial_max_stream_data;
+    t->initial_max_stream_data_bidi_remote = *settings._initial_max_stream_data;
+    t->initial_max_stream_data_uni = *settings._initial_max_stream_data;
+  } else {
+    t->initial_max_stream_data_bidi_local = MAX_DRAIN_BUFFER_SIZE;
+    t->initial_max_stream_data_bidi_remote = QUIC_MAX_STREAMS;
+    t->initial_max_stream_data_uni = QUIC_MAX_STREAMS;
+  }
+  t->initial_max_data = settings._initial_max_data.value_or(QUIC_MAX_DATA);
+  t->initial_max_streams_bidi = settings._initial_max_streams_bidi.value_or(max_streams_bidi);
+  t->initial_max_streams_uni = settings._initial_max_streams_uni.value_or(3);
   t->max_idle_timeout = duration_cast<milliseconds>(QUIC_IDLE_TIMEOUT).count();
+  // Keep the peer's datagrams within our receive slots.
+  t->max_udp_payload_size =
+      settings._max_udp_payload_size.value_or(QUIC_MAX_RECV_UDP_PAYLOAD_SIZE);
+  if (settings._max_udp_payload_size) {
+    s->max_udp_payload_size = *settings._max_udp_payload_size;
+  }
+  if (settings._congestion_control) {
+    switch (*settings._congestion_control) {
+    case QuicSettings::CongestionControl::RENO:
+      s->cc_algo = NGTCP2_CC_ALGO_RENO;
+      break;
+    case QuicSettings::CongestionControl::CUBIC:
+      s->cc_algo = NGTCP2_CC_ALGO_CUBIC;
+      break;
+    case QuicSettings::CongestionControl::BBR:
+      s->cc_algo = NGTCP2_CC_ALGO_BBR;
+      break;
+    }
+  }
+  qs.pacing = settings._pacing.value_or(false);
   if (qs.qlogfd != -1) {
     s->qlog.write = QuicSocket::qlog_callback;
   }
@@ -1252,16 +1758,18 @@ QuicSocket::QuicSocket()
 
 QuicSocket::~QuicSocket()
 {
-  if (qlogfd != -1) {
-    ::close(qlogfd);
-  }
-  qlogfd = -1;
   if (ssl != nullptr) {
     SSL_free(ssl);
   }
   ssl = nullptr;
   ngtcp2_conn_del(qconn);
   nghttp3_conn_del(h3conn);
+  // This is done last since deleting the connection may finish the log.
+  if (qlogfd != -1) {
+    // The log was not finished, but keep what there is of it.
+    LogFileWriter::write(qlogfd, std::move(qlog_buffer), true);
+  }
+  qlogfd = -1;
 }
 
 Errata
@@ -1294,6 +1802,7 @@ QuicSocket::open_qlog_file()
     errata.error("Failed to open QUIC log at {}: {}", qlog_path, Errno{});
     return errata;
   }
+  qlog_buffer.reserve(QLOG_BUFFER_SIZE);
   errata.diag("Writing QUIC log to: {}", qlog_path);
   return errata;
 }
@@ -1302,24 +1811,27 @@ QuicSocket::open_qlog_file()
 void
 QuicSocket::qlog_callback(void *user_data, uint32_t flags, const void *data, size_t datalen)
 {
-  Errata errata;
   H3Session *h3_session = reinterpret_cast<H3Session *>(user_data);
   QuicSocket &qs = h3_session->quic_socket;
   if (qs.qlogfd == -1) {
-    // Likely a previous write has failed and the log was closed.
+    // The log was already finished.
     return;
   }
-  std::scoped_lock _{_qlog_mutex};
-  ssize_t rc = ::write(qs.qlogfd, data, datalen);
-  if (rc == -1) {
-    errata.error("Failed to write to QUIC log file: {}", Errno{});
-    ::close(qs.qlogfd);
-    qs.qlogfd = -1;
-  }
-
-  if (flags & NGTCP2_QLOG_WRITE_FLAG_FIN) {
-    ::close(qs.qlogfd);
-    qs.qlogfd = -1;
+  // Only the thread running the connection logs for it, so the buffer needs
+  // no lock.
+  qs.qlog_buffer.append(static_cast<char const *>(data), datalen);
+  bool const fin = flags & NGTCP2_QLOG_WRITE_FLAG_FIN;
+  if (fin || qs.qlog_buffer.size() >= QLOG_BUFFER_SIZE) {
+    std::string full_buffer;
+    full_buffer.swap(qs.qlog_buffer);
+    if (!fin) {
+      // Nothing more is logged after the final write.
+      qs.qlog_buffer.reserve(QLOG_BUFFER_SIZE);
+    }
+    LogFileWriter::write(qs.qlogfd, std::move(full_buffer), fin);
+    if (fin) {
+      qs.qlogfd = -1;
+    }
   }
 }
 
@@ -1327,6 +1839,7 @@ QuicSocket::qlog_callback(void *user_data, uint32_t flags, const void *data, siz
 void
 QuicSocket::randomly_populate_array(uint8_t *array, size_t array_len)
 {
+  std::scoped_lock _{_rng_mutex};
   for (auto i = 0u; i < array_len; ++i) {
     array[i] = _uni_id(_rng);
   }
@@ -1374,6 +1887,19 @@ Errata
 H3Session::configure_udp_socket(swoc::TextView interface, swoc::IPEndpoint const *target)
 {
   Errata errata;
+  if (QuicClientSocketPool::is_enabled()) {
+    auto &&[socket, socket_errata] = QuicClientSocketPool::get_socket(interface, *target);
+    errata.note(std::move(socket_errata));
+    if (!errata.is_ok()) {
+      return errata;
+    }
+    _shared_connection = std::make_shared<QuicSharedConnection>(socket, *target);
+    quic_socket.local_addr = socket->get_local_addr();
+    errata.note(this->set_fd(socket->get_fd()));
+    this->_endpoint = target;
+    return errata;
+  }
+
   int const socket_fd = ::socket(target->family(), SOCK_DGRAM, 0);
   if (0 > socket_fd) {
     errata.error(R"(Failed to open a UDP socket - {})", Errno{});
@@ -1436,21 +1962,41 @@ H3Session::do_connect(swoc::TextView interface, swoc::IPEndpoint const *target)
 swoc::Rv<int>
 H3Session::poll_for_headers(milliseconds timeout)
 {
-  assert(0);
   if (this->get_a_stream_has_ended()) {
     return 1;
   }
+  if (is_closed()) {
+    return -1;
+  }
   swoc::Rv<int> zret{-1};
-  auto &&[poll_result, poll_errata] = Session::poll_for_data_on_socket(timeout);
+  auto &&[poll_result, poll_errata] =
+      this->poll_for_data_on_socket(bound_by_expiry(*this, timeout));
   zret.note(std::move(poll_errata));
   if (!zret.is_ok()) {
     return zret;
-  } else if (poll_result == 0) {
-    return 0;
   } else if (poll_result < 0) {
     // Connection closed.
     close();
     return -1;
+  } else if (poll_result == 0) {
+    if (ngtcp2_conn_get_idle_expiry(quic_socket.qconn) <= static_cast<ngtcp2_tstamp>(timestamp()))
+    {
+      zret.diag("Closing the HTTP/3 connection after its idle timeout.");
+      close();
+      zret = -1;
+      return zret;
+    }
+    // Nothing arrived, but a timer may have expired.
+    auto &&[num_bytes_written, egress_errata] = ngtcp2_flush_egress(*this);
+    zret.note(std::move(egress_errata));
+    if (num_bytes_written < 0) {
+      zret.error("Calling ngtcp2_flush_egress in H3Session::poll_for_headers failed.");
+      close();
+      zret = -1;
+      return zret;
+    }
+    zret = 0;
+    return zret;
   }
   zret.note(nghttp3_receive_and_send_data(*this, Poll_Timeout));
   if (!zret.is_ok()) {
@@ -1468,6 +2014,81 @@ H3Session::poll_for_headers(milliseconds timeout)
   }
 }
 
+swoc::Rv<int>
+H3Session::poll_for_data_on_socket(milliseconds timeout, short events)
+{
+  if (_shared_connection == nullptr || !(events & POLLIN)) {
+    return super_type::poll_for_data_on_socket(timeout, events);
+  }
+  if (is_closed()) {
+    return {-1, Errata().diag("Poll called on a closed connection.")};
+  }
+  return _shared_connection->wait(timeout);
+}
+
+void
+H3Session::close()
+{
+  if (is_closed()) {
+    return;
+  }
+  send_connection_close();
+  TLSSession::flush_keylog();
+  if (_shared_connection != nullptr) {
+    // The socket is shared with other connections.
+    _shared_connection->close();
+    super_type::set_fd(-1);
+  } else {
+    super_type::close();
+  }
+}
+
+void
+H3Session::send_connection_close()
+{
+  auto *qconn = quic_socket.qconn;
+  if (qconn == nullptr || ngtcp2_conn_is_in_closing_period(qconn) ||
+      ngtcp2_conn_is_in_draining_period(qconn))
+  {
+    return;
+  }
+  Errata errata;
+  uint8_t out[NGTCP2_MAX_UDP_PAYLOAD_SIZE];
+  ngtcp2_path_storage ps;
+  ngtcp2_path_storage_zero(&ps);
+  ngtcp2_pkt_info pi;
+  auto const outlen = ngtcp2_conn_write_application_close(
+      qconn,
+      &ps.path,
+      &pi,
+      out,
+      sizeof(out),
+      NGHTTP3_H3_NO_ERROR,
+      timestamp());
+  if (outlen <= 0) {
+    // The handshake may not have gotten far enough for a close to be sent.
+    errata.diag("Could not write an HTTP/3 CONNECTION_CLOSE: {}", Ngtcp2Error{(int)outlen});
+    return;
+  }
+  iovec packet{out, static_cast<size_t>(outlen)};
+  errata.note(ngtcp2_send_packets(*this, {&packet, 1}).errata());
+}
+
+void
+H3Session::note_udp_stats(Errata &errata) const
+{
+  auto const &stats = quic_socket.stats;
+  errata.diag(
+      "HTTP/3 UDP totals: received {} bytes in {} datagrams over {} batches, sent {} bytes in "
+      "{} datagrams with {} sendmmsg calls.",
+      stats.bytes_received,
+      stats.datagrams_received,
+      stats.receive_calls,
+      stats.bytes_sent,
+      stats.datagrams_sent,
+      stats.send_calls);
+}
+
 bool
 H3Session::get_a_stream_has_ended() const
 {
@@ -1475,12 +2096,25 @@ H3Session::get_a_stream_has_ended() const
 }
 
 void
-H3Session::record_stream_state(int64_t stream_id, std::shared_ptr<H3StreamState> stream_state)
+H3Session::record_stream_state(int64_t stream_id, H3StreamState *stream_state)
 {
-  stream_map[stream_id] = stream_state;
+  stream_map.insert(stream_id, stream_state);
   _last_added_stream = stream_state;
 }
 
+void
+H3Session::record_stream_closed(int64_t stream_id)
+{
+  auto *const stream_state = stream_map.erase(stream_id);
+  if (stream_state == nullptr) {
+    return;
+  }
+  if (stream_state == _last_added_stream) {
+    _last_added_stream = nullptr;
+  }
+  _stream_states.release(stream_state);
+}
+
 void
 H3Session::set_stream_has_ended(int64_t stream_id)
 {
@@ -1488,7 +2122,7 @@ H3Session::set_stream_has_ended(int64_t stream_id)
 }
 
 swoc::Rv<std::shared_ptr<HttpHeader>>
-H3Session::read_and_parse_request(swoc::FixedBufferWriter & /* buffer */)
+H3Session::read_and_parse_request()
 {
   swoc::Rv<std::shared_ptr<HttpHeader>> zret{nullptr};
 
@@ -1497,21 +2131,17 @@ H3Session::read_and_parse_request(swoc::FixedBufferWriter & /* buffer */)
   assert(!_ended_streams.empty());
   auto const stream_id = _ended_streams.front();
   _ended_streams.pop_front();
-  auto stream_map_iter = stream_map.find(stream_id);
-  if (stream_map_iter == stream_map.end()) {
+  auto *stream_state = stream_map.find(stream_id);
+  if (stream_state == nullptr) {
     zret.error("Requested request headers for stream id {}, but none are available.", stream_id);
     return zret;
   }
-  auto &stream_state = stream_map_iter->second;
   zret = stream_state->request_from_client;
   return zret;
 }
 
 swoc::Rv<size_t>
-H3Session::drain_body(
-    HttpHeader const & /* hdr */,
-    size_t /* expected_content_size */,
-    TextView /* initial */)
+H3Session::drain_body(HttpHeader const & /* hdr */, size_t /* expected_content_size */)
 {
   // For HTTP/3, we process entire streams once they are ended. Therefore there
   // is never body to drain.
@@ -1523,33 +2153,43 @@ Errata
 H3Session::accept()
 {
   swoc::Errata errata;
-  //
-  // TODO: This is all just stubbed out. Copied over from HTTP/2, so most of it
-  // is wrong. Flesh this out when we implement server-side HTTP/3
-  //
+
+  errata.note(this->server_session_init());
+  if (!errata.is_ok()) {
+    errata.error("HTTP/3 server session initialization failed.");
+    return errata;
+  }
+
+  // The client's Initial packet is already queued. Exchange packets until the
+  // handshake is complete.
+  bool handshake_completed = ngtcp2_conn_get_handshake_completed(quic_socket.qconn);
+  while (!handshake_completed && !is_closed()) {
+    errata.note(nghttp3_receive_and_send_data(*this, Poll_Timeout));
+    if (!errata.is_ok()) {
+      errata.error("Encountered a problem while completing the handshake.");
+      break;
+    }
+    handshake_completed = ngtcp2_conn_get_handshake_completed(quic_socket.qconn);
+  }
+  if (!handshake_completed) {
+    errata.error("Could not complete the QUIC handshake with {}.", _shared_connection->remote);
+    return errata;
+  }
 
   // Check that the HTTP/3 protocol was negotiated.
   unsigned char const *alpn = nullptr;
   unsigned int alpnlen = 0;
-#ifdef OPENSSL_NO_NEXTPROTONEG
-  SSL_get0_next_proto_negotiated(this->_ssl, &alpn, &alpnlen);
-#endif /* !OPENSSL_NO_NEXTPROTONEG */
-#if OPENSSL_VERSION_NUMBER >= 0x10002000L
-  if (alpn == nullptr) {
-    SSL_get0_alpn_selected(this->_ssl, &alpn, &alpnlen);
-  }
-#endif /* OPENSSL_VERSION_NUMBER >= 0x10002000L */
-
-  if (alpn != nullptr && alpnlen == 2 && memcmp("h3", alpn, 2) == 0) {
-    errata.diag(R"(Negotiated ALPN: {}, HTTP/3 is negotiated.)", TextView{(char *)alpn, alpnlen});
+  SSL_get0_alpn_selected(quic_socket.ssl, &alpn, &alpnlen);
+  TextView const alpn_view{reinterpret_cast<char const *>(alpn), alpnlen};
+  if (alpn != nullptr && alpn_view.starts_with("h3")) {
+    errata.diag(R"(Negotiated ALPN: {}, HTTP/3 is negotiated.)", alpn_view);
   } else {
     errata.error(
         R"(Negotiated ALPN: {}, HTTP/3 failed to negotiate.)",
-        (alpn == nullptr) ? "none" : TextView{(char *)alpn, alpnlen});
+        (alpn == nullptr) ? "none" : alpn_view);
     return errata;
   }
 
-  this->server_session_init();
   errata.diag("Finished accept using H3Session");
   return errata;
 }
@@ -1618,6 +2258,7 @@ H3Session::run_transactions(
     errata.note(std::move(txn_errata));
   }
   errata.note(receive_responses());
+  note_udp_stats(errata);
   return errata;
 }
 
@@ -1627,7 +2268,9 @@ H3Session::run_transaction(Txn const &transaction)
   Errata errata;
   auto &&[bytes_written, write_errata] = this->write(transaction._req);
   errata.note(std::move(write_errata));
-  _last_added_stream->specified_response = &transaction._rsp;
+  if (errata.is_ok() && _last_added_stream != nullptr) {
+    _last_added_stream->specified_response = &transaction._rsp;
+  }
   return errata;
 }
 
@@ -1657,6 +2300,44 @@ H3StreamState::~H3StreamState()
   }
 }
 
+void
+H3StreamState::reset(bool is_client)
+{
+  stream_start = ClockType::now();
+  _will_receive_request = !is_client;
+  _stream_id = 0;
+}
+
+void
+H3StreamState::clear()
+{
+  for (auto rcbuf : _rcbufs_to_free) {
+    nghttp3_rcbuf_decref(rcbuf);
+  }
+  _rcbufs_to_free.clear();
+  key.clear();
+  composed_url.clear();
+  have_received_headers = false;
+  specified_response = nullptr;
+  rendered_values.clear();
+  body_to_send.clear();
+  wait_for_continue = false;
+  num_data_bytes_written = 0;
+  // Headers which the caller still holds are replaced rather than reused.
+  if (request_from_client.use_count() == 1) {
+    request_from_client->clear();
+  } else {
+    request_from_client = std::make_shared<HttpHeader>();
+  }
+  request_from_client->set_is_request(HTTP_PROTOCOL_TYPE::HTTP_3);
+  if (response_from_server.use_count() == 1) {
+    response_from_server->clear();
+  } else {
+    response_from_server = std::make_shared<HttpHeader>();
+  }
+  response_from_server->set_is_response(HTTP_PROTOCOL_TYPE::HTTP_3);
+}
+
 bool
 H3StreamState::will_receive_request() const
 {
@@ -1673,6 +2354,8 @@ void
 H3StreamState::set_stream_id(int64_t stream_id)
 {
   _stream_id = stream_id;
+  request_from_client->_stream_id = stream_id;
+  response_from_server->_stream_id = stream_id;
 }
 
 int64_t
@@ -1689,9 +2372,41 @@ H3Session::H3Session(TextView const &client_sni, int client_verify_mode)
 {
 }
 
+H3Session::H3Session(std::shared_ptr<QuicSharedConnection> connection)
+  : _endpoint{&connection->remote}
+  , _shared_connection{std::move(connection)}
+  , _is_server{true}
+{
+  super_type::set_fd(_shared_connection->socket->get_fd());
+}
+
 H3Session::~H3Session()
 {
-  _last_added_stream.reset();
+  // Session's destructor would close the socket, which may be shared.
+  close();
+  if (_is_server) {
+    Errata errata;
+    note_udp_stats(errata);
+  }
+  _last_added_stream = nullptr;
+}
+
+bool
+H3Session::is_server() const
+{
+  return _is_server;
+}
+
+QuicSharedConnection *
+H3Session::shared_connection() const
+{
+  return _shared_connection.get();
+}
+
+H3StreamState *
+H3Session::new_stream_state(bool is_client)
+{
+  return _stream_states.acquire(is_client);
 }
 
 swoc::Rv<ssize_t> H3Session::read(swoc::MemSpan<char> /* span */)
@@ -1729,7 +2444,8 @@ H3Session::pack_headers(HttpHeader const &hdr, nghttp3_nv *&nv_hdr, int &hdr_cou
 
   hdr_count = hdr._fields_rules->_fields.size();
 
-  nv_hdr = reinterpret_cast<nghttp3_nv *>(malloc(sizeof(nghttp3_nv) * hdr_count));
+  _nv_buffer.resize(hdr_count);
+  nv_hdr = _nv_buffer.data();
 
   int offset = 0;
   if (hdr.is_response()) {
@@ -1748,27 +2464,32 @@ H3Session::pack_headers(HttpHeader const &hdr, nghttp3_nv *&nv_hdr, int &hdr_cou
 
 swoc::Rv<ssize_t>
 H3Session::write(HttpHeader const &hdr)
+{
+  return submit_message(hdr, hdr._stream_id);
+}
+
+swoc::Rv<ssize_t>
+H3Session::write_response(HttpHeader const &hdr, int64_t stream_id)
+{
+  return submit_message(hdr, stream_id);
+}
+
+swoc::Rv<ssize_t>
+H3Session::submit_message(HttpHeader const &hdr, int64_t response_stream_id)
 {
   swoc::Rv<ssize_t> zret{0};
 
   auto const key = hdr.get_key();
   H3StreamState *stream_state = nullptr;
-  std::shared_ptr<H3StreamState> new_stream_state{nullptr};
   int64_t stream_id = 0;
   if (hdr.is_response()) {
-    stream_id = hdr._stream_id;
-    auto stream_map_iter = stream_map.find(stream_id);
-    if (stream_map_iter == stream_map.end()) {
+    stream_id = response_stream_id;
+    stream_state = stream_map.find(stream_id);
+    if (stream_state == nullptr) {
       zret.error("Could not find registered stream for stream id: {}", stream_id);
       return zret;
     }
-    stream_state = stream_map_iter->second.get();
   } else { // Is a request.
-    // Only servers write responses while clients write requests.
-    bool const is_client = hdr.is_request();
-    new_stream_state = std::make_shared<H3StreamState>(is_client);
-    stream_state = new_stream_state.get();
-
     auto const rc = ngtcp2_conn_open_bidi_stream(quic_socket.qconn, &stream_id, nullptr);
     if (rc != 0) {
       zret.error(
@@ -1777,8 +2498,11 @@ H3Session::write(HttpHeader const &hdr)
           Ngtcp2Error{rc});
       return zret;
     }
+    // Only servers write responses while clients write requests.
+    bool const is_client = hdr.is_request();
+    stream_state = _stream_states.acquire(is_client);
     stream_state->set_stream_id(stream_id);
-    record_stream_state(stream_id, new_stream_state);
+    record_stream_state(stream_id, stream_state);
   }
   stream_state->key = key;
 
@@ -1789,6 +2513,7 @@ H3Session::write(HttpHeader const &hdr)
     zret.error("Failed to pack headers for key: {}", key);
     return zret;
   }
+  hdr.render_templates(nva, num_headers, stream_state->rendered_values, _template_context);
 
   int submit_result = 0;
   if (hdr._content_size > 0 && (hdr.is_request() || !HttpHeader::STATUS_NO_CONTENT[hdr._status])) {
@@ -1856,12 +2581,25 @@ H3Session::write(HttpHeader const &hdr)
   if (ngtcp2_flush_egress(*this) < 0) {
     zret.error("Failure calling ngtcp2_flush_egress while writing headers.");
   }
-  free(nva);
   return zret;
 }
 
 SSL_CTX *H3Session::_h3_client_context = nullptr;
 SSL_CTX *H3Session::_h3_server_context = nullptr;
+QuicSettings H3Session::_default_settings;
+
+void
+H3Session::set_settings(QuicSettings const &settings)
+{
+  _settings = settings;
+}
+
+// static
+void
+H3Session::set_default_settings(QuicSettings const &settings)
+{
+  _default_settings = settings;
+}
 
 // static
 Errata
@@ -1880,7 +2618,7 @@ H3Session::init(int *process_exit_code, TextView qlog_dir)
 void
 H3Session::terminate()
 {
-  H3Session::terminate(_h3_server_context);
+  H3Session::terminate(_h3_client_context);
   H3Session::terminate(_h3_server_context);
 }
 
@@ -1926,17 +2664,70 @@ H3Session::client_ssl_ctx_init(SSL_CTX *&client_context)
   return errata;
 }
 
+/** Select HTTP/3 from the ALPN protocols offered by a client. */
+static int
+cb_select_h3_alpn(
+    SSL * /* ssl */,
+    unsigned char const **out,
+    unsigned char *outlen,
+    unsigned char const *in,
+    unsigned int inlen,
+    void * /* arg */)
+{
+  auto const *alpn = reinterpret_cast<unsigned char const *>(H3_SERVER_ALPN.data());
+  if (SSL_select_next_proto(
+          const_cast<unsigned char **>(out),
+          outlen,
+          alpn,
+          H3_SERVER_ALPN.size(),
+          in,
+          inlen) == OPENSSL_NPN_NEGOTIATED)
+  {
+    return SSL_TLSEXT_ERR_OK;
+  }
+  Errata errata;
+  errata.error(
+      R"(The client offered no HTTP/3 ALPN protocol: "{}")",
+      TextView{reinterpret_cast<char const *>(in), inlen});
+  return SSL_TLSEXT_ERR_ALERT_FATAL;
+}
+
 // static
 Errata
-H3Session::server_ssl_ctx_init(SSL_CTX *& /* server_context */)
+H3Session::server_ssl_ctx_init(SSL_CTX *&server_context)
 {
   Errata errata;
-#if 0
-  // Add this in once we implement server-side HTTP/3.
+  server_context = SSL_CTX_new(TLS_method());
+  if (!server_context) {
+    errata.error(R"(Failed to create the HTTP/3 server context: {}.)", swoc::bwf::SSLError{});
+    return errata;
+  }
+
+  SSL_CTX_set_min_proto_version(server_context, TLS1_3_VERSION);
+  SSL_CTX_set_max_proto_version(server_context, TLS1_3_VERSION);
+
+  if (SSL_CTX_set_ciphersuites(server_context, QUIC_CIPHERS) != 1) {
+    errata.error("SSL_CTX_set_ciphersuites failed: {}", swoc::bwf::SSLError{});
+    return errata;
+  }
+
+  if (SSL_CTX_set1_groups_list(server_context, QUIC_GROUPS) != 1) {
+    errata.error("SSL_CTX_set1_groups_list failed: {}", swoc::bwf::SSLError{});
+    return errata;
+  }
+
+  errata.note(TLSSession::configure_certificates(server_context));
+  errata.note(TLSSession::configure_session_resumption(server_context));
+  SSL_CTX_set_alpn_select_cb(server_context, cb_select_h3_alpn, nullptr);
+
+  if (SSL_CTX_set_quic_method(server_context, &ssl_quic_method) == 0) {
+    errata.error("SSL_CTX_set_quic_method failed: {}", swoc::bwf::SSLError{});
+    return errata;
+  }
+
   if (TLSSession::tls_secrets_are_being_logged()) {
-    SSL_CTX_set_keylog_callback(client_context, TLSSession::keylog_callback);
+    SSL_CTX_set_keylog_callback(server_context, TLSSession::keylog_callback);
   }
-#endif
 
   return errata;
 }
@@ -1985,6 +2776,24 @@ H3Session::client_ssl_session_init(SSL_CTX *client_context)
   return errata;
 }
 
+Errata
+H3Session::server_ssl_session_init(SSL_CTX *server_context)
+{
+  Errata errata;
+  assert(quic_socket.ssl == nullptr);
+  quic_socket.ssl = SSL_new(server_context);
+  if (quic_socket.ssl == nullptr) {
+    errata.error("Failed to create an HTTP/3 server SSL object: {}", swoc::bwf::SSLError{});
+    return errata;
+  }
+  if (SSL_set_app_data(quic_socket.ssl, this) == 0) {
+    errata.error("SSL_set_app_data failed: {}", swoc::bwf::SSLError{});
+  }
+  SSL_set_accept_state(quic_socket.ssl);
+  SSL_set_quic_use_legacy_codepoint(quic_socket.ssl, 0);
+  return errata;
+}
+
 Errata
 H3Session::receive_responses()
 {
@@ -2019,7 +2828,10 @@ H3Session::client_session_init()
 
   errata.note(quic_socket.open_qlog_file());
 
-  configure_quic_socket_settings(quic_socket, MAX_DRAIN_BUFFER_SIZE);
+  auto settings = _settings;
+  settings.merge(_default_settings);
+  // The server opens no request streams.
+  configure_quic_socket_settings(quic_socket, settings, 1);
 
   if (!quic_socket.local_addr.is_valid()) {
     struct sockaddr_storage socket_address;
@@ -2055,6 +2867,10 @@ H3Session::client_session_init()
   }
 
   ngtcp2_conn_set_tls_native_handle(quic_socket.qconn, quic_socket.ssl);
+  if (_shared_connection != nullptr) {
+    // The server addresses its packets to our ID.
+    _shared_connection->add_connection_id(quic_socket.scid);
+  }
 
   // Commence handshake.
   if (ngtcp2_flush_egress(*this) < 0) {
@@ -2083,6 +2899,472 @@ Errata
 H3Session::server_session_init()
 {
   Errata errata;
-  // TODO: stubbed out. Flesh this out when we implement server-side HTTP/3.
+  auto &connection = *_shared_connection;
+  quic_socket.version = connection.version;
+  quic_socket.local_addr = connection.socket->get_local_addr();
+
+  errata.note(server_ssl_session_init(_h3_server_context));
+  if (!errata.is_ok()) {
+    errata.error("Failure initializing server-side SSL object.");
+    return errata;
+  }
+
+  // Our packets are addressed to the ID the client chose for itself, while
+  // the client addresses its packets to an ID of our choosing.
+  quic_socket.dcid = connection.client_scid;
+  quic_socket.scid.datalen = NGTCP2_MAX_CIDLEN;
+  QuicSocket::randomly_populate_array(quic_socket.scid.data, quic_socket.scid.datalen);
+
+  errata.note(quic_socket.open_qlog_file());
+
+  // A server connection is opened before the client's SNI is known, so it
+  // only has the defaults.
+  configure_quic_socket_settings(quic_socket, _default_settings, QUIC_SERVER_MAX_STREAMS_BIDI);
+  auto &params = quic_socket.transport_params;
+  params.original_dcid = connection.original_dcid;
+  params.stateless_reset_token_present = 1;
+  QuicSocket::randomly_populate_array(
+      params.stateless_reset_token,
+      sizeof(params.stateless_reset_token));
+
+  ngtcp2_path path;
+  memset(&path, 0, sizeof(path));
+  ngtcp2_addr_init(&path.local, quic_socket.local_addr, quic_socket.local_addr.size());
+  ngtcp2_addr_init(&path.remote, &connection.remote.sa, connection.remote.size());
+
+  auto const rc = ngtcp2_conn_server_new(
+      &quic_socket.qconn,
+      &quic_socket.dcid,
+      &quic_socket.scid,
+      &path,
+      quic_socket.version,
+      &server_ngtcp2_callbacks,
+      &quic_socket.settings,
+      &params,
+      nullptr,
+      this /* The user_data in the ngtcp2 callbacks. */);
+  if (rc != 0) {
+    errata.error("ngtcp2_conn_server_new failed: {}", Ngtcp2Error{rc});
+    return errata;
+  }
+
+  ngtcp2_conn_set_tls_native_handle(quic_socket.qconn, quic_socket.ssl);
+  connection.add_connection_id(quic_socket.scid);
   return errata;
 }
+
+/// @return Whether @a lhs and @a rhs are the same connection ID.
+static bool
+cid_equal(ngtcp2_cid const &lhs, ngtcp2_cid const &rhs)
+{
+  return lhs.datalen == rhs.datalen && memcmp(lhs.data, rhs.data, lhs.datalen) == 0;
+}
+
+QuicSharedConnection::QuicSharedConnection(
+    std::shared_ptr<QuicSharedSocket> socket,
+    swoc::IPEndpoint const &remote)
+  : socket{std::move(socket)}
+  , remote{remote}
+{
+}
+
+QuicSharedConnection::QuicSharedConnection(
+    std::shared_ptr<QuicSharedSocket> socket,
+    swoc::IPEndpoint const &remote,
+    ngtcp2_pkt_hd const &initial_header)
+  : socket{std::move(socket)}
+  , remote{remote}
+  , original_dcid{initial_header.dcid}
+  , client_scid{initial_header.scid}
+  , version{initial_header.version}
+{
+}
+
+bool
+QuicSharedConnection::push(swoc::IPEndpoint const &from, uint8_t const *data, size_t size)
+{
+  assert(size <= QuicDatagram::max_payload_size);
+  {
+    std::scoped_lock _{_mutex};
+    if (_closed || _queued.size() >= max_queued) {
+      return false;
+    }
+    auto &datagram = _queued.emplace_back();
+    datagram.remote = from;
+    datagram.size = size;
+    memcpy(datagram.data.data(), data, size);
+  }
+  _cvar.notify_one();
+  return true;
+}
+
+int
+QuicSharedConnection::wait(milliseconds timeout)
+{
+  std::unique_lock lock{_mutex};
+  _cvar.wait_for(lock, timeout, [this]() { return _closed || !_queued.empty(); });
+  if (_closed) {
+    return -1;
+  }
+  return _queued.empty() ? 0 : 1;
+}
+
+std::vector<QuicDatagram> const &
+QuicSharedConnection::take()
+{
+  std::scoped_lock _{_mutex};
+  _taken.clear();
+  // Swapping keeps the storage of both vectors for reuse.
+  _taken.swap(_queued);
+  return _taken;
+}
+
+void
+QuicSharedConnection::add_connection_id(ngtcp2_cid const &cid)
+{
+  {
+    std::scoped_lock _{_mutex};
+    if (_closed) {
+      return;
+    }
+    _connection_ids.push_back(cid);
+  }
+  socket->add_connection_id(cid, shared_from_this());
+}
+
+void
+QuicSharedConnection::remove_connection_id(ngtcp2_cid const &cid)
+{
+  {
+    std::scoped_lock _{_mutex};
+    auto spot = std::find_if(
+        _connection_ids.begin(),
+        _connection_ids.end(),
+        [&cid](ngtcp2_cid const &id) { return cid_equal(id, cid); });
+    if (spot == _connection_ids.end()) {
+      return;
+    }
+    _connection_ids.erase(spot);
+  }
+  socket->remove_connection_id(cid);
+}
+
+void
+QuicSharedConnection::close()
+{
+  std::vector<ngtcp2_cid> connection_ids;
+  {
+    std::scoped_lock _{_mutex};
+    _closed = true;
+    _queued.clear();
+    connection_ids.swap(_connection_ids);
+  }
+  _cvar.notify_all();
+  for (auto const &cid : connection_ids) {
+    socket->remove_connection_id(cid);
+  }
+}
+
+QuicSharedSocket::QuicSharedSocket(int fd, swoc::IPEndpoint const &local_addr)
+  : _fd{fd}
+  , _local_addr{local_addr}
+{
+}
+
+QuicSharedSocket::~QuicSharedSocket()
+{
+  if (_fd >= 0) {
+    ::close(_fd);
+  }
+}
+
+// static
+swoc::Rv<std::shared_ptr<QuicSharedSocket>>
+QuicSharedSocket::open(swoc::IPEndpoint const &addr)
+{
+  swoc::Rv<std::shared_ptr<QuicSharedSocket>> zret;
+  int const socket_fd = ::socket(addr.family(), SOCK_DGRAM, 0);
+  if (socket_fd < 0) {
+    zret.error(R"(Failed to open a UDP socket: {})", Errno{});
+    return zret;
+  }
+  static constexpr int ONE = 1;
+  // SO_REUSEPORT lets a socket per core share the address.
+  if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &ONE, sizeof(ONE)) < 0 ||
+      setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &ONE, sizeof(ONE)) < 0)
+  {
+    zret.error(R"(Could not set address reuse on UDP socket {}: {}.)", socket_fd, Errno{});
+    ::close(socket_fd);
+    return zret;
+  }
+  if (0 != ::fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL, 0) | O_NONBLOCK)) {
+    zret.error(R"(Could not make UDP socket {} non-blocking: {}.)", socket_fd, Errno{});
+    ::close(socket_fd);
+    return zret;
+  }
+  if (::bind(socket_fd, &addr.sa, addr.size()) == -1) {
+    zret.error(R"(Could not bind to {}: {}.)", addr, Errno{});
+    ::close(socket_fd);
+    return zret;
+  }
+  // Learn the port if an ephemeral one was bound.
+  swoc::IPEndpoint local_addr;
+  socklen_t local_addr_len = sizeof(local_addr);
+  if (getsockname(socket_fd, &local_addr.sa, &local_addr_len) == -1) {
+    zret.error(R"(getsockname failed on UDP socket {}: {}.)", socket_fd, Errno{});
+    ::close(socket_fd);
+    return zret;
+  }
+  zret = std::shared_ptr<QuicSharedSocket>(new QuicSharedSocket(socket_fd, local_addr));
+  return zret;
+}
+
+int
+QuicSharedSocket::get_fd() const
+{
+  return _fd;
+}
+
+swoc::IPEndpoint const &
+QuicSharedSocket::get_local_addr() const
+{
+  return _local_addr;
+}
+
+Errata
+QuicSharedSocket::receive(milliseconds timeout, AcceptHandler const &accept_session)
+{
+  Errata errata;
+  struct pollfd pfd = {.fd = _fd, .events = POLLIN, .revents = 0};
+  auto const poll_return = ::poll(&pfd, 1, timeout.count());
+  if (poll_return == 0) {
+    return errata;
+  } else if (poll_return < 0) {
+    if (errno != EINTR) {
+      errata.error("poll failed on HTTP/3 UDP socket {}: {}", _fd, Errno{});
+    }
+    return errata;
+  }
+
+  uint8_t bufs[QUIC_DATAGRAM_BATCH_SIZE][QUIC_MAX_RECV_UDP_PAYLOAD_SIZE];
+  iovec iovs[QUIC_DATAGRAM_BATCH_SIZE];
+  swoc::IPEndpoint remote_addrs[QUIC_DATAGRAM_BATCH_SIZE];
+  mmsghdr msgs[QUIC_DATAGRAM_BATCH_SIZE];
+  for (;;) {
+    memset(msgs, 0, sizeof(msgs));
+    for (auto i = 0u; i < QUIC_DATAGRAM_BATCH_SIZE; ++i) {
+      iovs[i].iov_base = bufs[i];
+      iovs[i].iov_len = sizeof(bufs[i]);
+      msgs[i].msg_hdr.msg_name = &remote_addrs[i].sa;
+      msgs[i].msg_hdr.msg_namelen = sizeof(remote_addrs[i]);
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int const num_datagrams = recvmmsg(_fd, msgs, QUIC_DATAGRAM_BATCH_SIZE, 0, nullptr);
+    if (num_datagrams == -1) {
+      if (errno == EINTR) {
+        continue;
+      } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        errata.error("recvmmsg failed on HTTP/3 UDP socket {}: {}", _fd, Errno{});
+      }
+      return errata;
+    }
+    for (auto i = 0; i < num_datagrams; ++i) {
+      if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        errata.diag(
+            "Dropping an HTTP/3 datagram from {} larger than our {} byte receive limit.",
+            remote_addrs[i],
+            QUIC_MAX_RECV_UDP_PAYLOAD_SIZE);
+        continue;
+      }
+      route(remote_addrs[i], bufs[i], msgs[i].msg_len, accept_session, errata);
+    }
+    if (num_datagrams < static_cast<int>(QUIC_DATAGRAM_BATCH_SIZE)) {
+      // The socket is drained.
+      return errata;
+    }
+  }
+}
+
+void
+QuicSharedSocket::route(
+    swoc::IPEndpoint const &remote,
+    uint8_t const *data,
+    size_t size,
+    AcceptHandler const &accept_session,
+    Errata &errata)
+{
+  uint32_t version = 0;
+  uint8_t const *dcid = nullptr;
+  uint8_t const *scid = nullptr;
+  size_t dcidlen = 0;
+  size_t scidlen = 0;
+  // Short header packets carry no ID length: ours are all NGTCP2_MAX_CIDLEN.
+  auto const rv = ngtcp2_pkt_decode_version_cid(
+      &version,
+      &dcid,
+      &dcidlen,
+      &scid,
+      &scidlen,
+      data,
+      size,
+      NGTCP2_MAX_CIDLEN);
+  if (rv != 0) {
+    errata.diag(
+        "Dropping an undecodable or unsupported version QUIC packet from {}: {}",
+        remote,
+        Ngtcp2Error{rv});
+    return;
+  }
+
+  ngtcp2_cid cid;
+  ngtcp2_cid_init(&cid, dcid, dcidlen);
+  std::shared_ptr<QuicSharedConnection> connection;
+  {
+    std::scoped_lock _{_mutex};
+    if (auto spot = _connections.find(cid); spot != _connections.end()) {
+      connection = spot->second;
+    }
+  }
+  if (connection != nullptr) {
+    if (!connection->push(remote, data, size)) {
+      errata.diag(
+          "Dropping a QUIC packet from {} for a closed connection or one too far behind.",
+          remote);
+    }
+    return;
+  } else if (!accept_session) {
+    errata.diag("Dropping a QUIC packet from {} for an unknown connection.", remote);
+    return;
+  }
+
+  ngtcp2_pkt_hd initial_header;
+  if (ngtcp2_accept(&initial_header, data, size) != 0) {
+    // Likely a packet for a connection which has since closed.
+    errata.diag("Dropping a QUIC packet from {} for an unknown connection.", remote);
+    return;
+  }
+  connection = std::make_shared<QuicSharedConnection>(shared_from_this(), remote, initial_header);
+  // Until the client learns our ID, it keeps using the one it made up.
+  connection->add_connection_id(initial_header.dcid);
+  connection->push(remote, data, size);
+  errata.diag("Accepted an HTTP/3 connection from {}.", remote);
+  accept_session(std::make_unique<H3Session>(std::move(connection)));
+}
+
+void
+QuicSharedSocket::add_connection_id(
+    ngtcp2_cid const &cid,
+    std::shared_ptr<QuicSharedConnection> connection)
+{
+  std::scoped_lock _{_mutex};
+  _connections[cid] = std::move(connection);
+}
+
+void
+QuicSharedSocket::remove_connection_id(ngtcp2_cid const &cid)
+{
+  std::scoped_lock _{_mutex};
+  _connections.erase(cid);
+}
+
+size_t
+QuicSharedSocket::CidHash::operator()(ngtcp2_cid const &cid) const
+{
+  return std::hash<std::string_view>{}(
+      std::string_view{reinterpret_cast<char const *>(cid.data), cid.datalen});
+}
+
+bool
+QuicSharedSocket::CidEqual::operator()(ngtcp2_cid const &lhs, ngtcp2_cid const &rhs) const
+{
+  return cid_equal(lhs, rhs);
+}
+
+std::mutex QuicClientSocketPool::_pool_mutex;
+std::unordered_map<int, QuicClientSocketPool::Sockets> QuicClientSocketPool::_sockets;
+std::vector<std::thread> QuicClientSocketPool::_threads;
+std::atomic<bool> QuicClientSocketPool::_shutdown{false};
+unsigned QuicClientSocketPool::_sockets_per_core = 0;
+
+// static
+void
+QuicClientSocketPool::set_sockets_per_core(unsigned sockets_per_core)
+{
+  _sockets_per_core = sockets_per_core;
+}
+
+// static
+bool
+QuicClientSocketPool::is_enabled()
+{
+  return _sockets_per_core > 0;
+}
+
+// static
+swoc::Rv<std::shared_ptr<QuicSharedSocket>>
+QuicClientSocketPool::get_socket(swoc::TextView interface, swoc::IPEndpoint const &target)
+{
+  swoc::Rv<std::shared_ptr<QuicSharedSocket>> zret;
+  std::scoped_lock _{_pool_mutex};
+  // The client has a single interface, so the family alone selects the
+  // sockets.
+  auto &sockets = _sockets[target.family()];
+  if (sockets._sockets.empty()) {
+    swoc::IPEndpoint local_addr;
+    if (interface.empty()) {
+      local_addr.set_to_any(target.family());
+    } else {
+      InterfaceNameToEndpoint interface_to_endpoint{interface, target.family()};
+      auto &&[device_endpoint, device_errata] = interface_to_endpoint.find_ip_endpoint();
+      zret.note(std::move(device_errata));
+      if (!zret.is_ok()) {
+        return zret;
+      }
+      local_addr = device_endpoint;
+    }
+    local_addr.port() = 0;
+    auto const socket_count = std::max(1u, std::thread::hardware_concurrency()) * _sockets_per_core;
+    for (auto i = 0u; i < socket_count; ++i) {
+      auto &&[socket, open_errata] = QuicSharedSocket::open(local_addr);
+      zret.note(std::move(open_errata));
+      if (!zret.is_ok()) {
+        zret.error("Could not open the shared HTTP/3 client sockets on {}.", local_addr);
+        return zret;
+      }
+      sockets._sockets.push_back(socket);
+      _threads.emplace_back(QuicClientSocketPool::receive, std::move(socket));
+    }
+    zret.diag(
+        "Opened {} shared HTTP/3 client sockets for {}.",
+        socket_count,
+        swoc::IPEndpoint::family_name(target.family()));
+  }
+  zret = sockets._sockets[sockets._next];
+  sockets._next = (sockets._next + 1) % sockets._sockets.size();
+  return zret;
+}
+
+// static
+void
+QuicClientSocketPool::receive(std::shared_ptr<QuicSharedSocket> socket)
+{
+  // An empty handler: servers do not open connections to clients.
+  QuicSharedSocket::AcceptHandler const no_accept;
+  while (!_shutdown) {
+    socket->receive(QUIC_CLIENT_SOCKET_POLL_INTERVAL, no_accept);
+  }
+}
+
+// static
+void
+QuicClientSocketPool::terminate()
+{
+  _shutdown = true;
+  std::scoped_lock _{_pool_mutex};
+  for (auto &thread : _threads) {
+    thread.join();
+  }
+  _threads.clear();
+  _sockets.clear();
+}
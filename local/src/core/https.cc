@@ -8,13 +8,18 @@
 #include "core/https.h"
 #include "core/ProxyVerifier.h"
 
+#include <cmath>
+#include <cstring>
 #include <dirent.h>
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
 #include <openssl/bio.h>
 #include <openssl/err.h>
+#include <openssl/rand.h>
 #include <openssl/ssl.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "swoc/bwf_ex.h"
 #include "swoc/bwf_ip.h"
@@ -26,11 +31,13 @@ using namespace swoc::literals;
 using namespace std::literals;
 
 namespace chrono = std::chrono;
+using chrono::duration_cast;
+using chrono::microseconds;
 using chrono::milliseconds;
+using ClockType = std::chrono::system_clock;
 
 std::unordered_map<std::string, TLSHandshakeBehavior> TLSSession::_handshake_behavior_per_sni;
 
-std::mutex TLSSession::tls_secrets_log_file_fd_mutex;
 int TLSSession::tls_secrets_log_file_fd = -1;
 swoc::file::path TLSSession::tls_secrets_log_file;
 
@@ -231,6 +238,16 @@ TLSSession::read(swoc::MemSpan<char> span)
   if (this->is_closed()) {
     return swoc::Rv<ssize_t>{0};
   }
+  if (!_early_data_received.empty()) {
+    return swoc::Rv<ssize_t>{static_cast<ssize_t>(take_early_data(span))};
+  }
+  if (early_data_is_pending()) {
+    swoc::Rv<ssize_t> handshake_result{0};
+    handshake_result.note(complete_early_data());
+    if (!handshake_result.is_ok() || this->is_closed()) {
+      return handshake_result;
+    }
+  }
   swoc::Rv<ssize_t> zret{SSL_read(this->_ssl, span.data(), span.size())};
 
   if (zret <= 0) {
@@ -253,11 +270,28 @@ TLSSession::read(swoc::MemSpan<char> span)
   return zret;
 }
 
+swoc::Rv<ssize_t>
+TLSSession::discard(size_t n)
+{
+  auto const buffer = discard_buffer();
+  return read({buffer.data(), std::min(n, buffer.size())});
+}
+
 swoc::Rv<ssize_t>
 TLSSession::write(TextView view)
 {
-  TextView remaining = view;
   swoc::Rv<ssize_t> num_written = 0;
+  if (early_data_is_pending()) {
+    if (_early_data_sent.size() + view.size() <= _max_early_data) {
+      return write_early_data(view);
+    }
+    // Beyond the session's limit, the rest waits on the handshake.
+    num_written.note(complete_early_data());
+    if (!num_written.is_ok()) {
+      return num_written;
+    }
+  }
+  TextView remaining = view;
   static int write_count = 0;
   ++write_count;
   while (!remaining.empty()) {
@@ -293,6 +327,85 @@ TLSSession::write(TextView view)
   return num_written;
 }
 
+swoc::Rv<ssize_t>
+TLSSession::write_early_data(TextView view)
+{
+  swoc::Rv<ssize_t> num_written = 0;
+  if (_early_data_sent.empty()) {
+    // The client hello goes out with the first of the early data.
+    _handshake_start = ClockType::now();
+  }
+  TextView remaining = view;
+  while (!remaining.empty()) {
+    size_t n = 0;
+    if (SSL_write_early_data(this->_ssl, remaining.data(), remaining.size(), &n) == 1) {
+      // Whatever has gone out must be resent if the proxy rejects it, even if
+      // a later chunk fails.
+      _early_data_sent.append(remaining.data(), n);
+      remaining.remove_prefix(n);
+      num_written.result() += n;
+      continue;
+    }
+    auto const ssl_error = SSL_get_error(this->_ssl, 0);
+    auto &&[poll_return, poll_errata] = poll_for_data_on_ssl_socket(Poll_Timeout, ssl_error);
+    num_written.note(std::move(poll_errata));
+    if (poll_return > 0) {
+      continue;
+    } else if (!num_written.is_ok()) {
+      num_written.error(R"(Failed SSL_write_early_data: {}.)", swoc::bwf::Errno{});
+    } else if (poll_return == 0) {
+      num_written.error("Timed out waiting to SSL_write_early_data after: {}.", Poll_Timeout);
+    }
+    return num_written;
+  }
+  return num_written;
+}
+
+bool
+TLSSession::can_send_content_file() const
+{
+  return false;
+}
+
+swoc::Rv<ssize_t>
+TLSSession::writev(swoc::MemSpan<iovec> iov)
+{
+  // Gathering into one record-sized buffer means a small header and body go
+  // out in a single TLS record instead of one record per buffer.
+  static constexpr size_t MAX_TLS_RECORD_PAYLOAD = 16 * 1024;
+  swoc::LocalBufferWriter<MAX_TLS_RECORD_PAYLOAD> w;
+  swoc::Rv<ssize_t> num_written{0};
+
+  auto const flush = [&](TextView data) -> bool {
+    auto &&[n, write_errata] = write(data);
+    num_written.note(std::move(write_errata));
+    num_written.result() += n;
+    return n == static_cast<ssize_t>(data.size());
+  };
+
+  for (auto const &buffer : iov) {
+    TextView data{static_cast<char const *>(buffer.iov_base), buffer.iov_len};
+    if (data.size() > w.remaining() && w.size() > 0) {
+      if (!flush(w.view())) {
+        return num_written;
+      }
+      w.clear();
+    }
+    if (data.size() >= w.capacity()) {
+      // Too large to benefit from coalescing: write it directly.
+      if (!flush(data)) {
+        return num_written;
+      }
+    } else {
+      w.write(data);
+    }
+  }
+  if (w.size() > 0) {
+    flush(w.view());
+  }
+  return num_written;
+}
+
 swoc::Rv<int>
 TLSSession::poll_for_data_on_ssl_socket(chrono::milliseconds timeout, int ssl_error)
 {
@@ -316,13 +429,10 @@ TLSSession::poll_for_data_on_ssl_socket(chrono::milliseconds timeout, int ssl_er
         swoc::bwf::Errno{});
     return zret;
   }
-  short events = 0;
-  if (ssl_error == SSL_ERROR_WANT_READ) {
-    events = POLLIN;
-  } else if (ssl_error == SSL_ERROR_WANT_WRITE) {
-    events = POLLOUT;
+  if (ssl_error == SSL_ERROR_WANT_WRITE) {
+    return poll_for_writable(timeout);
   }
-  return poll_for_data_on_socket(timeout, events);
+  return poll_for_data_on_socket(timeout, POLLIN);
 }
 
 // Complete the TLS handshake (server-side).
@@ -343,6 +453,15 @@ TLSSession::accept()
     errata.error(R"(Failed SSL_set_fd: {}.)", swoc::bwf::SSLError{});
     return errata;
   }
+  _early_data_received.clear();
+  if (server_max_early_data > 0) {
+    // Early data is only accepted if it is read before the handshake
+    // otherwise proceeds.
+    errata.note(read_early_data());
+    if (!errata.is_ok() || this->is_closed()) {
+      return errata;
+    }
+  }
   int retval = SSL_accept(_ssl);
   while (retval < 0) {
     auto const ssl_error = SSL_get_error(_ssl, retval);
@@ -375,9 +494,68 @@ TLSSession::accept()
     // Poll succeeded.
     retval = SSL_accept(_ssl);
   }
+  flush_keylog();
   errata.diag("Finished accept using TLSSession");
   return errata;
 }
+
+Errata
+TLSSession::read_early_data()
+{
+  Errata errata;
+  char buffer[4 * 1024];
+  while (true) {
+    size_t n = 0;
+    auto const result = SSL_read_early_data(_ssl, buffer, sizeof(buffer), &n);
+    if (result == SSL_READ_EARLY_DATA_SUCCESS) {
+      _early_data_received.append(buffer, n);
+      continue;
+    } else if (result == SSL_READ_EARLY_DATA_FINISH) {
+      break;
+    }
+    auto const ssl_error = SSL_get_error(_ssl, 0);
+    if (ssl_error != SSL_ERROR_WANT_READ && ssl_error != SSL_ERROR_WANT_WRITE) {
+      errata.error(R"(Failed SSL_read_early_data: {}.)", swoc::bwf::SSLError{_ssl, 0});
+      return errata;
+    }
+    auto &&[poll_return, poll_errata] = poll_for_data_on_ssl_socket(Poll_Timeout, ssl_error);
+    errata.note(std::move(poll_errata));
+    if (!errata.is_ok()) {
+      errata.error(R"(Failed SSL_read_early_data during poll: {}.)", swoc::bwf::Errno{});
+      return errata;
+    } else if (poll_return == 0) {
+      errata.error("Timed out waiting to SSL_read_early_data after {}.", Poll_Timeout);
+      return errata;
+    } else if (poll_return < 0) {
+      // Connection closed.
+      errata.diag("Connection closed during poll for SSL_read_early_data.");
+      return errata;
+    }
+  }
+  if (SSL_get_early_data_status(_ssl) == SSL_EARLY_DATA_ACCEPTED) {
+    errata.diag(R"(Accepted {} bytes of TLS early data.)", _early_data_received.size());
+  }
+  return errata;
+}
+
+size_t
+TLSSession::take_early_data(swoc::MemSpan<char> span)
+{
+  auto const n = std::min(span.size(), _early_data_received.size());
+  memcpy(span.data(), _early_data_received.data(), n);
+  _early_data_received.erase(0, n);
+  return n;
+}
+
+swoc::Rv<int>
+TLSSession::poll_for_headers(milliseconds timeout)
+{
+  if (!_early_data_received.empty()) {
+    // The request arrived as early data, along with the client hello.
+    return 1;
+  }
+  return Session::poll_for_headers(timeout);
+}
 Errata
 TLSSession::connect()
 {
@@ -408,6 +586,34 @@ TLSSession::connect(SSL_CTX *client_context)
         _client_verify_mode);
     SSL_set_verify(_ssl, _client_verify_mode, nullptr /* No verify_callback is passed */);
   }
+  _offered_session = false;
+  _early_data = EarlyData::NONE;
+  _early_data_sent.clear();
+  _handshake_duration = microseconds{0};
+  _time_first_transaction = TLSSessionCache::early_data_is_enabled();
+  if (TLSSessionCache::is_enabled()) {
+    _session_cache_key = TLSSessionCache::make_key(get_fd(), _client_sni, client_context);
+    _offered_session = TLSSessionCache::prepare(_ssl, _session_cache_key);
+  }
+  _handshake_start = ClockType::now();
+  if (_offered_session && TLSSessionCache::early_data_is_enabled()) {
+    _max_early_data = SSL_SESSION_get_max_early_data(SSL_get0_session(_ssl));
+    if (_max_early_data > 0) {
+      errata.diag(
+          R"(Deferring the TLS handshake to send up to {} bytes of early data.)",
+          _max_early_data);
+      _early_data = EarlyData::PENDING;
+      return errata;
+    }
+  }
+  errata.note(complete_handshake());
+  return errata;
+}
+
+Errata
+TLSSession::complete_handshake()
+{
+  Errata errata;
   int retval = SSL_connect(_ssl);
   while (retval < 0) {
     auto const ssl_error = SSL_get_error(_ssl, retval);
@@ -442,6 +648,17 @@ TLSSession::connect(SSL_CTX *client_context)
     // Poll succeeded.
     retval = SSL_connect(_ssl);
   }
+  if (retval == 1) {
+    _handshake_duration = duration_cast<microseconds>(ClockType::now() - _handshake_start);
+    bool const resumed = SSL_session_reused(_ssl) == 1;
+    errata.diag(
+        R"({} TLS handshake with the proxy took {}{}.)",
+        resumed ? "Resumed" : "Full",
+        _handshake_duration,
+        _offered_session && !resumed ? ", the offered session having been declined" : "");
+    TLSSessionCache::record_handshake(_offered_session, resumed, _handshake_duration);
+  }
+  flush_keylog();
 
   auto const verify_result = SSL_get_verify_result(_ssl);
   errata.diag(
@@ -451,6 +668,70 @@ TLSSession::connect(SSL_CTX *client_context)
   return errata;
 }
 
+Errata
+TLSSession::complete_early_data()
+{
+  Errata errata = complete_handshake();
+  if (!errata.is_ok() || is_closed()) {
+    return errata;
+  }
+  auto const status = SSL_get_early_data_status(_ssl);
+  if (status == SSL_EARLY_DATA_NOT_SENT) {
+    // Nothing was written before the first read.
+    _early_data = EarlyData::NONE;
+  } else if (status == SSL_EARLY_DATA_ACCEPTED) {
+    errata.diag(R"(The proxy accepted {} bytes of TLS early data.)", _early_data_sent.size());
+    _early_data = EarlyData::ACCEPTED;
+    TLSSessionCache::record_early_data(true);
+  } else {
+    // The proxy discarded the early data, so it has to be sent again now
+    // that the handshake is complete.
+    errata.diag(
+        R"(The proxy rejected TLS early data: resending {} bytes.)",
+        _early_data_sent.size());
+    _early_data = EarlyData::REJECTED;
+    TLSSessionCache::record_early_data(false);
+    auto &&[n, write_errata] = write(_early_data_sent);
+    errata.note(std::move(write_errata));
+  }
+  _early_data_sent.clear();
+  return errata;
+}
+
+Errata
+TLSSession::run_transaction(Txn const &json_txn)
+{
+  if (!_time_first_transaction) {
+    return super_type::run_transaction(json_txn);
+  }
+  auto const before = ClockType::now();
+  Errata errata = super_type::run_transaction(json_txn);
+  if (errata.is_ok()) {
+    record_transaction_latency(duration_cast<microseconds>(ClockType::now() - before));
+  }
+  return errata;
+}
+
+void
+TLSSession::record_transaction_latency(microseconds elapsed)
+{
+  if (!_time_first_transaction) {
+    return;
+  }
+  _time_first_transaction = false;
+  // With early data, the handshake completed during the transaction.
+  if (_early_data != EarlyData::ACCEPTED && _early_data != EarlyData::REJECTED) {
+    elapsed += _handshake_duration;
+  }
+  bool const zero_rtt = _early_data == EarlyData::ACCEPTED;
+  Errata errata;
+  errata.diag(
+      R"(The first transaction over the TLS connection took {} as {}.)",
+      elapsed,
+      zero_rtt ? "0-RTT" : "1-RTT");
+  TLSSessionCache::record_first_transaction(zero_rtt, elapsed);
+}
+
 void
 TLSSession::close()
 {
@@ -459,6 +740,7 @@ TLSSession::close()
       SSL_free(_ssl);
       _ssl = nullptr;
     }
+    flush_keylog();
     super_type::close();
   }
 }
@@ -467,6 +749,9 @@ swoc::file::path TLSSession::certificate_file;
 swoc::file::path TLSSession::privatekey_file;
 swoc::file::path TLSSession::ca_certificate_file;
 swoc::file::path TLSSession::ca_certificate_dir;
+int TLSSession::server_session_cache_size = -1;
+swoc::file::path TLSSession::ticket_key_file;
+uint32_t TLSSession::server_max_early_data = 0;
 SSL_CTX *TLSSession::server_context = nullptr;
 SSL_CTX *TLSSession::client_context = nullptr;
 
@@ -729,6 +1014,93 @@ TLSSession::configure_certificates(SSL_CTX *&context)
   return errata;
 }
 
+// static
+swoc::Rv<std::string>
+TLSSession::load_ticket_keys()
+{
+  // A key name, an HMAC secret, and an AES key, as SSL_CTX_set_tlsext_ticket_keys
+  // expects them.
+  static constexpr size_t TICKET_KEYS_SIZE = 16 + 32 + 32;
+  swoc::Rv<std::string> zret;
+  std::error_code ec;
+  zret.result() = swoc::file::load(ticket_key_file, ec);
+  if (ec.value() == ENOENT) {
+    std::array<unsigned char, TICKET_KEYS_SIZE> keys;
+    if (RAND_bytes(keys.data(), keys.size()) != 1) {
+      zret.error(R"(Failed to generate session ticket keys: {}.)", swoc::bwf::SSLError{});
+      return zret;
+    }
+    std::string temporary_file;
+    swoc::bwprint(temporary_file, "{}.{}", ticket_key_file, getpid());
+    int const fd = ::open(temporary_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+      zret.error(R"(Failed to create "{}": {}.)", temporary_file, swoc::bwf::Errno{});
+      return zret;
+    }
+    bool const written = ::write(fd, keys.data(), keys.size()) == ssize_t(keys.size());
+    ::close(fd);
+    // link fails with EEXIST if another process got there first, in which case
+    // its keys are the ones to use.
+    if (!written ||
+        (link(temporary_file.c_str(), ticket_key_file.c_str()) != 0 && errno != EEXIST))
+    {
+      zret.error(R"(Failed to create "{}": {}.)", ticket_key_file, swoc::bwf::Errno{});
+      unlink(temporary_file.c_str());
+      return zret;
+    }
+    unlink(temporary_file.c_str());
+    zret.result() = swoc::file::load(ticket_key_file, ec);
+  }
+  if (ec.value()) {
+    zret.error(R"(Error loading "{}": {})", ticket_key_file, ec);
+  } else if (zret.result().size() != TICKET_KEYS_SIZE) {
+    zret.error(
+        R"("{}" has {} bytes rather than the {} bytes of session ticket keys.)",
+        ticket_key_file,
+        zret.result().size(),
+        TICKET_KEYS_SIZE);
+  }
+  return zret;
+}
+
+// static
+Errata
+TLSSession::configure_session_resumption(SSL_CTX *context)
+{
+  Errata errata;
+  // Without a session ID context, OpenSSL refuses to resume sessions once a
+  // client certificate is requested, which the server does per SNI.
+  static constexpr std::string_view SESSION_ID_CONTEXT = "verifier-server";
+  SSL_CTX_set_session_id_context(
+      context,
+      reinterpret_cast<unsigned char const *>(SESSION_ID_CONTEXT.data()),
+      SESSION_ID_CONTEXT.size());
+  if (server_session_cache_size == 0) {
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_OFF);
+  } else if (server_session_cache_size > 0) {
+    SSL_CTX_sess_set_cache_size(context, server_session_cache_size);
+  }
+  if (server_max_early_data > 0) {
+    // OpenSSL's replay protection makes the tickets of sessions allowing
+    // early data single use by way of the session cache, so early data is
+    // only accepted on the server which issued the ticket.
+    SSL_CTX_set_max_early_data(context, server_max_early_data);
+    SSL_CTX_set_recv_max_early_data(context, server_max_early_data);
+  }
+  if (ticket_key_file.empty()) {
+    return errata;
+  }
+  auto &&[keys, keys_errata] = load_ticket_keys();
+  errata.note(std::move(keys_errata));
+  if (!errata.is_ok()) {
+    return errata;
+  }
+  if (SSL_CTX_set_tlsext_ticket_keys(context, keys.data(), keys.size()) != 1) {
+    errata.error(R"(Failed to set the session ticket keys: {}.)", swoc::bwf::SSLError{});
+  }
+  return errata;
+}
+
 // static
 bool
 TLSSession::tls_secrets_are_being_logged()
@@ -736,30 +1108,47 @@ TLSSession::tls_secrets_are_being_logged()
   return tls_secrets_log_file_fd != -1;
 }
 
+struct TLSSession::KeylogLines
+{
+  std::string _lines;
+
+  void
+  flush()
+  {
+    if (_lines.empty()) {
+      return;
+    }
+    if (tls_secrets_log_file_fd != -1) {
+      LogFileWriter::write(tls_secrets_log_file_fd, std::move(_lines));
+    }
+    _lines.clear();
+  }
+
+  /// Lines collected since the thread's last handshake are not lost.
+  ~KeylogLines() { flush(); }
+};
+
+thread_local TLSSession::KeylogLines TLSSession::keylog_lines;
+
 // static
 void
 TLSSession::keylog_callback(SSL const * /* ssl */, char const *line)
 {
   if (tls_secrets_log_file_fd == -1) {
-    // Likely a previous write has failed and the log was closed.
     return;
   }
-  Errata errata;
-  std::scoped_lock _{tls_secrets_log_file_fd_mutex};
-  ssize_t rc = ::write(tls_secrets_log_file_fd, line, strlen(line));
-  if (rc == -1) {
-    errata.error("Failed to write to TLS secrets log file: {}", swoc::bwf::Errno{});
-    ::close(tls_secrets_log_file_fd);
-    tls_secrets_log_file_fd = -1;
-  }
+  // Collecting the lines of a handshake spares an allocation and a turn at
+  // the LogFileWriter's lock for each line.
+  auto &lines = keylog_lines._lines;
+  lines.append(line);
+  lines += '\n';
+}
 
-  constexpr char const *LF = "\n";
-  rc = ::write(tls_secrets_log_file_fd, LF, strlen(LF));
-  if (rc == -1) {
-    errata.error("Failed to write to TLS secrets log file: {}", swoc::bwf::Errno{});
-    ::close(tls_secrets_log_file_fd);
-    tls_secrets_log_file_fd = -1;
-  }
+// static
+void
+TLSSession::flush_keylog()
+{
+  keylog_lines.flush();
 }
 
 // static
@@ -777,6 +1166,7 @@ TLSSession::client_init(SSL_CTX *&client_context)
   if (tls_secrets_are_being_logged()) {
     SSL_CTX_set_keylog_callback(client_context, keylog_callback);
   }
+  TLSSessionCache::configure_context(client_context);
   return errata;
 }
 
@@ -794,6 +1184,7 @@ TLSSession::server_init(SSL_CTX *&server_context)
   /* Register for the client hello callback so we can inspect the SNI
    * for dynamic server behavior (such as requesting a client cert). */
   SSL_CTX_set_client_hello_cb(server_context, client_hello_callback, nullptr);
+  errata.note(configure_session_resumption(server_context));
 
   if (tls_secrets_are_being_logged()) {
     SSL_CTX_set_keylog_callback(server_context, keylog_callback);
@@ -840,3 +1231,212 @@ TLSSession::get_alpn_protocol_string_for_sni(std::string_view sni)
   }
   return it->second.get_alpn_wire_string();
 }
+
+std::mutex TLSSessionCache::_sessions_mutex;
+std::unordered_map<std::string, SSL_SESSION *> TLSSessionCache::_sessions;
+int TLSSessionCache::_key_index = -1;
+double TLSSessionCache::_resumption_ratio = 0.0;
+bool TLSSessionCache::_early_data = false;
+std::atomic<uint64_t> TLSSessionCache::_prepared{0};
+std::atomic<uint64_t> TLSSessionCache::_full_handshakes{0};
+std::atomic<uint64_t> TLSSessionCache::_resumed_handshakes{0};
+std::atomic<uint64_t> TLSSessionCache::_rejected_resumptions{0};
+std::atomic<uint64_t> TLSSessionCache::_full_handshake_us{0};
+std::atomic<uint64_t> TLSSessionCache::_resumed_handshake_us{0};
+std::atomic<uint64_t> TLSSessionCache::_accepted_early_data{0};
+std::atomic<uint64_t> TLSSessionCache::_rejected_early_data{0};
+std::atomic<uint64_t> TLSSessionCache::_zero_rtt_transactions{0};
+std::atomic<uint64_t> TLSSessionCache::_one_rtt_transactions{0};
+std::atomic<uint64_t> TLSSessionCache::_zero_rtt_us{0};
+std::atomic<uint64_t> TLSSessionCache::_one_rtt_us{0};
+
+// static
+void
+TLSSessionCache::set_resumption_ratio(double ratio)
+{
+  _resumption_ratio = ratio;
+  if (_key_index < 0) {
+    _key_index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  }
+}
+
+// static
+bool
+TLSSessionCache::is_enabled()
+{
+  return _resumption_ratio > 0.0;
+}
+
+// static
+void
+TLSSessionCache::set_early_data(bool enable)
+{
+  _early_data = enable;
+}
+
+// static
+bool
+TLSSessionCache::early_data_is_enabled()
+{
+  return _early_data && is_enabled();
+}
+
+// static
+void
+TLSSessionCache::configure_context(SSL_CTX *context)
+{
+  if (!is_enabled()) {
+    return;
+  }
+  // OpenSSL's internal cache is keyed by session ID, which is of no use for
+  // finding a session for a given target, so only the callback keeps them.
+  SSL_CTX_set_session_cache_mode(
+      context,
+      SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(context, new_session_callback);
+}
+
+// static
+std::string
+TLSSessionCache::make_key(int fd, std::string_view sni, SSL_CTX const *context)
+{
+  std::string key;
+  if (!sni.empty()) {
+    swoc::bwprint(key, "{}/{}", sni, context);
+    return key;
+  }
+  swoc::IPEndpoint target;
+  socklen_t target_len = sizeof(target);
+  if (getpeername(fd, &target.sa, &target_len) == -1) {
+    target.invalidate();
+  }
+  swoc::bwprint(key, "{}/{}", target, context);
+  return key;
+}
+
+// static
+bool
+TLSSessionCache::prepare(SSL *ssl, std::string const &key)
+{
+  // The const_cast is safe: new_session_callback only reads the key.
+  SSL_set_ex_data(ssl, _key_index, const_cast<std::string *>(&key));
+
+  SSL_SESSION *session = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(_sessions_mutex);
+    auto spot = _sessions.find(key);
+    if (spot == _sessions.end()) {
+      // There is nothing to resume, so this handshake does not take a turn.
+      return false;
+    }
+    // Spread the resumptions evenly: handshake n resumes if the running
+    // count of resumptions owed, n * ratio, reaches another whole number.
+    auto const n = _prepared++;
+    if (std::floor((n + 1) * _resumption_ratio) <= std::floor(n * _resumption_ratio)) {
+      return false;
+    }
+    session = spot->second;
+    SSL_SESSION_up_ref(session);
+  }
+  bool const offered = SSL_set_session(ssl, session) == 1;
+  SSL_SESSION_free(session);
+  return offered;
+}
+
+// static
+int
+TLSSessionCache::new_session_callback(SSL *ssl, SSL_SESSION *session)
+{
+  auto const *key = static_cast<std::string const *>(SSL_get_ex_data(ssl, _key_index));
+  if (key == nullptr || SSL_SESSION_is_resumable(session) != 1) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(_sessions_mutex);
+  auto &cached = _sessions[*key];
+  if (cached != nullptr) {
+    SSL_SESSION_free(cached);
+  }
+  // Returning 1 hands the caller's reference to the cache.
+  cached = session;
+  return 1;
+}
+
+// static
+void
+TLSSessionCache::record_handshake(bool offered, bool resumed, microseconds duration)
+{
+  auto const us = static_cast<uint64_t>(duration.count());
+  if (resumed) {
+    ++_resumed_handshakes;
+    _resumed_handshake_us += us;
+  } else {
+    ++_full_handshakes;
+    _full_handshake_us += us;
+    if (offered) {
+      ++_rejected_resumptions;
+    }
+  }
+}
+
+// static
+void
+TLSSessionCache::record_early_data(bool accepted)
+{
+  if (accepted) {
+    ++_accepted_early_data;
+  } else {
+    ++_rejected_early_data;
+  }
+}
+
+// static
+void
+TLSSessionCache::record_first_transaction(bool zero_rtt, microseconds latency)
+{
+  auto const us = static_cast<uint64_t>(latency.count());
+  if (zero_rtt) {
+    ++_zero_rtt_transactions;
+    _zero_rtt_us += us;
+  } else {
+    ++_one_rtt_transactions;
+    _one_rtt_us += us;
+  }
+}
+
+// static
+void
+TLSSessionCache::terminate()
+{
+  if (!is_enabled()) {
+    return;
+  }
+  auto const average = [](uint64_t total_us, uint64_t count) {
+    return microseconds{count == 0 ? 0 : total_us / count};
+  };
+  Errata errata;
+  errata.info(
+      "TLS handshakes: {} full averaging {}, {} resumed averaging {}, {} offered sessions "
+      "declined.",
+      _full_handshakes.load(),
+      average(_full_handshake_us, _full_handshakes),
+      _resumed_handshakes.load(),
+      average(_resumed_handshake_us, _resumed_handshakes),
+      _rejected_resumptions.load());
+  if (_early_data) {
+    errata.info(
+        "TLS early data: {} accepted, {} rejected. First transactions: {} 0-RTT averaging {}, "
+        "{} 1-RTT averaging {}.",
+        _accepted_early_data.load(),
+        _rejected_early_data.load(),
+        _zero_rtt_transactions.load(),
+        average(_zero_rtt_us, _zero_rtt_transactions),
+        _one_rtt_transactions.load(),
+        average(_one_rtt_us, _one_rtt_transactions));
+  }
+
+  std::lock_guard<std::mutex> lock(_sessions_mutex);
+  for (auto &[key, session] : _sessions) {
+    SSL_SESSION_free(session);
+  }
+  _sessions.clear();
+}
@@ -332,6 +332,26 @@ RuleCheck::invert_if_applicable(bool input) const
   }
 }
 
+/** Compile @a value as a request template if it contains template tokens.
+ *
+ * Malformed templates are reported when the rule is parsed from the replay
+ * file, so they never reach a verification.
+ *
+ * @return The compiled template, or nullopt if @a value is a plain value.
+ */
+static std::optional<RequestTemplate>
+compile_value_template(TextView value)
+{
+  if (!RequestTemplate::has_tokens(value)) {
+    return std::nullopt;
+  }
+  auto &&[value_template, errata] = RequestTemplate::compile(value);
+  if (!errata.is_ok()) {
+    return std::nullopt;
+  }
+  return std::move(value_template);
+}
+
 EqualityCheck::EqualityCheck(TextView name, TextView value, bool is_inverted, bool is_nocase)
 {
   _name = name;
@@ -339,6 +359,7 @@ EqualityCheck::EqualityCheck(TextView name, TextView value, bool is_inverted, bo
   _is_field = true;
   _is_inverted = is_inverted;
   _is_nocase = is_nocase;
+  _value_template = compile_value_template(value);
 }
 
 EqualityCheck::EqualityCheck(UrlPart url_part, TextView value, bool is_inverted, bool is_nocase)
@@ -348,6 +369,7 @@ EqualityCheck::EqualityCheck(UrlPart url_part, TextView value, bool is_inverted,
   _is_field = false;
   _is_inverted = is_inverted;
   _is_nocase = is_nocase;
+  _value_template = compile_value_template(value);
 }
 
 EqualityCheck::EqualityCheck(
@@ -507,7 +529,7 @@ EqualityCheck::test(TextView key, TextView name, TextView value) const
         target_type(),
         _name,
         _value);
-  } else if ((!_is_nocase && strcmp(value, _value)) || (_is_nocase && strcasecmp(value, _value))) {
+  } else if (!value_matches(value)) {
     errata.info(
         R"({}Equals {}: Different. Key: "{}", {}: "{}", Correct Value: "{}", Actual Value: "{}")",
         get_subtype(),
@@ -543,6 +565,18 @@ EqualityCheck::test(TextView key, TextView name, TextView value) const
   return invert_if_applicable(false);
 }
 
+bool
+EqualityCheck::value_matches(TextView value) const
+{
+  if (_value_template) {
+    return _value_template->matches(value, _is_nocase);
+  }
+  if (_is_nocase) {
+    return strcasecmp(value, _value) == 0;
+  }
+  return strcmp(value, _value) == 0;
+}
+
 bool
 EqualityCheck::test(TextView key, TextView name, std::vector<TextView> const &values) const
 {
@@ -12,6 +12,7 @@
 #include "core/ProxyVerifier.h"
 #include "core/YamlParser.h"
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <condition_variable>
@@ -19,9 +20,15 @@
 #include <cstring>
 #include <deque>
 #include <libgen.h>
+#include <limits>
+#include <list>
+#include <map>
 #include <mutex>
+#include <optional>
+#include <set>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include <dirent.h>
 #include <fcntl.h>
@@ -235,6 +242,172 @@ parse_request_certificate(YAML::Node const &tls_node)
 
 std::unordered_map<std::string, Txn, std::hash<std::string_view>> Transactions;
 
+/// A transaction whose key contains request template tokens.
+struct TemplatedTransaction
+{
+  RequestTemplate _key_template; ///< The compiled key.
+  swoc::TextView _key;           ///< The key as written, owned by Transactions.
+  Txn *_txn = nullptr;           ///< The transaction in Transactions.
+};
+
+/** Transactions whose keys contain request template tokens.
+ *
+ * The client renders such keys differently for each repetition of a session,
+ * so lookups that miss in Transactions fall back to matching the received key
+ * against these compiled key templates. They are indexed by the literal prefix
+ * of their key so that a lookup only tries templates that can match. Each
+ * bucket is ordered by key so that the result does not depend on the order in
+ * which replay files were loaded.
+ */
+std::unordered_map<std::string_view, std::vector<TemplatedTransaction>> Templated_Transactions;
+
+/// The distinct literal prefix lengths in Templated_Transactions, longest first.
+std::set<size_t, std::greater<size_t>> Templated_Prefix_Lengths;
+
+/** Find the specified transaction for a received request's key.
+ *
+ * Templated keys with a longer literal prefix are more specific and are
+ * preferred over those with a shorter one.
+ *
+ * @param[in] key The key derived from the received request.
+ *
+ * @return The transaction or nullptr if no transaction matches the key.
+ */
+Txn *
+find_transaction(std::string const &key)
+{
+  if (auto spot{Transactions.find(key)}; spot != Transactions.end()) {
+    return &spot->second;
+  }
+  std::string_view const key_view{key};
+  for (auto const prefix_length : Templated_Prefix_Lengths) {
+    if (prefix_length > key_view.size()) {
+      continue;
+    }
+    auto const bucket{Templated_Transactions.find(key_view.substr(0, prefix_length))};
+    if (bucket == Templated_Transactions.end()) {
+      continue;
+    }
+    for (auto const &candidate : bucket->second) {
+      if (candidate._key_template.matches(key)) {
+        return candidate._txn;
+      }
+    }
+  }
+  return nullptr;
+}
+
+/** A response to send once its transaction's delay has elapsed. */
+struct ScheduledResponse
+{
+  Txn *_txn = nullptr;      ///< The transaction whose response to send.
+  int32_t _stream_id = -1;  ///< The stream of the request, for HTTP/2 and HTTP/3.
+  bool _is_http2 = false;   ///< Whether the request was received over HTTP/2.
+  bool _is_http3 = false;   ///< Whether the request was received over HTTP/3.
+  std::string _key;         ///< The key of the request, for logging.
+};
+
+/** A connection's delayed responses, ordered by when they are due.
+ *
+ * Responses due at the same time stay in the order they were scheduled.
+ */
+using ResponseSchedule = std::multimap<std::chrono::steady_clock::time_point, ScheduledResponse>;
+
+/** Write the response described by @a response to @a session.
+ *
+ * @param[in] session The connection upon which to write the response.
+ * @param[in] response The response to write.
+ * @param[in] more_requests_received Whether further responses are about to be
+ * written, either to pipelined requests or to other ended HTTP/2 streams, in
+ * which case the response is held to be written with theirs.
+ *
+ * @return Any messaging from writing the response.
+ */
+swoc::Errata
+send_response(Session &session, ScheduledResponse const &response, bool more_requests_received)
+{
+  swoc::Errata errata;
+  // The transaction is shared by every connection serving its key, so the
+  // stream is passed along rather than set in the response.
+  auto const &rsp = response._txn->_rsp;
+  if (more_requests_received) {
+    session.hold_output();
+  }
+  auto &&[bytes_written, write_errata] = session.write_response(rsp, response._stream_id);
+  errata.note(std::move(write_errata));
+  if (!more_requests_received) {
+    errata.note(session.flush_output().errata());
+  }
+  auto const protocol = response._is_http3 ? "HTTP/3" : response._is_http2 ? "HTTP/2" : "HTTP/1";
+  if (more_requests_received && session.has_held_output()) {
+    errata.diag(
+        "Queued an {} response to request with key {} with response status {} "
+        "to be written with the responses that follow it:\n{}",
+        protocol,
+        response._key,
+        rsp._status,
+        rsp);
+  } else {
+    errata.diag(
+        "Wrote {} bytes in an {} response to request with key {} "
+        "with response status {}:\n{}",
+        bytes_written,
+        protocol,
+        response._key,
+        rsp._status,
+        rsp);
+  }
+  return errata;
+}
+
+/** Send the responses in @a schedule which are due.
+ *
+ * @return How long until the next scheduled response is due, capped at
+ * Thread_Sleep_Interval.
+ */
+std::chrono::milliseconds
+send_due_responses(Session &session, ResponseSchedule &schedule, swoc::Errata &errata)
+{
+  auto const now = std::chrono::steady_clock::now();
+  while (!schedule.empty() && schedule.begin()->first <= now) {
+    // Responses falling due together are sent together.
+    auto const next = std::next(schedule.begin());
+    bool const more_due = next != schedule.end() && next->first <= now;
+    errata.note(send_response(session, schedule.begin()->second, more_due));
+    schedule.erase(schedule.begin());
+  }
+  if (schedule.empty()) {
+    return Thread_Sleep_Interval;
+  }
+  // Round up so that the poll does not wake just before the response is due.
+  auto const until_due =
+      std::chrono::ceil<std::chrono::milliseconds>(schedule.begin()->first - now);
+  return std::min<std::chrono::milliseconds>(until_due, Thread_Sleep_Interval);
+}
+
+/** Send the rest of @a schedule as each response falls due, once no further
+ * requests will be read from the connection.
+ *
+ * Responses which cannot be sent, because the connection closes or the server
+ * is shutting down first, are reported as errors.
+ */
+void
+send_remaining_responses(Session &session, ResponseSchedule &schedule, swoc::Errata &errata)
+{
+  while (!schedule.empty() && !Shutdown_Flag && !session.is_closed()) {
+    auto const until_due = send_due_responses(session, schedule, errata);
+    if (!schedule.empty()) {
+      sleep_for(until_due);
+    }
+  }
+  for (auto const &[due, response] : schedule) {
+    errata.error(
+        R"(Dropped the delayed response to the request with key {}: the connection closed before it was due.)",
+        response._key);
+  }
+  schedule.clear();
+}
+
 class ServerReplayFileHandler : public ReplayFileHandler
 {
 public:
@@ -425,10 +598,19 @@ ServerReplayFileHandler::handle_protocol_node(YAML::Node const &proxy_request_no
     errata.note(std::move(http_node.errata()));
     return errata;
   }
+  std::optional<H2Settings> h2_settings;
   if (http_node.result().IsDefined() && http_node.result()[YAML_SSN_PROTOCOL_VERSION]) {
     if (http_node.result()[YAML_SSN_PROTOCOL_VERSION].Scalar() == "2") {
       _txn._req.set_is_http2();
       _txn._rsp.set_is_http2();
+      if (http_node.result()[YAML_SSN_HTTP_SETTINGS_KEY]) {
+        auto &&[settings, settings_errata] = parse_h2_settings(http_node);
+        if (!settings_errata.is_ok()) {
+          errata.note(std::move(settings_errata));
+          return errata;
+        }
+        h2_settings = settings;
+      }
     } else if (http_node.result()[YAML_SSN_PROTOCOL_VERSION].Scalar() == "3") {
       _txn._req.set_is_http3();
       _txn._rsp.set_is_http3();
@@ -440,15 +622,27 @@ ServerReplayFileHandler::handle_protocol_node(YAML::Node const &proxy_request_no
     errata.note(std::move(tls_node.errata()));
     return errata;
   }
-  if (!tls_node.result()) {
-    return errata;
+  std::string sni;
+  if (tls_node.result()) {
+    auto const &sni_rv = parse_sni(tls_node);
+    if (!sni_rv.is_ok()) {
+      errata.note(std::move(sni_rv.errata()));
+      return errata;
+    }
+    sni = sni_rv.result();
   }
-  auto const &sni_rv = parse_sni(tls_node);
-  if (!sni_rv.is_ok()) {
-    errata.note(std::move(sni_rv.errata()));
-    return errata;
+  if (h2_settings) {
+    // The server sends its SETTINGS when the connection is accepted, before
+    // any request identifies the replay session, so they are keyed by SNI.
+    if (sni.empty()) {
+      errata.warn(
+          R"(HTTP/2 settings at "{}":{} are ignored by the server without a tls "sni".)",
+          _path,
+          http_node.result().Mark().line);
+    } else {
+      H2Session::register_settings_for_sni(sni, *h2_settings);
+    }
   }
-  auto const sni = sni_rv.result();
   if (sni.empty()) {
     return errata;
   }
@@ -538,7 +732,24 @@ ServerReplayFileHandler::txn_close()
     // in some places. For this reason make sure the response is aware of the
     // key.
     _txn._rsp.set_key(_key);
-    Transactions.emplace(_key, std::move(_txn));
+    auto const [spot, inserted] = Transactions.emplace(_key, std::move(_txn));
+    if (inserted && RequestTemplate::has_tokens(spot->first)) {
+      // The template refers to the key string owned by Transactions.
+      auto &&[key_template, template_errata] = RequestTemplate::compile(spot->first);
+      errata.note(std::move(template_errata));
+      swoc::TextView const key{spot->first};
+      auto const prefix = key.prefix(key_template.literal_prefix_size());
+      auto &bucket = Templated_Transactions[prefix];
+      auto const position = std::upper_bound(
+          bucket.begin(),
+          bucket.end(),
+          key,
+          [](std::string_view lhs, TemplatedTransaction const &rhs) {
+            return lhs < std::string_view{rhs._key};
+          });
+      bucket.insert(position, {std::move(key_template), key, &spot->second});
+      Templated_Prefix_Lengths.insert(prefix.size());
+    }
   }
   this->txn_reset();
   LoadMutex.unlock();
@@ -579,12 +790,15 @@ TF_Serve_Connection(std::thread *t)
     }
 
     errata = thread_info._session->accept();
+    // Delayed responses wait here rather than blocking the thread so that the
+    // connection continues to read and serve other requests meanwhile.
+    ResponseSchedule schedule;
     while (!Shutdown_Flag && !thread_info._session->is_closed() && errata.is_ok()) {
       swoc::Errata thread_errata;
 
+      auto const poll_timeout = send_due_responses(*thread_info._session, schedule, thread_errata);
       // Poll so we can timeout and check for shutdown.
-      auto &&[poll_return, poll_errata] =
-          thread_info._session->poll_for_headers(Thread_Sleep_Interval);
+      auto &&[poll_return, poll_errata] = thread_info._session->poll_for_headers(poll_timeout);
       thread_errata.note(poll_errata);
       if (poll_return == 0) {
         // Poll timed out. Loop back around.
@@ -598,8 +812,7 @@ TF_Serve_Connection(std::thread *t)
         break;
       }
 
-      swoc::LocalBufferWriter<MAX_HDR_SIZE> w;
-      auto &&[req_hdr, read_header_errata] = thread_info._session->read_and_parse_request(w);
+      auto &&[req_hdr, read_header_errata] = thread_info._session->read_and_parse_request();
       thread_errata.note(std::move(read_header_errata));
       if (!thread_errata.is_ok()) {
         thread_errata.error("Could not read the header.");
@@ -615,20 +828,23 @@ TF_Serve_Connection(std::thread *t)
       auto const is_http2 = req_hdr->is_http2();
       auto const is_http3 = req_hdr->is_http3();
       auto key{req_hdr->get_key()};
-      auto specified_transaction_it{Transactions.find(key)};
+      auto *specified_transaction_p = find_transaction(key);
 
-      if (specified_transaction_it == Transactions.end()) {
+      if (specified_transaction_p == nullptr) {
         thread_errata.error(R"(Proxy request with key "{}" not found, sending a 404.)", key);
         Engine::process_exit_code = 1;
         HttpHeader not_found_response =
             get_not_found_response(stream_id, req_hdr->get_http_protocol());
         not_found_response.update_content_length(req_hdr->_method);
+        // Responses to earlier requests still go out, and for HTTP/1 they
+        // must precede this one.
+        send_remaining_responses(*thread_info._session, schedule, thread_errata);
         thread_info._session->write(not_found_response);
         // This will end the loop and eventually drop the connection.
         break;
       }
 
-      [[maybe_unused]] auto &[unused_key, specified_transaction] = *specified_transaction_it;
+      auto &specified_transaction = *specified_transaction_p;
 
       thread_errata.note(req_hdr->update_content_length(req_hdr->_method));
       thread_errata.note(req_hdr->update_transfer_encoding());
@@ -650,7 +866,7 @@ TF_Serve_Connection(std::thread *t)
           req_hdr->_content_size = specified_transaction._req._content_size;
         }
         auto &&[bytes_drained, drain_errata] =
-            thread_info._session->drain_body(*req_hdr, req_hdr->_content_size, w.view());
+            thread_info._session->drain_body(*req_hdr, req_hdr->_content_size);
         thread_errata.note(std::move(drain_errata));
 
         if (!thread_errata.is_ok()) {
@@ -669,29 +885,35 @@ TF_Serve_Connection(std::thread *t)
       // expectations so the body is not written for responses to such
       // requests.
       specified_transaction._rsp.update_content_length(req_hdr->_method);
-      if (is_http3) {
-        specified_transaction._rsp.set_is_http3();
-        specified_transaction._rsp._stream_id = stream_id;
-      } else if (is_http2) {
-        specified_transaction._rsp.set_is_http2();
-        specified_transaction._rsp._stream_id = stream_id;
-      }
-      if (specified_transaction._user_specified_delay_duration > 0us) {
-        sleep_for(specified_transaction._user_specified_delay_duration);
+      ScheduledResponse response{&specified_transaction, stream_id, is_http2, is_http3, key};
+      auto const delay = specified_transaction._user_specified_delay_duration;
+      // HTTP/1 responses must be sent in request order, so once one is
+      // delayed, those after it wait their turn behind it.
+      bool const must_follow_scheduled = !is_http3 && !is_http2 && !schedule.empty();
+      if (delay > 0us || must_follow_scheduled) {
+        auto due = std::chrono::steady_clock::now() + delay;
+        if (must_follow_scheduled) {
+          due = std::max(due, schedule.rbegin()->first);
+        }
+        schedule.emplace(due, std::move(response));
+        // A response held to go out with this one's must not wait for this
+        // one's delay: send it now.
+        thread_errata.note(thread_info._session->flush_output().errata());
+        continue;
       }
-      auto &&[bytes_written, write_errata] =
-          thread_info._session->write(specified_transaction._rsp);
-      thread_errata.note(std::move(write_errata));
-      thread_errata.diag(
-          "Wrote {} bytes in an {}{}{} response to request with key {} "
-          "with response status {}:\n{}",
-          bytes_written,
-          swoc::bwf::If(is_http3, "HTTP/3"),
-          swoc::bwf::If(is_http2, "HTTP/2"),
-          swoc::bwf::If(!is_http3 && !is_http2, "HTTP/1"),
-          key,
-          specified_transaction._rsp._status,
-          specified_transaction._rsp);
+      // If the client pipelined further requests, or has ended further HTTP/2
+      // streams, which are already received, hold this response so that it
+      // goes out with theirs. For HTTP/2 this lets the DATA frames of all the
+      // ready streams be interleaved rather than sent one stream after the
+      // other.
+      bool const more_requests_received =
+          !is_http3 && thread_info._session->has_buffered_header();
+      thread_errata.note(send_response(*thread_info._session, response, more_requests_received));
+    }
+    send_remaining_responses(*thread_info._session, schedule, errata);
+    if (!thread_info._session->is_closed()) {
+      // Send anything held for a batch that an error cut short.
+      errata.note(thread_info._session->flush_output().errata());
     }
 
     // cleanup and get ready for another session.
@@ -699,8 +921,37 @@ TF_Serve_Connection(std::thread *t)
   }
 }
 
+/// The protocol spoken on the connections of a TCP listening socket.
+enum class ListenProtocol {
+  HTTP,  ///< HTTP/1.x over TCP.
+  HTTPS, ///< HTTP/1.x or HTTP/2, as negotiated via TLS ALPN.
+  H2C,   ///< HTTP/2 over cleartext TCP, with prior knowledge.
+};
+
+/** Pass a newly accepted session to a worker thread, which serves it.
+ *
+ * @param[in] session The session to serve.
+ *
+ * @return Any messaging from finding a worker.
+ */
+swoc::Errata
+hand_off_session(std::unique_ptr<Session> session)
+{
+  swoc::Errata errata;
+  ServerThreadInfo *thread_info =
+      dynamic_cast<ServerThreadInfo *>(Server_Thread_Pool.get_worker());
+  if (nullptr == thread_info) {
+    errata.error("Failed to get worker thread");
+  } else {
+    std::unique_lock<std::mutex> lock(thread_info->_mutex);
+    thread_info->_session = session.release();
+    thread_info->_cvar.notify_one();
+  }
+  return errata;
+}
+
 void
-TF_Accept(int socket_fd, bool do_https, bool do_http3)
+TF_Accept(int socket_fd, ListenProtocol protocol)
 {
   std::unique_ptr<Session> session;
   struct pollfd pfd = {.fd = socket_fd, .events = POLLIN, .revents = 0};
@@ -729,12 +980,14 @@ TF_Accept(int socket_fd, bool do_https, bool do_http3)
     if (0 != ::fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK)) {
       errata.error("Failed to make the server socket non-blocking: {}", swoc::bwf::Errno{});
     }
-    if (do_http3) {
-      session = std::make_unique<H3Session>();
-    } else if (do_https) {
+    if (protocol == ListenProtocol::HTTPS) {
       // H2Session will figure out the HTTP protocol during the TLS handshake
       // and handle HTTP/1.x or HTTP/2 accordingly.
       session = std::make_unique<H2Session>();
+    } else if (protocol == ListenProtocol::H2C) {
+      auto h2_session = std::make_unique<H2Session>();
+      h2_session->set_is_cleartext(true);
+      session = std::move(h2_session);
     } else {
       session = std::make_unique<Session>();
     }
@@ -742,31 +995,37 @@ TF_Accept(int socket_fd, bool do_https, bool do_http3)
     if (!errata.is_ok()) {
       continue;
     }
-    ServerThreadInfo *thread_info =
-        dynamic_cast<ServerThreadInfo *>(Server_Thread_Pool.get_worker());
-    if (nullptr == thread_info) {
-      errata.error("Failed to get worker thread");
-    } else {
-      std::unique_lock<std::mutex> lock(thread_info->_mutex);
-      thread_info->_session = session.release();
-      thread_info->_cvar.notify_one();
-    }
+    errata.note(hand_off_session(std::move(session)));
   }
 }
 
-constexpr bool DO_HTTPS = true;
-constexpr bool DO_HTTP3 = true;
+/** Receive HTTP/3 datagrams on @a socket until shutdown.
+ *
+ * Each new QUIC connection is handed off to a worker thread, as a TCP
+ * connection is by TF_Accept.
+ */
+void
+TF_Accept_HTTP3(std::shared_ptr<QuicSharedSocket> socket)
+{
+  auto const accept_session = [](std::unique_ptr<H3Session> session) {
+    swoc::Errata errata = hand_off_session(std::move(session));
+  };
+  while (!Shutdown_Flag) {
+    // Receive with a timeout so that we can check whether the user requested a shutdown.
+    swoc::Errata errata = socket->receive(Thread_Sleep_Interval, accept_session);
+  }
+}
 
 swoc::Errata
-do_listen(swoc::IPEndpoint &server_addr, bool do_https, bool do_http3)
+do_listen(swoc::IPEndpoint &server_addr, ListenProtocol protocol)
 {
   swoc::Errata errata;
   int socket_fd = socket(server_addr.family(), SOCK_STREAM, 0);
   std::string protocol_description;
-  if (do_http3) {
-    protocol_description = "HTTP/3";
-  } else if (do_https) {
+  if (protocol == ListenProtocol::HTTPS) {
     protocol_description = "HTTPS (HTTP/2 or HTTP/1.x)";
+  } else if (protocol == ListenProtocol::H2C) {
+    protocol_description = "h2c (HTTP/2 over cleartext TCP)";
   } else {
     protocol_description = "HTTP/1.x";
   }
@@ -782,7 +1041,7 @@ do_listen(swoc::IPEndpoint &server_addr, bool do_https, bool do_http3)
           int listen_result = listen(socket_fd, 16384);
           if (listen_result == 0) {
             errata.info(R"(Listening for {} at: {})", protocol_description, server_addr);
-            auto runner = std::make_unique<std::thread>(TF_Accept, socket_fd, do_https, do_http3);
+            auto runner = std::make_unique<std::thread>(TF_Accept, socket_fd, protocol);
             Accept_Threads.push_back(std::move(runner));
           } else {
             errata.error(R"(Could not listen to {}: {}.)", server_addr, swoc::bwf::Errno{});
@@ -806,20 +1065,51 @@ do_listen(swoc::IPEndpoint &server_addr, bool do_https, bool do_http3)
   return errata;
 }
 
+/** Listen for HTTP/3 at @a server_addr.
+ *
+ * A UDP socket is bound for each core, sharing the address. The kernel
+ * spreads clients across the sockets and each socket's thread routes its
+ * datagrams to their connections.
+ */
+swoc::Errata
+do_listen_http3(swoc::IPEndpoint &server_addr)
+{
+  swoc::Errata errata;
+  auto const num_sockets = std::max(1u, std::thread::hardware_concurrency());
+  for (auto i = 0u; i < num_sockets; ++i) {
+    auto &&[socket, open_errata] = QuicSharedSocket::open(server_addr);
+    errata.note(std::move(open_errata));
+    if (!errata.is_ok()) {
+      return errata;
+    }
+    // Share the port actually bound, which the kernel picks if none was
+    // asked for.
+    server_addr = socket->get_local_addr();
+    auto runner = std::make_unique<std::thread>(TF_Accept_HTTP3, socket);
+    Accept_Threads.push_back(std::move(runner));
+  }
+  errata.info(R"(Listening for HTTP/3 at: {} on {} sockets)", server_addr, num_sockets);
+  return errata;
+}
+
 void
 Engine::command_run()
 {
   { // Scope errata before the long-lived server loop.
     Errata errata;
     auto args{arguments.get("run")};
-    std::deque<swoc::IPEndpoint> server_addrs, server_addrs_https, server_addrs_http3;
+    std::deque<swoc::IPEndpoint> server_addrs, server_addrs_https, server_addrs_http3,
+        server_addrs_h2c;
 
     auto server_addr_http_arg{arguments.get("listen-http")};
     auto server_addr_https_arg{arguments.get("listen-https")};
     auto server_addr_http3_arg{arguments.get("listen-http3")};
-    if (!server_addr_http_arg && !server_addr_https_arg && !server_addr_http3_arg) {
+    auto server_addr_h2c_arg{arguments.get("listen-h2c")};
+    if (!server_addr_http_arg && !server_addr_https_arg && !server_addr_http3_arg &&
+        !server_addr_h2c_arg)
+    {
       errata.error(
-          R"(Must provide at least one of "--listen-http", "--listen-https", or "--listen-http3" arguments")");
+          R"(Must provide at least one of "--listen-http", "--listen-https", "--listen-http3", or "--listen-h2c" arguments")");
       process_exit_code = 1;
       return;
     }
@@ -883,10 +1173,23 @@ Engine::command_run()
         process_exit_code = 1;
         return;
       }
-      if (errata.is_ok()) {
-        // TODO: When server-side HTTP/3 is implemented, add a --qlog-dir
-        // option like the client has and pass that here.
-        errata.note(H3Session::init(&process_exit_code, ""));
+    }
+
+    if (server_addr_h2c_arg) {
+      if (server_addr_h2c_arg.size() != 1) {
+        errata.error(
+            R"(--listen-h2c option must have a single value, a comma separated list of listen address and port.)");
+        process_exit_code = 1;
+        return;
+      }
+      errata = parse_ips(server_addr_h2c_arg[0], server_addrs_h2c);
+      if (!errata.is_ok()) {
+        process_exit_code = 1;
+        return;
+      }
+      if (!server_addr_https_arg && !server_addr_http3_arg) {
+        // TLS is not otherwise initialized, and h2c does not need it.
+        errata.note(H2Session::init_cleartext(&process_exit_code));
       }
     }
 
@@ -909,6 +1212,33 @@ Engine::command_run()
           return;
         }
       }
+      auto cache_size_arg{arguments.get("tls-session-cache-size")};
+      if (cache_size_arg.size() == 1) {
+        auto const cache_size = atoi(cache_size_arg[0].c_str());
+        if (cache_size < 0) {
+          errata.error(R"("--tls-session-cache-size" must not be negative.)");
+          process_exit_code = 1;
+          return;
+        }
+        TLSSession::server_session_cache_size = cache_size;
+      }
+      auto ticket_key_file_arg{arguments.get("tls-ticket-key-file")};
+      if (ticket_key_file_arg.size() == 1) {
+        TLSSession::ticket_key_file = swoc::file::path{ticket_key_file_arg[0]};
+      }
+      auto max_early_data_arg{arguments.get("tls-max-early-data")};
+      if (max_early_data_arg.size() == 1) {
+        swoc::TextView const text{max_early_data_arg[0]};
+        swoc::TextView parsed;
+        auto const max_early_data = swoc::svtou(text, &parsed);
+        if (parsed.size() != text.size() ||
+            max_early_data > std::numeric_limits<uint32_t>::max()) {
+          errata.error(R"("--tls-max-early-data" must be a number of bytes.)");
+          process_exit_code = 1;
+          return;
+        }
+        TLSSession::server_max_early_data = static_cast<uint32_t>(max_early_data);
+      }
       if (errata.is_ok()) {
         auto tls_secrets_log_file_arg{arguments.get("tls-secrets-log-file")};
         std::string tls_secrets_log_file;
@@ -919,6 +1249,40 @@ Engine::command_run()
         errata.note(H2Session::init(&process_exit_code));
       }
     }
+    if (server_addr_http3_arg && errata.is_ok()) {
+      // This follows TLSSession::init so that the HTTP/3 context gets the
+      // certificates and the TLS secrets log.
+      auto qlog_dir_arg{arguments.get("qlog-dir")};
+      std::string qlog_dir;
+      if (qlog_dir_arg) {
+        qlog_dir = qlog_dir_arg[0];
+      }
+      errata.note(H3Session::init(&process_exit_code, qlog_dir));
+      if (!errata.is_ok()) {
+        process_exit_code = 1;
+        return;
+      }
+    }
+    if (auto h2_settings_arg{arguments.get("h2-settings")}; h2_settings_arg.size() == 1) {
+      H2Settings h2_settings;
+      errata.note(h2_settings.parse(h2_settings_arg[0]));
+      if (!errata.is_ok()) {
+        errata.error(R"(Invalid "--h2-settings" value "{}".)", h2_settings_arg[0]);
+        process_exit_code = 1;
+        return;
+      }
+      H2Session::set_default_settings(h2_settings);
+    }
+    if (auto quic_settings_arg{arguments.get("quic-settings")}; quic_settings_arg.size() == 1) {
+      QuicSettings quic_settings;
+      errata.note(quic_settings.parse(quic_settings_arg[0]));
+      if (!errata.is_ok()) {
+        errata.error(R"(Invalid "--quic-settings" value "{}".)", quic_settings_arg[0]);
+        process_exit_code = 1;
+        return;
+      }
+      H3Session::set_default_settings(quic_settings);
+    }
 
     errata.note(YamlParser::load_replay_files(
         swoc::file::path{args[0]},
@@ -952,7 +1316,7 @@ Engine::command_run()
     for (auto &server_addr : server_addrs) {
       // Set up listen port.
       if (server_addr.is_valid()) {
-        errata.note(do_listen(server_addr, !DO_HTTPS, !DO_HTTP3));
+        errata.note(do_listen(server_addr, ListenProtocol::HTTP));
       }
       if (!errata.is_ok()) {
         process_exit_code = 1;
@@ -961,12 +1325,17 @@ Engine::command_run()
     }
     for (auto &server_addr_https : server_addrs_https) {
       if (server_addr_https.is_valid()) {
-        errata.note(do_listen(server_addr_https, DO_HTTPS, !DO_HTTP3));
+        errata.note(do_listen(server_addr_https, ListenProtocol::HTTPS));
+      }
+    }
+    for (auto &server_addr_h2c : server_addrs_h2c) {
+      if (server_addr_h2c.is_valid()) {
+        errata.note(do_listen(server_addr_h2c, ListenProtocol::H2C));
       }
     }
     for (auto &server_addr_http3 : server_addrs_http3) {
       if (server_addr_http3.is_valid()) {
-        errata.note(do_listen(server_addr_http3, DO_HTTPS, DO_HTTP3));
+        errata.note(do_listen_http3(server_addr_http3));
       }
     }
   } // End of scope for errata so it gets logged.
@@ -985,6 +1354,7 @@ Engine::command_run()
   TLSSession::terminate();
   H2Session::terminate();
   H3Session::terminate();
+  LogFileWriter::terminate();
   exit(Engine::process_exit_code);
 }
 
@@ -1050,10 +1420,14 @@ main(int /* argc */, char const *argv[])
           "",
           1,
           "")
-#if 0
-      // Server-side HTTP/3 is not implemented yet. Don't confuse the user by
-      // showing this option. When we implement server-side HTTP/3, uncomment
-      // this code.
+      .add_option(
+          "--listen-h2c",
+          "",
+          "Address and port on which to accept HTTP/2 over cleartext TCP (h2c) "
+          "with prior knowledge. Can be a comma separated list.",
+          "",
+          1,
+          "")
       .add_option(
           "--listen-http3",
           "",
@@ -1061,7 +1435,14 @@ main(int /* argc */, char const *argv[])
           "",
           1,
           "")
-#endif
+      .add_option(
+          "--qlog-dir",
+          "",
+          "The directory in which to store QUIC log files. By default no QUIC "
+          "logging is performed.",
+          "",
+          1,
+          "")
       .add_option("--format", "-f", "Transaction key format", "", 1, "")
       .add_option(
           "--server-cert",
@@ -1081,6 +1462,27 @@ main(int /* argc */, char const *argv[])
           "",
           1,
           "")
+      .add_option(
+          "--h2-settings",
+          "",
+          "A comma separated list of HTTP/2 settings for connections whose "
+          "SNI has none in the replay files, such as "
+          "\"initial-window-size=1048576,connection-window-size=16777216\". "
+          "Also accepted are max-concurrent-streams, max-frame-size, and "
+          "header-table-size.",
+          "",
+          1,
+          "")
+      .add_option(
+          "--quic-settings",
+          "",
+          "A comma separated list of QUIC settings for HTTP/3 connections, "
+          "such as \"initial-max-streams-bidi=1000,congestion-control=bbr\". "
+          "Also accepted are initial-max-data, initial-max-stream-data, "
+          "initial-max-streams-uni, max-udp-payload-size, and pacing.",
+          "",
+          1,
+          "")
       .add_option(
           "--tls-secrets-log-file",
           "",
@@ -1089,6 +1491,33 @@ main(int /* argc */, char const *argv[])
           "",
           1,
           "")
+      .add_option(
+          "--tls-session-cache-size",
+          "",
+          "The number of TLS sessions to cache for session ID resumption. 0 "
+          "disables the cache, leaving only session tickets. By default "
+          "OpenSSL's cache size is used.",
+          "",
+          1,
+          "")
+      .add_option(
+          "--tls-ticket-key-file",
+          "",
+          "A file of 80 bytes of TLS session ticket keys. Server processes "
+          "given the same file resume each other's sessions. The file is "
+          "created with random keys if it does not exist.",
+          "",
+          1,
+          "")
+      .add_option(
+          "--tls-max-early-data",
+          "",
+          "The number of bytes of TLS 1.3 early data (0-RTT) the sessions the "
+          "server issues allow, and which the server accepts on resumption. "
+          "By default early data is not allowed.",
+          "",
+          1,
+          "")
       .add_option(
           "--strict",
           "-s",
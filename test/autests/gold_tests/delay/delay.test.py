@@ -108,3 +108,46 @@ r.ReturnCode = 0
 r.Streams.stdout += Testers.ContainsExpression(
     'Good',
     f'The verifier script should report success.')
+
+#
+# Test 5: Run HTTP/2 streams with server-side delays on one connection.
+#
+r = Test.AddTestRun("Verify that server-side delays of concurrent HTTP/2 streams overlap.")
+server = r.AddServerProcess("server_concurrent_delay", "concurrent-server-delay.yaml",
+                            configure_http3=False)
+client = r.AddClientProcess("client_concurrent_delay", "concurrent-server-delay.yaml",
+                            configure_http=False, configure_http3=False,
+                            https_ports=[server.Variables.https_port],
+                            other_args="--no-proxy")
+
+# The undelayed response is not held behind the delayed ones.
+server.Streams.stdout = "concurrent_server_delay_server.gold"
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "3 transactions in 1 sessions .* in .* milliseconds",
+    "The client should have reported running the transactions with timing data.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+server.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+#
+# Test 6: Verify that the delays were scheduled rather than slept in turn.
+#
+r = Test.AddTestRun("Verify the concurrent server-side delays took about one delay to run.")
+client_output = client.Streams.stdout.AbsTestPath
+expected_min_delay_ms = "1000"
+expected_max_delay_ms = "1900"
+r.Processes.Default.Setup.Copy(verifier_script)
+
+r.Processes.Default.Command = \
+    f'python3 {verifier_script} {client_output} {expected_min_delay_ms} ' \
+    f'--max-milliseconds {expected_max_delay_ms}'
+r.ReturnCode = 0
+r.Streams.stdout += Testers.ContainsExpression(
+    'Good',
+    f'The verifier script should report success.')
@@ -62,6 +62,10 @@ def parse_args():
                         help='The minimum number of milliseconds the '
                         'replay should have taken.')
 
+    parser.add_argument('--max-milliseconds', type=int, default=None,
+                        help='The maximum number of milliseconds the '
+                        'replay should have taken.')
+
     return parser.parse_args()
 
 
@@ -69,20 +73,25 @@ def main():
     args = parse_args()
 
     min_milliseconds = args.min_milliseconds
+    max_milliseconds = args.max_milliseconds
     for line in args.client_output:
         if not line_has_timing_data(line):
             continue
 
         duration_in_ms = get_replay_duration(line)
 
-        if duration_in_ms >= min_milliseconds:
-            print(f'Good: replay took {duration_in_ms} ms which is more '
-                  f'than required {min_milliseconds} ms')
-            return 0
-        else:
+        if duration_in_ms < min_milliseconds:
             print(f'Bad: replay took {duration_in_ms} ms which is less than '
                   f'than required {min_milliseconds} ms')
             return 1
+        elif max_milliseconds is not None and duration_in_ms > max_milliseconds:
+            print(f'Bad: replay took {duration_in_ms} ms which is more than '
+                  f'the allowed {max_milliseconds} ms')
+            return 1
+        else:
+            print(f'Good: replay took {duration_in_ms} ms which is more '
+                  f'than required {min_milliseconds} ms')
+            return 0
 
 
 if __name__ == '__main__':
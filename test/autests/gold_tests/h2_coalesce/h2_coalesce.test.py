@@ -0,0 +1,53 @@
+'''
+Verify HTTP/2 connection coalescing across sessions.
+'''
+# @file
+#
+# Copyright 2021, Verizon Media
+# SPDX-License-Identifier: Apache-2.0
+#
+
+Test.Summary = '''
+Verify HTTP/2 connection coalescing across sessions.
+'''
+
+#
+# Test 1: Verify that sessions for the same target and SNI share a connection
+# and that each stream is verified against its own session's transaction.
+#
+r = Test.AddTestRun("Verify --h2-coalesce")
+server = r.AddServerProcess("server", "replay_files/coalesced.yaml",
+                            configure_http3=False)
+client = r.AddClientProcess("client", "replay_files/coalesced.yaml",
+                            configure_http=False, configure_http3=False,
+                            https_ports=[server.Variables.https_port],
+                            single_threaded=False,
+                            other_args="--no-proxy --h2-coalesce 10")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "Opening a pooled HTTP/2 connection for",
+    "The client should open a pooled connection.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    r"Opening a pooled HTTP/2 connection for[\s\S]*Opening a pooled HTTP/2 connection for",
+    "The sessions should all fit on the one pooled connection.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "6 transactions in 3 sessions",
+    "The client should replay all the transactions.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "closed with its connection before its response was received",
+    "No stream should be lost with the shared connection.")
+
+server.Streams.stdout += Testers.ContainsExpression(
+    "Received an HTTP/2 request for stream id 11:",
+    "The server should receive the six streams on one connection.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+server.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
@@ -0,0 +1,53 @@
+'''
+Verify HTTP/2 over cleartext TCP (h2c) with prior knowledge.
+'''
+# @file
+#
+# Copyright 2021, Verizon Media
+# SPDX-License-Identifier: Apache-2.0
+#
+
+Test.Summary = '''
+Verify HTTP/2 over cleartext TCP (h2c) with prior knowledge.
+'''
+
+#
+# Test 1: Verify an h2c session from the client directly to the server.
+#
+r = Test.AddTestRun("Verify --connect-h2c and --listen-h2c")
+server = r.AddServerProcess("server", "replay_files/h2c.yaml",
+                            configure_https=False, configure_http3=False,
+                            configure_h2c=True)
+client = r.AddClientProcess("client", "replay_files/h2c.yaml",
+                            configure_http=False, configure_https=False,
+                            configure_http3=False,
+                            h2c_ports=[server.Variables.h2c_port],
+                            other_args="--no-proxy")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    r"Connecting via HTTP/2 over cleartext TCP \(h2c\).",
+    "The client should replay the session as h2c.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "Received an HTTP/2 response for stream id 3:",
+    "The client should receive the response to the second stream.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "2 transactions in 1 sessions",
+    "The client should replay both transactions.")
+
+server.Streams.stdout += Testers.ContainsExpression(
+    "Received an HTTP/2 request for stream id 3:",
+    "The server should receive the requests over h2c.")
+
+server.Streams.stdout += Testers.ContainsExpression(
+    "Wrote .* bytes in an HTTP/2 response to request with key 2 ",
+    "The server should respond over h2c.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+server.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
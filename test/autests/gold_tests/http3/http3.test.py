@@ -64,3 +64,75 @@ client.Streams.stdout += Testers.ContainsExpression(
 client.Streams.stdout += Testers.ContainsExpression(
     'HTTP/3 Status Violation: expected 502 got 200',
     "There should a status violation for an unexpected 502 response.")
+
+#
+# Test 3: Verify HTTP/3 between the client and the server without a proxy.
+#
+r = Test.AddTestRun("Verify HTTP/3 from the client directly to the server")
+server = r.AddServerProcess("server3", "replay_files/http3_no_proxy.yaml")
+client = r.AddClientProcess("client3", "replay_files/http3_no_proxy.yaml",
+                            configure_http=False, configure_https=False,
+                            http3_ports=[server.Variables.http3_port],
+                            other_args="--no-proxy")
+
+server.Streams.stdout += Testers.ContainsExpression(
+    "Listening for HTTP/3 at: .* on [0-9]+ sockets",
+    "The server should listen for HTTP/3.")
+
+server.Streams.stdout += Testers.ContainsExpression(
+    "Received an HTTP/3 request for key 2 with stream id",
+    "The server should receive the HTTP/3 requests.")
+
+server.Streams.stdout += Testers.ContainsExpression(
+    "Sent the following HTTP/3 headers for stream id",
+    "The server should send HTTP/3 responses.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "Received an HTTP/3 response for key 1 with stream id",
+    "The client should receive the first HTTP/3 response.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "Received an HTTP/3 response for key 2 with stream id",
+    "The client should receive the second HTTP/3 response.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "2 transactions in 1 sessions",
+    "The client should replay both transactions.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+server.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+#
+# Test 4: Verify HTTP/3 over client UDP sockets shared between connections.
+#
+r = Test.AddTestRun("Verify --h3-sockets-per-core")
+server = r.AddServerProcess("server4", "replay_files/http3_no_proxy.yaml")
+client = r.AddClientProcess("client4", "replay_files/http3_no_proxy.yaml",
+                            configure_http=False, configure_https=False,
+                            http3_ports=[server.Variables.http3_port],
+                            other_args="--no-proxy --h3-sockets-per-core 1")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "Opened [0-9]+ shared HTTP/3 client sockets for",
+    "The client should open the shared sockets.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "Received an HTTP/3 response for key 2 with stream id",
+    "The client should receive the responses through the shared socket.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "2 transactions in 1 sessions",
+    "The client should replay both transactions.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+server.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
@@ -0,0 +1,47 @@
+'''
+Verify HTTP/1 request pipelining.
+'''
+# @file
+#
+# Copyright 2021, Verizon Media
+# SPDX-License-Identifier: Apache-2.0
+#
+
+Test.Summary = '''
+Verify HTTP/1 request pipelining.
+'''
+
+#
+# Test 1: Verify that a pipelining client writes its requests ahead of the
+# responses and still verifies each response against its own transaction.
+#
+r = Test.AddTestRun("Verify --pipeline-depth")
+server = r.AddServerProcess("server", "replay_files/pipelined.yaml",
+                            configure_https=False, configure_http3=False)
+client = r.AddClientProcess("client", "replay_files/pipelined.yaml",
+                            http_ports=[server.Variables.http_port],
+                            configure_https=False, configure_http3=False,
+                            other_args="--no-proxy --pipeline-depth 4")
+
+# All four requests arrive before the delayed first response is written.
+server.Streams.stdout = "gold/pipelined_server.gold"
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "4 transactions in 1 sessions",
+    "The client should replay all four transactions on one session.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "Received an HTTP/1 200 response for key 4 ",
+    "The client should receive the response to the last pipelined request.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Resending them",
+    "The server should not close the connection with requests outstanding.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+server.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
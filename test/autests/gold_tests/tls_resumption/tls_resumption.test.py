@@ -0,0 +1,197 @@
+'''
+Verify TLS session resumption and early data.
+'''
+# @file
+#
+# Copyright 2021, Verizon Media
+# SPDX-License-Identifier: Apache-2.0
+#
+
+import os
+
+Test.Summary = '''
+Verify TLS session resumption and early data.
+'''
+
+#
+# Test 1: Verify that the client resumes the sessions the server issues.
+#
+r = Test.AddTestRun("Verify --tls-resumption")
+server = r.AddServerProcess("server_resumption", "replay_files/resumption.yaml",
+                            configure_http3=False)
+client = r.AddClientProcess("client_resumption", "replay_files/resumption.yaml",
+                            configure_http=False, configure_http3=False,
+                            https_ports=[server.Variables.https_port],
+                            other_args="--no-proxy --tls-resumption 1")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "Full TLS handshake with the proxy took",
+    "The first session should perform a full handshake.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "Resumed TLS handshake with the proxy took",
+    "Later sessions should resume the cached session.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "TLS handshakes: 1 full averaging .*, 2 resumed averaging .*, 0 offered sessions declined.",
+    "The client should report the handshakes of each kind.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+server.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+#
+# Test 2: Verify that early data is only sent when the session allows it.
+#
+r = Test.AddTestRun("Verify --tls-early-data")
+server = r.AddServerProcess("server_early_data", "replay_files/resumption.yaml",
+                            configure_http3=False)
+client = r.AddClientProcess("client_early_data", "replay_files/resumption.yaml",
+                            configure_http=False, configure_http3=False,
+                            https_ports=[server.Variables.https_port],
+                            other_args="--no-proxy --tls-resumption 1 --tls-early-data")
+
+# verifier-server does not allow early data in the sessions it issues, so the
+# resumed connections send their first requests after the handshake.
+client.Streams.stdout += Testers.ContainsExpression(
+    "TLS early data: 0 accepted, 0 rejected. First transactions: 0 0-RTT averaging .*, "
+    "3 1-RTT averaging",
+    "The client should report its first transactions as 1-RTT.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "TLS handshakes: 1 full averaging .*, 2 resumed averaging",
+    "Later sessions should still be resumed.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "3 transactions in 3 sessions",
+    "The client should replay all the transactions.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+server.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+#
+# Test 3: Verify resumption across servers sharing ticket keys from a file.
+#
+r = Test.AddTestRun("Verify --tls-session-cache-size and --tls-ticket-key-file")
+ticket_key_file = os.path.join(Test.RunDirectory, "ticket.key")
+server_args = f"--tls-session-cache-size 0 --tls-ticket-key-file {ticket_key_file}"
+server1 = r.AddServerProcess("server_ticket_keys1", "replay_files/resumption.yaml",
+                             configure_http3=False, other_args=server_args)
+server2 = r.AddServerProcess("server_ticket_keys2", "replay_files/resumption.yaml",
+                             configure_http3=False, other_args=server_args)
+# The client alternates between the two servers, so each resumed session was
+# issued by the other server.
+client = r.AddClientProcess("client_ticket_keys", "replay_files/resumption.yaml",
+                            configure_http=False, configure_http3=False,
+                            https_ports=[server1.Variables.https_port,
+                                         server2.Variables.https_port],
+                            other_args="--no-proxy --tls-resumption 1")
+
+# Without a session cache, only tickets encrypted with the keys both servers
+# load from the file let the client resume.
+client.Streams.stdout += Testers.ContainsExpression(
+    "TLS handshakes: 1 full averaging .*, 2 resumed averaging .*, 0 offered sessions declined.",
+    "Later sessions should resume by ticket on the other server.")
+
+r.Disk.File(ticket_key_file, exists=True)
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+for server in (server1, server2):
+    server.Streams.stdout += Testers.ContainsExpression(
+        "Received an HTTP/1 request with key [123]",
+        "Each server should receive at least one of the requests.")
+
+    server.Streams.stdout += Testers.ExcludesExpression(
+        "Violation:",
+        "There should be no verification errors because there are none added.")
+
+#
+# Test 4: Verify that early data is sent and accepted when the server allows it.
+#
+r = Test.AddTestRun("Verify accepted --tls-early-data")
+server = r.AddServerProcess("server_early_data_accepted", "replay_files/resumption.yaml",
+                            configure_http3=False,
+                            other_args="--tls-max-early-data 16384")
+client = r.AddClientProcess("client_early_data_accepted", "replay_files/resumption.yaml",
+                            configure_http=False, configure_http3=False,
+                            https_ports=[server.Variables.https_port],
+                            other_args="--no-proxy --tls-resumption 1 --tls-early-data")
+
+# Each resumed connection sends its request along with the client hello.
+client.Streams.stdout += Testers.ContainsExpression(
+    "TLS early data: 2 accepted, 0 rejected. First transactions: 2 0-RTT averaging .*, "
+    "1 1-RTT averaging",
+    "The resumed connections should send their first requests as 0-RTT.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "3 transactions in 3 sessions",
+    "The client should replay all the transactions.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+server.Streams.stdout += Testers.ContainsExpression(
+    "Accepted [0-9]+ bytes of TLS early data.",
+    "The server should read the requests sent as early data.")
+
+server.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+#
+# Test 5: Verify that rejected early data is resent after the handshake.
+#
+r = Test.AddTestRun("Verify rejected --tls-early-data")
+early_data_key_file = os.path.join(Test.RunDirectory, "early_data_ticket.key")
+server1 = r.AddServerProcess(
+    "server_early_data_rejected1", "replay_files/resumption.yaml",
+    configure_http3=False,
+    other_args=f"--tls-max-early-data 16384 --tls-ticket-key-file {early_data_key_file}")
+server2 = r.AddServerProcess(
+    "server_early_data_rejected2", "replay_files/resumption.yaml",
+    configure_http3=False,
+    other_args=f"--tls-ticket-key-file {early_data_key_file}")
+# The session from the first server allows early data, but only that server
+# can resume it. The second server declines it and so rejects the early data
+# sent with it. Its own session, which the first server resumes, does not allow
+# early data.
+client = r.AddClientProcess("client_early_data_rejected", "replay_files/resumption.yaml",
+                            configure_http=False, configure_http3=False,
+                            https_ports=[server1.Variables.https_port,
+                                         server2.Variables.https_port],
+                            other_args="--no-proxy --tls-resumption 1 --tls-early-data")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "The proxy rejected TLS early data: resending",
+    "The client should resend the rejected early data.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "TLS early data: 0 accepted, 1 rejected. First transactions: 0 0-RTT averaging .*, "
+    "3 1-RTT averaging",
+    "The client should report the rejected early data.")
+
+client.Streams.stdout += Testers.ContainsExpression(
+    "3 transactions in 3 sessions",
+    "The client should replay all the transactions.")
+
+client.Streams.stdout += Testers.ExcludesExpression(
+    "Violation:",
+    "There should be no verification errors because there are none added.")
+
+for server in (server1, server2):
+    server.Streams.stdout += Testers.ExcludesExpression(
+        "Violation:",
+        "There should be no verification errors because there are none added.")
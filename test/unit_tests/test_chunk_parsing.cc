@@ -102,3 +102,26 @@ TEST_CASE("Check parsing of a chunked body", "[RuleCheck]")
   REQUIRE(num_body_bytes == 21);
   REQUIRE(accumulated_body == "123456789012345678901");
 }
+
+TEST_CASE("Check content after the final chunk is not consumed", "[RuleCheck]")
+{
+  size_t num_body_bytes = 0;
+  ChunkCodex codex;
+  ChunkCodex::ChunkCallback cb{
+      [&num_body_bytes](TextView block, size_t /* offset */, size_t /* size */) -> bool {
+        num_body_bytes += block.size();
+        return true;
+      }};
+
+  constexpr TextView chunk_stream{"3\r\nabc\r\n0\r\n\r\n"};
+  constexpr TextView next_message{"GET / HTTP/1.1\r\n\r\n"};
+  std::string received{chunk_stream};
+  received += next_message;
+
+  size_t consumed = 0;
+  REQUIRE(ChunkCodex::CONTINUE == codex.parse(received.substr(0, 5), cb, consumed));
+  REQUIRE(consumed == 5);
+  REQUIRE(ChunkCodex::DONE == codex.parse(TextView{received}.substr(5), cb, consumed));
+  REQUIRE(num_body_bytes == 3);
+  REQUIRE(consumed == chunk_stream.size() - 5);
+}
@@ -7,6 +7,8 @@
 
 #include "catch.hpp"
 #include "core/http.h"
+#include "core/http2.h"
+#include "core/http3.h"
 
 struct ParseUrlTestCase
 {
@@ -255,3 +257,272 @@ TEST_CASE("Test path parsing", "[ParseUrl]")
   CHECK(header.uri_query == test_case.expected_uri_query);
   CHECK(header.uri_fragment == test_case.expected_uri_fragment);
 }
+
+TEST_CASE("Test request template rendering and matching", "[RequestTemplate]")
+{
+  CHECK_FALSE(RequestTemplate::has_tokens("/plain/path"));
+  CHECK(RequestTemplate::has_tokens("/path?i={{iteration}}"));
+
+  SECTION("Unknown and unterminated tokens are rejected")
+  {
+    CHECK_FALSE(RequestTemplate::compile("/path?x={{bogus}}").errata().is_ok());
+    CHECK_FALSE(RequestTemplate::compile("/path?x={{iteration").errata().is_ok());
+  }
+
+  SECTION("Iteration and session tokens render the context")
+  {
+    auto &&[request_template, errata] =
+        RequestTemplate::compile("/a/{{session}}/b?i={{iteration}}");
+    REQUIRE(errata.is_ok());
+    swoc::MemArena arena;
+    TemplateContext context;
+    context._iteration = 12;
+    context._session_index = 3;
+    auto const rendered =
+        request_template.render(arena, RequestTemplate::make_values(context));
+    CHECK(rendered == "/a/3/b?i=12");
+    CHECK(request_template.matches(rendered));
+    CHECK(request_template.matches("/a/40/b?i=7"));
+    CHECK_FALSE(request_template.matches("/a/x/b?i=7"));
+    CHECK_FALSE(request_template.matches("/a/3/b?i=12&extra"));
+    CHECK_FALSE(request_template.matches("/A/3/B?i=12"));
+    CHECK(request_template.matches("/A/3/B?I=12", true));
+  }
+
+  SECTION("Random and unique tokens differ across requests")
+  {
+    auto &&[request_template, errata] = RequestTemplate::compile("k-{{random}}-{{unique}}");
+    REQUIRE(errata.is_ok());
+    swoc::MemArena arena;
+    auto const first = request_template.render(arena, RequestTemplate::make_values({}));
+    auto const second = request_template.render(arena, RequestTemplate::make_values({}));
+    CHECK(first != second);
+    CHECK(first.size() > 2 + RequestTemplate::RANDOM_WIDTH);
+    CHECK(request_template.matches(first));
+    CHECK(request_template.matches(second));
+    CHECK_FALSE(request_template.matches("k-1234-5"));
+  }
+
+  SECTION("A request renders its URL and fields with the same values")
+  {
+    HttpHeader header;
+    header.set_is_request();
+    header._method = "GET";
+    header._http_version = "1.1";
+    header._url = "/k/{{unique}}/{{random}}";
+    header._fields_rules->add_field("uuid", "{{unique}}/{{random}}");
+    header._fields_rules->add_field("host", "example.com");
+    REQUIRE(header.compile_templates().is_ok());
+    REQUIRE(header.has_templates());
+
+    swoc::LocalBufferWriter<1024> w;
+    TemplateContext context;
+    context._iteration = 2;
+    REQUIRE(header.serialize(w, context).is_ok());
+    swoc::TextView serialized{w.view()};
+    auto next_line = [&serialized]() { return serialized.take_prefix_at('\n').rtrim('\r'); };
+    auto request_line = next_line();
+    CHECK(request_line.take_prefix_at(' ') == "GET");
+    auto url = request_line.take_prefix_at(' ');
+    CHECK(request_line == "HTTP/1.1");
+    CHECK(header._templates->_url->matches(url));
+    auto uuid = next_line();
+    CHECK(uuid.take_prefix_at(':') == "uuid");
+    uuid.ltrim(' ');
+    CHECK(url == "/k/" + std::string{uuid});
+    CHECK(next_line() == "host: example.com");
+    CHECK(next_line().empty());
+    CHECK(serialized.empty());
+
+    // A second request draws new values.
+    swoc::LocalBufferWriter<1024> w2;
+    REQUIRE(header.serialize(w2, context).is_ok());
+    CHECK(w2.view() != w.view());
+  }
+}
+
+TEST_CASE("Test HTTP/2 settings parsing", "[H2Settings]")
+{
+  SECTION("Listed settings are set and others are left unset")
+  {
+    H2Settings settings;
+    auto const errata =
+        settings.parse("initial-window-size=1048576, connection-window-size = 16777216");
+    REQUIRE(errata.is_ok());
+    CHECK(settings._initial_window_size == 1048576u);
+    CHECK(settings._connection_window_size == 16777216u);
+    CHECK_FALSE(settings._max_concurrent_streams.has_value());
+    CHECK_FALSE(settings._max_frame_size.has_value());
+    CHECK_FALSE(settings._header_table_size.has_value());
+  }
+
+  SECTION("Unknown names and out of range values are rejected")
+  {
+    H2Settings settings;
+    CHECK_FALSE(settings.parse("bogus=1").is_ok());
+    CHECK_FALSE(settings.parse("max-frame-size=1024").is_ok());
+    CHECK_FALSE(settings.parse("initial-window-size=4294967295").is_ok());
+    CHECK_FALSE(settings.parse("header-table-size=12ab").is_ok());
+  }
+
+  SECTION("Merging takes only the unset values from the defaults")
+  {
+    H2Settings settings;
+    REQUIRE(settings.parse("max-concurrent-streams=10,header-table-size=0").is_ok());
+    H2Settings defaults;
+    REQUIRE(defaults.parse("max-concurrent-streams=1000,max-frame-size=65536").is_ok());
+    settings.merge(defaults);
+    CHECK(settings._max_concurrent_streams == 10u);
+    CHECK(settings._header_table_size == 0u);
+    CHECK(settings._max_frame_size == 65536u);
+    CHECK_FALSE(settings._initial_window_size.has_value());
+  }
+}
+
+TEST_CASE("Test QUIC settings parsing", "[QuicSettings]")
+{
+  SECTION("Listed settings are set and others are left unset")
+  {
+    QuicSettings settings;
+    auto const errata = settings.parse(
+        "initial-max-data=67108864, initial-max-streams-bidi = 1000, "
+        "congestion-control=BBR,pacing=on");
+    REQUIRE(errata.is_ok());
+    CHECK(settings._initial_max_data == 67108864u);
+    CHECK(settings._initial_max_streams_bidi == 1000u);
+    CHECK(settings._congestion_control == QuicSettings::CongestionControl::BBR);
+    CHECK(settings._pacing == true);
+    CHECK_FALSE(settings._initial_max_stream_data.has_value());
+    CHECK_FALSE(settings._max_udp_payload_size.has_value());
+  }
+
+  SECTION("Unknown names and invalid values are rejected")
+  {
+    QuicSettings settings;
+    CHECK_FALSE(settings.parse("bogus=1").is_ok());
+    CHECK_FALSE(settings.parse("max-udp-payload-size=1000").is_ok());
+    CHECK_FALSE(settings.parse("max-udp-payload-size=65527").is_ok());
+    CHECK_FALSE(settings.parse("initial-max-streams-uni=2").is_ok());
+    CHECK_FALSE(settings.parse("congestion-control=vegas").is_ok());
+    CHECK_FALSE(settings.parse("pacing=maybe").is_ok());
+  }
+
+  SECTION("Merging takes only the unset values from the defaults")
+  {
+    QuicSettings settings;
+    REQUIRE(settings.parse("congestion-control=reno,pacing=off").is_ok());
+    QuicSettings defaults;
+    REQUIRE(defaults.parse("congestion-control=cubic,pacing=on,initial-max-data=1024").is_ok());
+    settings.merge(defaults);
+    CHECK(settings._congestion_control == QuicSettings::CongestionControl::RENO);
+    CHECK(settings._pacing == false);
+    CHECK(settings._initial_max_data == 1024u);
+    CHECK_FALSE(settings._initial_max_streams_uni.has_value());
+  }
+}
+
+TEST_CASE("Test the stream table and stream state pool", "[StreamTable]")
+{
+  struct State
+  {
+    State(int value) : _value{value} { }
+    void
+    reset(int value)
+    {
+      _value = value;
+    }
+    void
+    clear()
+    {
+      _value = -1;
+    }
+    int _value;
+  };
+
+  SECTION("Streams are found until they are erased")
+  {
+    std::vector<State> states;
+    for (int i = 0; i < 200; ++i) {
+      states.emplace_back(i);
+    }
+    StreamTable<int32_t, State> table;
+    CHECK(table.empty());
+    CHECK(table.find(1) == nullptr);
+    CHECK(table.erase(1) == nullptr);
+    // Client stream identifiers are odd.
+    for (int i = 0; i < 200; ++i) {
+      table.insert(2 * i + 1, &states[i]);
+    }
+    CHECK(table.size() == 200);
+    for (int i = 0; i < 200; ++i) {
+      REQUIRE(table.find(2 * i + 1) == &states[i]);
+    }
+    CHECK(table.find(2) == nullptr);
+    // Erase every third stream, then check the remainder are still reachable.
+    for (int i = 0; i < 200; i += 3) {
+      CHECK(table.erase(2 * i + 1) == &states[i]);
+    }
+    for (int i = 0; i < 200; ++i) {
+      CHECK(table.find(2 * i + 1) == (i % 3 == 0 ? nullptr : &states[i]));
+    }
+    CHECK(table.size() == 133);
+    for (int i = 0; i < 200; ++i) {
+      table.erase(2 * i + 1);
+    }
+    CHECK(table.empty());
+  }
+
+  SECTION("Released states are reused")
+  {
+    StreamStatePool<State> pool;
+    auto *first = pool.acquire(1);
+    auto *second = pool.acquire(2);
+    CHECK(first != second);
+    pool.release(first);
+    CHECK(first->_value == -1);
+    auto *third = pool.acquire(3);
+    CHECK(third == first);
+    CHECK(third->_value == 3);
+  }
+
+  SECTION("HTTP/2 stream headers are reused across streams")
+  {
+    StreamStatePool<H2StreamState> pool;
+    auto *first = pool.acquire();
+    first->set_stream_id(1);
+    auto *const request = first->_request_from_client.get();
+    auto *const request_fields = request->_fields_rules.get();
+    request->_method = "GET";
+    request->set_key("first-key");
+    for (int i = 0; i < 40; ++i) {
+      request->_fields_rules->add_field("x-field", "value");
+    }
+    auto const fields_capacity = request_fields->_fields_sequence.capacity();
+    first->_response_from_server->_status = 200;
+
+    pool.release(first);
+    auto *second = pool.acquire();
+    REQUIRE(second == first);
+    second->set_stream_id(3);
+    // The same headers, with the same field storage, serve the new stream.
+    CHECK(second->_request_from_client.get() == request);
+    CHECK(second->_request_from_client->_fields_rules.get() == request_fields);
+    CHECK(request_fields->_fields_sequence.capacity() == fields_capacity);
+    CHECK(request_fields->_fields_sequence.empty());
+    CHECK(request_fields->_fields.empty());
+    CHECK(request->_method.empty());
+    CHECK(request->get_key() == HttpHeader::TRANSACTION_KEY_NOT_SET);
+    CHECK(request->is_request());
+    CHECK(request->is_http2());
+    CHECK(request->_stream_id == 3);
+    CHECK(second->_response_from_server->_status == 0);
+    CHECK(second->_response_from_server->is_response());
+
+    // A request still held by the caller is left to it.
+    auto const held = second->_request_from_client;
+    pool.release(second);
+    auto *third = pool.acquire();
+    CHECK(third->_request_from_client.get() != held.get());
+    CHECK(third->_request_from_client->is_request());
+  }
+}